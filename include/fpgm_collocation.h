@@ -26,6 +26,8 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <chrono>
+#include <algorithm>
 
 #include "math.hpp"
 #include "geo.h"
@@ -71,6 +73,58 @@ namespace fpgm_collocation
     class equations_and_helper
     {
         public:
+            /** @brief Wind in the trajectory frame (x along the descend, z up), m/s
+             * - CONSTANT : (x, z)
+             * - SHEAR : x + shear_x * (height - reference_height), z constant
+             * - TABLE : (table_x, table_z) sampled every table_dt from t = 0, linear in between
+             * and held at the ends, one index computation per lookup
+             * The aerodynamic forces use the velocity relative to the air mass,
+             * the states stay in the ground frame
+            **/
+            struct wind_field
+            {
+                enum wind_model {NONE, CONSTANT, SHEAR, TABLE};
+
+                wind_model model;
+                double x, z;
+                double shear_x;
+                double reference_height;
+                double table_dt;
+                vector<double> table_x, table_z;
+
+                wind_field() : model(NONE), x(0), z(0), shear_x(0),
+                    reference_height(0), table_dt(0) {}
+
+                void at(double height, double t, double &wx, double &wz) const
+                {
+                    switch (model)
+                    {
+                        case CONSTANT:
+                            wx = x; wz = z;
+                            return;
+                        case SHEAR:
+                            wx = x + shear_x * (height - reference_height); wz = z;
+                            return;
+                        case TABLE:
+                        {
+                            int n = (int)table_x.size();
+                            if (n == 0 || table_dt <= 0)
+                                break;
+                            double s = std::max(0.0, std::min((double)(n - 1), t / table_dt));
+                            int i = std::min((int)s, std::max(n - 2, 0));
+                            double w = n > 1 ? s - i : 0.0;
+                            int j = std::min(i + 1, n - 1);
+                            wx = (1 - w) * table_x[i] + w * table_x[j];
+                            wz = (1 - w) * table_z[i] + w * table_z[j];
+                            return;
+                        }
+                        default:
+                            break;
+                    }
+                    wx = 0; wz = 0;
+                }
+            };
+
             struct fpgm_param
             {
                 double l_w, l_e, l;
@@ -78,8 +132,48 @@ namespace fpgm_collocation
                 double mass;
                 double I; // I is only rotation in single axis
                 double h; // Time-step
-                Eigen::MatrixXd Q;
+                // Per interval time-steps h_k and the knot times, empty when every interval is h
+                vector<double> steps, times;
+                Eigen::Matrix<double, 7, 7> Q;
+                // Diagonal of Q, used by the weighted sum of squares fast path
+                Eigen::Matrix<double, 7, 1> Q_diagonal;
+                bool Q_is_diagonal;
                 double R;
+                wind_field wind;
+
+                double step(int k) const { return steps.empty() ? h : steps[k]; }
+
+                double time(int k) const { return times.empty() ? k * h : times[k]; }
+
+                /** @brief trapezoidal quadrature weight of knot k out of size knots **/
+                double weight(int k, int size) const
+                {
+                    if (size < 2)
+                        return h;
+                    return ((k > 0 ? step(k-1) : 0.0) + (k < size - 1 ? step(k) : 0.0)) / 2;
+                }
+
+                /** @brief per interval steps, an empty vector goes back to the uniform h **/
+                void set_steps(const vector<double> &h_k)
+                {
+                    steps = h_k;
+                    times.assign(steps.empty() ? 0 : steps.size() + 1, 0.0);
+                    for (size_t k = 0; k < steps.size(); k++)
+                        times[k+1] = times[k] + steps[k];
+                }
+            };
+
+            /** @brief Touchdown at the last knot, against the landing point (ix.back(), iz.back())
+             * a tolerance or max_speed <= 0 and theta_min >= theta_max leave that part out
+             * terminal cost = position_weight * |p - p_land|^2 + speed_weight * |v|^2
+            **/
+            struct terminal_constrain
+            {
+                bool enabled;
+                double x_tolerance, z_tolerance; // position box
+                double max_speed; // touchdown speed
+                double theta_min, theta_max; // pitch window (rad)
+                double position_weight, speed_weight;
             };
 
             struct optimization_constrain
@@ -91,12 +185,14 @@ namespace fpgm_collocation
                 double pd_c;
                 vector<double> ix;
                 vector<double> iz;
+                terminal_constrain terminal;
             };
 
             struct combined_param
             {
                 fpgm_param fp;
                 optimization_constrain oc;
+                bool verbose;
             };
 
             double cl(double aoa) { return 2 * sin(aoa) * cos(aoa);};
@@ -114,14 +210,20 @@ namespace fpgm_collocation
              * @param zdot
              * @param thetadot
              * @param phidot
+             * @param t time from the first knot, for the wind lookup
              * **/
-            Eigen::VectorXd fpgm_dynamics(
+            Eigen::Matrix<double, 7, 1> fpgm_dynamics(
                 double x, double z, double theta, double phi, double xdot, double zdot, double thetadot, double phidot,
-                fpgm_param parameter)
+                const fpgm_param &parameter, double t = 0.0)
             {
                 double g = 9.81 , p = 1.225; // Density of air = 1.225 kg/m
 
-                Eigen::VectorXd dx(7);
+                Eigen::Matrix<double, 7, 1> dx;
+
+                // velocities relative to the air mass for the aerodynamic forces
+                double wind_x, wind_z;
+                parameter.wind.at(z, t, wind_x, wind_z);
+                double air_xdot = xdot - wind_x, air_zdot = zdot - wind_z;
 
                 // force_vectors
                 Eigen::Vector2d n_w = Eigen::Vector2d(-sin(theta), cos(theta));
@@ -135,11 +237,11 @@ namespace fpgm_collocation
                     z - parameter.l * sin(theta) - parameter.l_e * sin(theta + phi));
                 
                 Eigen::Vector2d x_w_dot = Eigen::Vector2d(
-                    xdot + parameter.l_w * thetadot * sin(theta), 
-                    zdot - parameter.l_w * thetadot * cos(theta));
+                    air_xdot + parameter.l_w * thetadot * sin(theta), 
+                    air_zdot - parameter.l_w * thetadot * cos(theta));
                 Eigen::Vector2d x_e_dot = Eigen::Vector2d(
-                    xdot + parameter.l * thetadot * sin(theta) + parameter.l_e * (thetadot + phidot) * sin(theta + phi), 
-                    zdot - parameter.l * thetadot * cos(theta) - parameter.l_e * (thetadot + phidot) * cos(theta + phi));
+                    air_xdot + parameter.l * thetadot * sin(theta) + parameter.l_e * (thetadot + phidot) * sin(theta + phi), 
+                    air_zdot - parameter.l * thetadot * cos(theta) - parameter.l_e * (thetadot + phidot) * cos(theta + phi));
 
                 double alpha_w = theta - atan(x_w_dot[1] / x_w_dot[0]);
                 double alpha_e = theta + phi - atan(x_e_dot[1] / x_e_dot[0]);
@@ -169,6 +271,54 @@ namespace fpgm_collocation
                 return dx;
             }
 
+            /** @brief jacobian of fpgm_dynamics with respect to [x, u] using central differences
+             * @param s = [x, z, theta, phi, xdot, zdot, thetadot, phidot]
+             * @return 7x8 matrix, columns follow the order of s
+             * **/
+            Eigen::Matrix<double, 7, 8> fpgm_jacobian(
+                const double *s, const fpgm_param &parameter, double t = 0.0)
+            {
+                Eigen::Matrix<double, 7, 8> jacobian;
+                double sp[8], sm[8];
+                for (int j = 0; j < 8; j++)
+                {
+                    std::copy(s, s + 8, sp);
+                    std::copy(s, s + 8, sm);
+                    double step = 1E-6 * std::max(1.0, fabs(s[j]));
+                    sp[j] += step;
+                    sm[j] -= step;
+
+                    Eigen::Matrix<double, 7, 1> f_p = fpgm_dynamics(
+                        sp[0], sp[1], sp[2], sp[3], sp[4], sp[5], sp[6], sp[7], parameter, t);
+                    Eigen::Matrix<double, 7, 1> f_m = fpgm_dynamics(
+                        sm[0], sm[1], sm[2], sm[3], sm[4], sm[5], sm[6], sm[7], parameter, t);
+                    jacobian.col(j) = (f_p - f_m) / (2 * step);
+                }
+                return jacobian;
+            }
+
+            /** @brief classical runge kutta step of fpgm_dynamics, phidot held constant over dt
+             * @param s = [x, z, theta, phi, xdot, zdot, thetadot]
+             * @param t time at the start of the step
+             * **/
+            Eigen::Matrix<double, 7, 1> rk4_step(
+                const Eigen::Matrix<double, 7, 1> &s, double phidot, double dt,
+                const fpgm_param &parameter, double t = 0.0)
+            {
+                Eigen::Matrix<double, 7, 1> k1 = fpgm_dynamics(
+                    s[0], s[1], s[2], s[3], s[4], s[5], s[6], phidot, parameter, t);
+                Eigen::Matrix<double, 7, 1> s2 = s + dt/2 * k1;
+                Eigen::Matrix<double, 7, 1> k2 = fpgm_dynamics(
+                    s2[0], s2[1], s2[2], s2[3], s2[4], s2[5], s2[6], phidot, parameter, t + dt/2);
+                Eigen::Matrix<double, 7, 1> s3 = s + dt/2 * k2;
+                Eigen::Matrix<double, 7, 1> k3 = fpgm_dynamics(
+                    s3[0], s3[1], s3[2], s3[3], s3[4], s3[5], s3[6], phidot, parameter, t + dt/2);
+                Eigen::Matrix<double, 7, 1> s4 = s + dt * k3;
+                Eigen::Matrix<double, 7, 1> k4 = fpgm_dynamics(
+                    s4[0], s4[1], s4[2], s4[3], s4[4], s4[5], s4[6], phidot, parameter, t + dt);
+                return s + dt/6 * (k1 + 2*k2 + 2*k3 + k4);
+            }
+
             Eigen::VectorXd std_vector_to_eigen_vector(std::vector<double> x)
             {
                 int vector_size = (int)x.size();
@@ -187,6 +337,19 @@ namespace fpgm_collocation
 
     };
 
+    /** @brief Mesh refinement after a solve (landing_problem::solve)
+     * - tolerance : max relative error between a knot and the integration of
+     * fpgm_dynamics from the previous knot, 0 disables the refinement
+     * - substeps : rk4 steps per interval for the error estimate
+    **/
+    struct mesh_options
+    {
+        double tolerance = 0.0;
+        int max_passes = 3;
+        int max_knots = 200;
+        int substeps = 8;
+    };
+
     class fpgm_collocation
     {
 
@@ -195,6 +358,7 @@ namespace fpgm_collocation
             equations_and_helper::fpgm_param param;
             equations_and_helper::optimization_constrain boundary;
             int N;
+            bool verbose = true;
 
             std::vector<double> guess;
 
@@ -214,11 +378,15 @@ namespace fpgm_collocation
                 equations_and_helper::combined_param *params = 
                     (equations_and_helper::combined_param*)data;
                 
-                equations_and_helper::fpgm_param fpgm = params->fp;
-                equations_and_helper::optimization_constrain boundary = params->oc;
+                const equations_and_helper::fpgm_param &fpgm = params->fp;
+                const equations_and_helper::optimization_constrain &boundary = params->oc;
 
                 int state_input_length = n / 8;
 
+                // grad is row major m x n, d(result[i]) / d(x[j]) = grad[i*n + j]
+                if (grad)
+                    std::fill(grad, grad + m * n, 0.0);
+
                 for (int i = 0; i < state_input_length; i++)
                 {
                     // Give a threshold that is from the guess
@@ -245,12 +413,12 @@ namespace fpgm_collocation
                         Eigen::VectorXd f_k = eq.fpgm_dynamics(
                             x1[0], x1[1], x1[2], x1[3], 
                             x1[4], x1[5], x1[6], x[7+8*i],
-                            fpgm);
+                            fpgm, fpgm.time(i));
                         // future dynamics
                         Eigen::VectorXd f_k_1 = eq.fpgm_dynamics(
                             x2[0], x2[1], x2[2], x2[3], 
                             x2[4], x2[5], x2[6], x[7+8*(i+1)],
-                            fpgm);
+                            fpgm, fpgm.time(i+1));
 
                         Eigen::VectorXd x_k = eq.std_vector_to_eigen_vector(x1);
                         Eigen::VectorXd x_k_1 = eq.std_vector_to_eigen_vector(x2);
@@ -259,7 +427,7 @@ namespace fpgm_collocation
                         // https://arxiv.org/pdf/2001.11478.pdf
                         // https://epubs.siam.org/doi/pdf/10.1137/16M1062569
                         Eigen::VectorXd single_results_vector = 
-                            x_k - x_k_1 + (fpgm.h)/2 * (f_k + f_k_1);
+                            x_k - x_k_1 + fpgm.step(i)/2 * (f_k + f_k_1);
 
                         // https://dspace.mit.edu/handle/1721.1/93861
                         // Eigen::VectorXd lhs = params->h * f_k;
@@ -286,6 +454,38 @@ namespace fpgm_collocation
                             //     printf(" %d violate constrains %lf / %lf\n", 
                             //         j, single_results_vector[j], tolerance);
                         }
+
+                        if (grad)
+                        {
+                            // d(defect)/d(s_k) = [I 0] + h_k/2 * J_k
+                            // d(defect)/d(s_k+1) = -[I 0] + h_k/2 * J_k+1
+                            Eigen::Matrix<double, 7, 8> d_k = fpgm.step(i)/2 * eq.fpgm_jacobian(x + 8*i, fpgm, fpgm.time(i));
+                            Eigen::Matrix<double, 7, 8> d_k_1 = fpgm.step(i)/2 * eq.fpgm_jacobian(x + 8*(i+1), fpgm, fpgm.time(i+1));
+                            for (int j = 0; j < 7; j++)
+                            {
+                                d_k(j,j) += 1.0;
+                                d_k_1(j,j) -= 1.0;
+                            }
+
+                            for (int j = 0; j < 7; j++)
+                            {
+                                double *upper_row = grad + ((j*2) + 1 + (i*26)) * n;
+                                double *lower_row = grad + ((j*2) + (i*26)) * n;
+                                for (int k = 0; k < 8; k++)
+                                {
+                                    upper_row[k+8*i] = d_k(j,k);
+                                    upper_row[k+8*(i+1)] = d_k_1(j,k);
+                                    lower_row[k+8*i] = -d_k(j,k);
+                                    lower_row[k+8*(i+1)] = -d_k_1(j,k);
+                                }
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // No defect after the last state, keep these rows satisfied
+                        for (int j = 0; j < 7; j++)
+                            eq.set_bounded_constrains(result, ((j*2) + (i*26)), 0.0, 0.01);
                     }
                     
                     // (14 & 15) theta constrains for lower and upper bound
@@ -306,6 +506,27 @@ namespace fpgm_collocation
 
                 eq.set_bounded_constrains(result, 0 + (state_input_length)*26, x[0], boundary.ix[0]);
                 eq.set_bounded_constrains(result, 2 + (state_input_length)*26, x[1], boundary.iz[0]);
+
+                if (grad)
+                {
+                    // bounded constrains (0 & 1) are [-x - bound, x - bound]
+                    const int bounded_index[6] = {2, 3, 4, 5, 6, 7};
+                    for (int i = 0; i < state_input_length; i++)
+                        for (int b = 0; b < 6; b++)
+                        {
+                            grad[(b*2 + 14 + (i*26)) * n + bounded_index[b] + 8*i] = -1.0;
+                            grad[(b*2 + 1 + 14 + (i*26)) * n + bounded_index[b] + 8*i] = 1.0;
+                        }
+                    grad[(0 + (state_input_length)*26) * n + 0] = -1.0;
+                    grad[(1 + (state_input_length)*26) * n + 0] = 1.0;
+                    grad[(2 + (state_input_length)*26) * n + 1] = -1.0;
+                    grad[(3 + (state_input_length)*26) * n + 1] = 1.0;
+                }
+
+                if (terminal_rows(boundary) > 0)
+                    terminal_constraints(result + 4 + state_input_length*26,
+                        grad ? grad + (4 + state_input_length*26) * n : nullptr,
+                        n, x, state_input_length, boundary);
                 // printf("difference %lf constrains %lf / %lf\n", 
                 //     x[0] - boundary.ix[0], x[0], boundary.ix[0]);
 
@@ -316,46 +537,163 @@ namespace fpgm_collocation
 
             static double control_effort_objective(unsigned n, const double *x, double *grad, void *data)
             {
-                static equations_and_helper eq;
                 equations_and_helper::combined_param *params = 
                     (equations_and_helper::combined_param*)data;
                 
-                equations_and_helper::fpgm_param fpgm = params->fp;
-                equations_and_helper::optimization_constrain boundary = params->oc;
+                const equations_and_helper::fpgm_param &fpgm = params->fp;
+                const equations_and_helper::optimization_constrain &boundary = params->oc;
 
-                // Assuming h_k = uniform, timestep is uniform
+                // trapezoidal quadrature, knot i is weighted by (h_i-1 + h_i) / 2
                 // double factor = params->h / 2;
-                double factor = fpgm.h;
                 double cost = 0;
                 int state_input_length = n / 8;
-                double kinetic_energy = 0;
 
                 // for (int i = 0; i < state_input_length; i++)
                 //     cost += factor * (pow(x[7+8*i], 2) + pow(x[7+8*(i+1)], 2));
 
-                for (int i = 0; i < state_input_length; i++)
+                if (fpgm.Q_is_diagonal)
                 {
-                    Eigen::VectorXd x1(7);
-                    x1 << x[0+8*i], x[1+8*i], 
-                        x[2+8*i], x[3+8*i], 
-                        x[4+8*i], x[5+8*i], 
-                        x[6+8*i];
-                    
-                    auto state_term = x1.transpose() * fpgm.Q * x1;
+                    /** @brief Q is diagonal (which is what opt_landing constructs)
+                     * x'Qx reduces to a weighted sum of squares, so the whole horizon
+                     * is fused into one pass over the 8 * N decision vector
+                     * with the weights of [Q_diagonal, R] repeating every 8 entries **/
+                    double w[8];
+                    for (int j = 0; j < 7; j++)
+                        w[j] = fpgm.Q_diagonal[j];
+                    w[7] = fpgm.R;
+
+                    for (int i = 0; i < state_input_length; i++)
+                    {
+                        const double *xi = x + 8*i;
+                        double knot = 0;
+                        for (int j = 0; j < 8; j++)
+                            knot += w[j] * xi[j] * xi[j];
+                        cost += fpgm.weight(i, state_input_length) * knot;
+                    }
 
-                    double input_term = x[7+8*i] * fpgm.R * x[7+8*i];
+                    if (grad)
+                    {
+                        for (int i = 0; i < state_input_length; i++)
+                        {
+                            double factor = fpgm.weight(i, state_input_length);
+                            for (int j = 0; j < 8; j++)
+                                grad[j+8*i] = 2 * factor * w[j] * x[j+8*i];
+                        }
+                    }
+                }
+                else
+                {
+                    for (int i = 0; i < state_input_length; i++)
+                    {
+                        Eigen::Map<const Eigen::Matrix<double, 7, 1>> x1(x + 8*i);
+                        double factor = fpgm.weight(i, state_input_length);
+                        
+                        double state_term = x1.dot(fpgm.Q * x1);
 
-                    cost += state_term + input_term;
+                        double input_term = x[7+8*i] * fpgm.R * x[7+8*i];
+
+                        cost += factor * (state_term + input_term);
+
+                        if (grad)
+                        {
+                            // d(x'Qx)/dx = (Q + Q')x
+                            Eigen::Map<Eigen::Matrix<double, 7, 1>> g1(grad + 8*i);
+                            g1 = factor * (fpgm.Q + fpgm.Q.transpose()) * x1;
+                            grad[7+8*i] = 2 * factor * fpgm.R * x[7+8*i];
+                        }
+                    }
                 }
+
+                cost += terminal_cost(x, state_input_length, boundary, grad);
+
                 double start_constrain = abs(x[0] - boundary.ix[0]) + abs(x[1] - boundary.iz[0]);
-                cost = cost * factor + (1E6 * start_constrain);
+                cost = cost + (1E6 * start_constrain);
 
-                printf("cost = %lf\n", cost);
+                if (grad)
+                {
+                    grad[0] += 1E6 * ((x[0] - boundary.ix[0]) >= 0 ? 1.0 : -1.0);
+                    grad[1] += 1E6 * ((x[1] - boundary.iz[0]) >= 0 ? 1.0 : -1.0);
+                }
+
+                if (params->verbose)
+                    printf("cost = %lf\n", cost);
                 return cost;
             }
 
+            /** @brief rows of the terminal constrains (fc(x) <= 0), after the start constrains
+             * (0 & 1) x box, (2 & 3) z box, (4) |v|^2 - max_speed^2, (5 & 6) pitch window
+             * grad points at the first terminal row, row major with n columns
+             * **/
+            static void terminal_constraints(
+                double *result, double *grad, unsigned n, const double *x, int size,
+                const equations_and_helper::optimization_constrain &boundary)
+            {
+                const equations_and_helper::terminal_constrain &terminal = boundary.terminal;
+                const double *s = x + 8*(size - 1);
+                int last = 8*(size - 1);
+                if (grad)
+                    std::fill(grad, grad + 7 * n, 0.0);
+                // an inactive row is held at -1
+                std::fill(result, result + 7, -1.0);
+
+                if (terminal.x_tolerance > 0)
+                {
+                    double e = s[0] - boundary.ix.back();
+                    result[0] = -e - terminal.x_tolerance;
+                    result[1] = e - terminal.x_tolerance;
+                    if (grad) { grad[0*n + last] = -1.0; grad[1*n + last] = 1.0; }
+                }
+                if (terminal.z_tolerance > 0)
+                {
+                    double e = s[1] - boundary.iz.back();
+                    result[2] = -e - terminal.z_tolerance;
+                    result[3] = e - terminal.z_tolerance;
+                    if (grad) { grad[2*n + last + 1] = -1.0; grad[3*n + last + 1] = 1.0; }
+                }
+                if (terminal.max_speed > 0)
+                {
+                    result[4] = s[4]*s[4] + s[5]*s[5] - terminal.max_speed*terminal.max_speed;
+                    if (grad) { grad[4*n + last + 4] = 2 * s[4]; grad[4*n + last + 5] = 2 * s[5]; }
+                }
+                if (terminal.theta_min < terminal.theta_max)
+                {
+                    result[5] = terminal.theta_min - s[2];
+                    result[6] = s[2] - terminal.theta_max;
+                    if (grad) { grad[5*n + last + 2] = -1.0; grad[6*n + last + 2] = 1.0; }
+                }
+            }
+
         public:
 
+            static int terminal_rows(const equations_and_helper::optimization_constrain &boundary)
+            {
+                return boundary.terminal.enabled ? 7 : 0;
+            }
+
+            /** @brief terminal cost of a decision vector, adds its gradient to grad if given **/
+            static double terminal_cost(
+                const double *x, int size,
+                const equations_and_helper::optimization_constrain &boundary, double *grad = nullptr)
+            {
+                const equations_and_helper::terminal_constrain &terminal = boundary.terminal;
+                if (!terminal.enabled || size < 1 ||
+                    (terminal.position_weight == 0 && terminal.speed_weight == 0))
+                    return 0.0;
+
+                const double *s = x + 8*(size - 1);
+                double ex = s[0] - boundary.ix.back(), ez = s[1] - boundary.iz.back();
+                if (grad)
+                {
+                    double *g = grad + 8*(size - 1);
+                    g[0] += 2 * terminal.position_weight * ex;
+                    g[1] += 2 * terminal.position_weight * ez;
+                    g[4] += 2 * terminal.speed_weight * s[4];
+                    g[5] += 2 * terminal.speed_weight * s[5];
+                }
+                return terminal.position_weight * (ex*ex + ez*ez) +
+                    terminal.speed_weight * (s[4]*s[4] + s[5]*s[5]);
+            }
+
             struct control_state
             {
                 // Using 6 control parameters for flight control
@@ -365,8 +703,240 @@ namespace fpgm_collocation
                 vector<double> phi;
                 vector<double> vx;
                 vector<double> vz;
+                vector<double> thetadot;
+                vector<double> phidot;
+                // knot times, empty for a uniform grid of fpgm_param::h
+                vector<double> t;
+            };
+
+            /** @brief Summary of the last solve, filled by every solver backend **/
+            struct solve_report
+            {
+                bool converged;
+                int iterations;
+                double cost; // control effort without the start penalty
+                double constraint_violation; // max absolute collocation defect
+                double solve_time; // seconds
             };
 
+            /** @brief interval k and fraction w of time t on the knots of a control_state,
+             * spaced by h when the control_state has no knot times, held at the ends
+             * **/
+            static void locate_knot(const control_state &c, double h, double t, int &k, double &w)
+            {
+                int n = (int)c.x.size();
+                k = 0; w = 0.0;
+                if (n < 2)
+                    return;
+                if (c.t.empty())
+                {
+                    double s = std::max(0.0, std::min((double)(n - 1), t / h));
+                    k = std::min((int)s, n - 2);
+                    w = s - k;
+                    return;
+                }
+                t = std::max(c.t.front(), std::min(c.t.back(), t));
+                k = (int)(std::upper_bound(c.t.begin(), c.t.end(), t) - c.t.begin()) - 1;
+                k = std::max(0, std::min(k, n - 2));
+                w = (t - c.t[k]) / (c.t[k+1] - c.t[k]);
+            }
+
+            /** @brief time from the first knot to the last **/
+            static double duration(const control_state &c, double h)
+            {
+                if (c.x.size() < 2)
+                    return 0.0;
+                return c.t.empty() ? h * ((int)c.x.size() - 1) : c.t.back() - c.t.front();
+            }
+
+            /** @brief conversion of the 8 * N decision vector back to control states format
+             * with the knot times when the grid is not uniform
+             * **/
+            static control_state to_control_state(
+                const double *x, int size, const equations_and_helper::fpgm_param &fpgm)
+            {
+                control_state state = to_control_state(x, size);
+                if (!fpgm.times.empty())
+                    state.t.assign(fpgm.times.begin(), fpgm.times.begin() + std::min(size, (int)fpgm.times.size()));
+                return state;
+            }
+
+            static control_state to_control_state(const double *x, int size)
+            {
+                control_state state;
+                for (int i = 0; i < size; i++)
+                {
+                    state.x.push_back(x[0+i*8]);
+                    state.z.push_back(x[1+i*8]);
+                    state.theta.push_back(x[2+i*8]);
+                    state.phi.push_back(x[3+i*8]);
+                    state.vx.push_back(x[4+i*8]);
+                    state.vz.push_back(x[5+i*8]);
+                    state.thetadot.push_back(x[6+i*8]);
+                    state.phidot.push_back(x[7+i*8]);
+                }
+                return state;
+            }
+
+            /** @brief control effort of a decision vector, without the start penalty **/
+            static double trajectory_cost(
+                const double *x, int size, const equations_and_helper::fpgm_param &fpgm)
+            {
+                double cost = 0;
+                for (int i = 0; i < size; i++)
+                {
+                    Eigen::Map<const Eigen::Matrix<double, 7, 1>> x1(x + 8*i);
+                    cost += fpgm.weight(i, size) * (x1.dot(fpgm.Q * x1) + x[7+8*i] * fpgm.R * x[7+8*i]);
+                }
+                return cost;
+            }
+
+            /** @brief largest absolute trapezoidal defect of a decision vector **/
+            static double max_defect(
+                const double *x, int size, const equations_and_helper::fpgm_param &fpgm)
+            {
+                equations_and_helper eq;
+                double defect = 0;
+                for (int i = 0; i < size - 1; i++)
+                {
+                    const double *s1 = x + 8*i;
+                    const double *s2 = x + 8*(i+1);
+                    Eigen::VectorXd f_k = eq.fpgm_dynamics(
+                        s1[0], s1[1], s1[2], s1[3], s1[4], s1[5], s1[6], s1[7], fpgm, fpgm.time(i));
+                    Eigen::VectorXd f_k_1 = eq.fpgm_dynamics(
+                        s2[0], s2[1], s2[2], s2[3], s2[4], s2[5], s2[6], s2[7], fpgm, fpgm.time(i+1));
+                    for (int j = 0; j < 7; j++)
+                        defect = std::max(defect, 
+                            fabs(s1[j] - s2[j] + fpgm.step(i)/2 * (f_k[j] + f_k_1[j])));
+                }
+                return defect;
+            }
+
+            /** @brief local error of every interval of a decision vector
+             * fpgm_dynamics is integrated from knot k to k+1 with rk4 and phidot linear
+             * between the knots, error_k = max_j |x_k+1,j - x(t_k+1)_j| / (1 + |x_k+1,j|)
+             * **/
+            static std::vector<double> interval_error(
+                const double *x, int size, const equations_and_helper::fpgm_param &fpgm, int substeps = 8)
+            {
+                equations_and_helper eq;
+                std::vector<double> error(std::max(size - 1, 0), 0.0);
+                for (int i = 0; i < size - 1; i++)
+                {
+                    double step = fpgm.step(i) / substeps;
+                    const double *s1 = x + 8*i;
+                    const double *s2 = x + 8*(i+1);
+                    Eigen::Matrix<double, 7, 1> s = Eigen::Map<const Eigen::Matrix<double, 7, 1>>(s1);
+                    for (int j = 0; j < substeps; j++)
+                    {
+                        double w0 = (double)j / substeps, w1 = (double)(j + 1) / substeps;
+                        double u0 = (1 - w0) * s1[7] + w0 * s2[7];
+                        double u1 = (1 - w1) * s1[7] + w1 * s2[7];
+                        double t = fpgm.time(i) + j * step;
+                        Eigen::Matrix<double, 7, 1> k1 = eq.fpgm_dynamics(
+                            s[0], s[1], s[2], s[3], s[4], s[5], s[6], u0, fpgm, t);
+                        Eigen::Matrix<double, 7, 1> a = s + step/2 * k1;
+                        Eigen::Matrix<double, 7, 1> k2 = eq.fpgm_dynamics(
+                            a[0], a[1], a[2], a[3], a[4], a[5], a[6], (u0 + u1) / 2, fpgm, t + step/2);
+                        Eigen::Matrix<double, 7, 1> b = s + step/2 * k2;
+                        Eigen::Matrix<double, 7, 1> k3 = eq.fpgm_dynamics(
+                            b[0], b[1], b[2], b[3], b[4], b[5], b[6], (u0 + u1) / 2, fpgm, t + step/2);
+                        Eigen::Matrix<double, 7, 1> c = s + step * k3;
+                        Eigen::Matrix<double, 7, 1> k4 = eq.fpgm_dynamics(
+                            c[0], c[1], c[2], c[3], c[4], c[5], c[6], u1, fpgm, t + step);
+                        s += step/6 * (k1 + 2*k2 + 2*k3 + k4);
+                    }
+                    for (int j = 0; j < 7; j++)
+                    {
+                        double e = fabs(s2[j] - s[j]) / (1 + fabs(s2[j]));
+                        error[i] = std::isfinite(e) ? std::max(error[i], e) : 1E10;
+                    }
+                }
+                return error;
+            }
+
+            /** @brief move the problem onto new knot times (from 0 to the end of the current grid)
+             * the solution is interpolated linearly in time as the warm start of the next solve,
+             * the OBVP reference (boundary.ix, iz) is resampled at the same times
+             * a grid with equal steps is stored as the uniform h
+             * **/
+            bool remesh(const control_state &solution, const vector<double> &times)
+            {
+                int n = (int)solution.x.size();
+                int size = (int)times.size();
+                if (n < 2 || size < 2 || n != N ||
+                    (int)boundary.ix.size() != n || (int)boundary.iz.size() != n)
+                    return false;
+
+                const vector<double> *channel[8] = {
+                    &solution.x, &solution.z, &solution.theta, &solution.phi,
+                    &solution.vx, &solution.vz, &solution.thetadot, &solution.phidot};
+
+                std::vector<double> x(8 * size);
+                vector<double> ix(size), iz(size), steps(size - 1);
+                int k = 0;
+                for (int i = 0; i < size; i++)
+                {
+                    double t = std::max(0.0, std::min(times[i], param.time(n - 1)));
+                    while (k < n - 2 && param.time(k + 1) < t)
+                        k++;
+                    double w = (t - param.time(k)) / param.step(k);
+                    for (int j = 0; j < 8; j++)
+                        x[j+8*i] = (1 - w) * (*channel[j])[k] + w * (*channel[j])[k+1];
+                    ix[i] = (1 - w) * boundary.ix[k] + w * boundary.ix[k+1];
+                    iz[i] = (1 - w) * boundary.iz[k] + w * boundary.iz[k+1];
+                    if (i > 0)
+                    {
+                        steps[i-1] = times[i] - times[i-1];
+                        if (steps[i-1] <= 0)
+                            return false;
+                    }
+                }
+
+                bool uniform = true;
+                for (int i = 1; i < size - 1; i++)
+                    uniform &= fabs(steps[i] - steps[0]) < 1E-9 * steps[0];
+                param.h = uniform ? steps[0] : (times.back() - times.front()) / (size - 1);
+                param.set_steps(uniform ? vector<double>() : steps);
+                boundary.ix = ix;
+                boundary.iz = iz;
+                guess = x;
+                N = size;
+                return true;
+            }
+
+            /** @brief knot times with interval k split into split[k] equal intervals **/
+            static vector<double> split_intervals(
+                const equations_and_helper::fpgm_param &fpgm, const vector<int> &split)
+            {
+                vector<double> times(1, fpgm.time(0));
+                for (int k = 0; k < (int)split.size(); k++)
+                {
+                    int m = std::max(1, split[k]);
+                    for (int j = 1; j <= m; j++)
+                        times.push_back(fpgm.time(k) + fpgm.step(k) * j / m);
+                }
+                return times;
+            }
+
+            void set_verbose(bool v) { verbose = v; }
+
+            bool get_verbose() const { return verbose; }
+
+            const equations_and_helper::fpgm_param &get_parameters() const { return param; }
+
+            const equations_and_helper::optimization_constrain &get_boundary() const { return boundary; }
+
+            const std::vector<double> &get_initial_guess() const { return guess; }
+
+            const solve_report &get_last_report() const { return report; }
+
+        private:
+
+            solve_report report = {};
+
+        public:
+
             bool load_parameters(
                 std::string directory, double total, int size, 
                 MatrixXd Q, double R, vector<double> ix, vector<double> iz)
@@ -376,7 +946,14 @@ namespace fpgm_collocation
                     return false;
 
                 YAML::Node node = YAML::LoadFile(directory);
+                return load_parameters(node, total, size, Q, R, ix, iz);
+            }
 
+            /** @brief same as above with parameters.yaml already loaded (or modified) **/
+            bool load_parameters(
+                const YAML::Node &node, double total, int size, 
+                MatrixXd Q, double R, vector<double> ix, vector<double> iz)
+            {
                 param = {}; boundary = {}; // reset the parameters
                 param.l_w = node["length_cg_to_cwing"].as<double>();
                 param.l_e = node["length_pivote_to_celevator"].as<double>();
@@ -386,6 +963,8 @@ namespace fpgm_collocation
                 param.mass = node["mass"].as<double>();
                 param.I = node["moments_of_inertia"].as<double>();
                 param.Q = Q;
+                param.Q_diagonal = param.Q.diagonal();
+                param.Q_is_diagonal = param.Q.isDiagonal();
                 param.R = R;
                 param.h = total / (size);
 
@@ -397,10 +976,79 @@ namespace fpgm_collocation
                 boundary.ix = ix;
                 boundary.iz = iz;
 
+                load_wind(node, param.wind);
+                load_terminal(node, boundary.terminal);
+
                 printf("Parameters loaded\n");
                 return true;
             }
 
+            /** @brief optional wind keys of parameters.yaml, no wind when wind_model is missing
+             * wind_model : none, constant, shear or table
+             * wind_x, wind_z, wind_shear_x, wind_reference_height
+             * wind_table_dt, wind_table_x, wind_table_z
+             * **/
+            static void load_wind(const YAML::Node &node, equations_and_helper::wind_field &wind)
+            {
+                wind = equations_and_helper::wind_field();
+                if (!node["wind_model"])
+                    return;
+
+                std::string model = node["wind_model"].as<std::string>();
+                wind.x = node["wind_x"] ? node["wind_x"].as<double>() : 0.0;
+                wind.z = node["wind_z"] ? node["wind_z"].as<double>() : 0.0;
+                if (model == "constant")
+                    wind.model = equations_and_helper::wind_field::CONSTANT;
+                else if (model == "shear")
+                {
+                    wind.model = equations_and_helper::wind_field::SHEAR;
+                    wind.shear_x = node["wind_shear_x"] ? node["wind_shear_x"].as<double>() : 0.0;
+                    wind.reference_height = node["wind_reference_height"] ?
+                        node["wind_reference_height"].as<double>() : 0.0;
+                }
+                else if (model == "table" && node["wind_table_x"] && node["wind_table_dt"])
+                {
+                    wind.model = equations_and_helper::wind_field::TABLE;
+                    wind.table_dt = node["wind_table_dt"].as<double>();
+                    wind.table_x = node["wind_table_x"].as<std::vector<double>>();
+                    wind.table_z = node["wind_table_z"] ?
+                        node["wind_table_z"].as<std::vector<double>>() :
+                        std::vector<double>(wind.table_x.size(), 0.0);
+                    if (wind.table_z.size() != wind.table_x.size())
+                        wind.table_z.resize(wind.table_x.size(), 0.0);
+                }
+            }
+
+            /** @brief optional terminal_* keys of parameters.yaml, see terminal_constrain
+             * terminal_x_tolerance, terminal_z_tolerance, terminal_max_speed,
+             * terminal_pitch_min_deg, terminal_pitch_max_deg,
+             * terminal_position_weight, terminal_speed_weight
+             * **/
+            static void load_terminal(const YAML::Node &node, equations_and_helper::terminal_constrain &terminal)
+            {
+                const double deg_to_rad = M_PI / 180.0;
+                terminal = {};
+                if (node["terminal_x_tolerance"])
+                    terminal.x_tolerance = node["terminal_x_tolerance"].as<double>();
+                if (node["terminal_z_tolerance"])
+                    terminal.z_tolerance = node["terminal_z_tolerance"].as<double>();
+                if (node["terminal_max_speed"])
+                    terminal.max_speed = node["terminal_max_speed"].as<double>();
+                if (node["terminal_pitch_min_deg"] && node["terminal_pitch_max_deg"])
+                {
+                    terminal.theta_min = node["terminal_pitch_min_deg"].as<double>() * deg_to_rad;
+                    terminal.theta_max = node["terminal_pitch_max_deg"].as<double>() * deg_to_rad;
+                }
+                if (node["terminal_position_weight"])
+                    terminal.position_weight = node["terminal_position_weight"].as<double>();
+                if (node["terminal_speed_weight"])
+                    terminal.speed_weight = node["terminal_speed_weight"].as<double>();
+
+                terminal.enabled = terminal.x_tolerance > 0 || terminal.z_tolerance > 0 ||
+                    terminal.max_speed > 0 || terminal.theta_min < terminal.theta_max ||
+                    terminal.position_weight != 0 || terminal.speed_weight != 0;
+            }
+
             bool load_initial_guess(std::vector<double> x)
             {
                 guess.clear();
@@ -460,9 +1108,15 @@ namespace fpgm_collocation
                 return Eigen::Vector3d(roll, pitch, yaw);
             }
 
-            fpgm_collocation::control_state nlopt_optimization() 
+            /** @brief NLopt backend
+             * @param algorithm NLOPT_LN_COBYLA (derivative free) or 
+             * a gradient based algorithm such as NLOPT_LD_SLSQP
+             * **/
+            fpgm_collocation::control_state nlopt_optimization(
+                nlopt_algorithm algorithm = NLOPT_LN_COBYLA) 
             {
                 fpgm_collocation::control_state final_vector;
+                report = {};
                 if (guess.empty())
                     return final_vector;
                 
@@ -471,6 +1125,7 @@ namespace fpgm_collocation
                 equations_and_helper::combined_param cp;
                 cp.fp = param;
                 cp.oc = boundary; 
+                cp.verbose = verbose;
 
                 /** @brief C++ version: erroneous**/
                 // const std::vector<double> tol_eq(dimension+2, 1E-8);
@@ -499,11 +1154,11 @@ namespace fpgm_collocation
                 /** @brief C version **/
                 // inequality_dimension =
                 // dimension * 2[from upper and lower bound] 
-                int inequality_dimension = 4 + N * 26;
+                int inequality_dimension = 4 + N * 26 + terminal_rows(boundary);
                 double tol_ineq[inequality_dimension] = {tolerance};
                 
-                nlopt_opt opt = nlopt_create(NLOPT_LN_COBYLA, guess.size());
-                nlopt_set_min_objective(opt, control_effort_objective, &param);
+                nlopt_opt opt = nlopt_create(algorithm, guess.size());
+                nlopt_set_min_objective(opt, control_effort_objective, &cp);
 
                 nlopt_set_ftol_abs(opt, 1E-6);
                 nlopt_set_xtol_rel(opt, 1E-4);
@@ -536,31 +1191,34 @@ namespace fpgm_collocation
                 // printf("\n");
 
                 double cost = 0;
-                nlopt_optimize(opt, x, &cost);
-                printf("number of iterations: %d \n", nlopt_get_numevals(opt));
+                std::chrono::time_point<std::chrono::system_clock> start = 
+                    std::chrono::system_clock::now();
+                nlopt_result result = nlopt_optimize(opt, x, &cost);
+                report.solve_time = std::chrono::duration<double>(
+                    std::chrono::system_clock::now() - start).count();
 
-                printf("guess-difference: \n");
-                for(int i = 0; i < N; i++)
+                if (verbose)
                 {
-                    printf("row %d ", i);
-                    for (int j = 0; j < 8; j++)
-                        printf("%lf ", x[j+i*8] - guess[j+i*8]);
+                    printf("number of iterations: %d \n", nlopt_get_numevals(opt));
+                    printf("Optimization completed cost %lf\n", cost);
+                    printf("guess-difference: \n");
+                    for(int i = 0; i < N; i++)
+                    {
+                        printf("row %d ", i);
+                        for (int j = 0; j < 8; j++)
+                            printf("%lf ", x[j+i*8] - guess[j+i*8]);
+                        printf("\n");
+                    }
                     printf("\n");
                 }
-                printf("\n");
 
-                printf("Optimization completed cost %lf\n", cost);
+                report.converged = result > 0;
+                report.iterations = nlopt_get_numevals(opt);
+                report.cost = trajectory_cost(x, N, param);
+                report.constraint_violation = max_defect(x, N, param);
 
                 // conversion back to control states format
-                for (int i = 0; i < N; i++)
-                {
-                    final_vector.x.push_back(x[0+i*8]);
-                    final_vector.z.push_back(x[1+i*8]);
-                    final_vector.theta.push_back(x[2+i*8]);
-                    final_vector.phi.push_back(x[3+i*8]);
-                    final_vector.vx.push_back(x[4+i*8]);
-                    final_vector.vz.push_back(x[5+i*8]);
-                }
+                final_vector = to_control_state(x, N, param);
 
                 nlopt_destroy(opt);
 
@@ -0,0 +1,420 @@
+/*
+* fpgm_ilqr.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// iLQR / control-limited box-DDP for the flat plate glider perching problem
+
+#ifndef FPGM_ILQR_H
+#define FPGM_ILQR_H
+
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include <limits>
+
+#include "fpgm_collocation.h"
+#include "fpgm_kkt.h"
+#include "Eigen/Dense"
+
+namespace fpgm_collocation
+{
+    struct ilqr_options
+    {
+        int max_iterations = 100;
+        double tolerance = 1E-6; // relative cost decrease
+        double regularization_init = 1E-6;
+        double regularization_max = 1E10;
+        // quadratic penalty on the theta, phi, velocity and thetadot boxes,
+        // which iLQR cannot hold as hard constrains
+        double state_penalty = 1E3;
+        bool verbose = false;
+    };
+
+    /** @brief iLQR with control-limited box-DDP on phidot
+     * reference : https://homes.cs.washington.edu/~todorov/papers/TassaICRA14.pdf
+     *
+     * - discrete dynamics are fpgm_dynamics integrated with rk4 over h, phidot held per interval
+     * - stage cost h * (x'Qx + R u^2), the same Q and R loaded by load_parameters
+     * - the initial state is the first knot of the guess with x and z from the boundary,
+     * unlike the collocation where theta, phi and the velocities of the first knot are free
+     * - |phidot| <= pd_c is held exactly by the box-DDP clamp,
+     * the state boxes are a quadratic penalty (ilqr_options::state_penalty)
+     * - besides the control_state, the time-varying feedback u_k = u_k* + K_k (x_k - x_k*)
+     * is available through get_gains()
+    **/
+    class fpgm_ilqr
+    {
+        public:
+            typedef Eigen::Matrix<double, 7, 1> state_vector;
+            typedef Eigen::Matrix<double, 7, 7> state_matrix;
+            typedef Eigen::Matrix<double, 1, 7> gain_vector;
+
+            fpgm_ilqr(
+                const equations_and_helper::fpgm_param &parameter,
+                const equations_and_helper::optimization_constrain &constrain,
+                ilqr_options opt = ilqr_options()) :
+                param(parameter), boundary(constrain), options(opt) {}
+
+            const fpgm_collocation::solve_report &get_report() const { return report; }
+
+            /** @brief feedback gains K_k (1x7) of the last solve, one per interval **/
+            const aligned_vector<gain_vector> &get_gains() const { return K; }
+
+            fpgm_collocation::control_state solve(const std::vector<double> &guess)
+            {
+                report = {};
+                fpgm_collocation::control_state final_vector;
+                if (guess.size() < 16 || guess.size() % 8 != 0)
+                    return final_vector;
+
+                std::chrono::time_point<std::chrono::system_clock> start =
+                    std::chrono::system_clock::now();
+
+                N = (int)guess.size() / 8;
+                x.resize(N); u.assign(N, 0.0);
+                x_new.resize(N); u_new.assign(N, 0.0);
+                A.resize(N-1); B.resize(N-1);
+                K.assign(N-1, gain_vector::Zero()); k.assign(N-1, 0.0);
+
+                for (int i = 0; i < N; i++)
+                    u[i] = std::max(-boundary.pd_c, std::min(boundary.pd_c, guess[7+8*i]));
+                x[0] = Eigen::Map<const state_vector>(guess.data());
+                x[0][0] = boundary.ix[0];
+                x[0][1] = boundary.iz[0];
+                for (int i = 0; i < N - 1; i++)
+                    x[i+1] = eq.rk4_step(x[i], u[i], param.step(i), param, param.time(i));
+                u[N-1] = 0.0;
+
+                double cost = total_cost(x, u);
+                double lambda_reg = options.regularization_init;
+                int iter = 0;
+                bool converged = false;
+
+                for (; iter < options.max_iterations; iter++)
+                {
+                    linearize();
+
+                    double expected[2];
+                    bool backward_ok = false;
+                    while (!backward_ok)
+                    {
+                        backward_ok = backward_pass(lambda_reg, expected);
+                        if (!backward_ok)
+                        {
+                            lambda_reg = std::max(lambda_reg * 10, 1E-6);
+                            if (lambda_reg > options.regularization_max)
+                                break;
+                        }
+                    }
+                    if (!backward_ok)
+                        break;
+
+                    // backtracking on the feedforward term
+                    bool accepted = false;
+                    double new_cost = cost;
+                    for (double alpha = 1.0; alpha > 1E-4; alpha *= 0.5)
+                    {
+                        forward_pass(alpha);
+                        new_cost = total_cost(x_new, u_new);
+                        double expected_decrease = -(alpha * expected[0] + alpha * alpha * expected[1]);
+                        double actual_decrease = cost - new_cost;
+                        if (actual_decrease > 0 &&
+                            (expected_decrease <= 0 || actual_decrease / expected_decrease > 1E-1))
+                        {
+                            accepted = true;
+                            break;
+                        }
+                    }
+
+                    if (!accepted)
+                    {
+                        lambda_reg = std::max(lambda_reg * 10, 1E-6);
+                        if (lambda_reg > options.regularization_max)
+                            break;
+                        continue;
+                    }
+
+                    double relative = (cost - new_cost) / std::max(1.0, fabs(cost));
+                    x.swap(x_new);
+                    u.swap(u_new);
+                    cost = new_cost;
+                    lambda_reg = std::max(lambda_reg / 10, 1E-9);
+
+                    if (options.verbose)
+                        printf("ilqr iter %d cost %lf reg %.1e\n", iter, cost, lambda_reg);
+
+                    if (relative < options.tolerance)
+                    {
+                        converged = true;
+                        iter++;
+                        break;
+                    }
+                }
+
+                std::vector<double> z(8*N);
+                for (int i = 0; i < N; i++)
+                {
+                    for (int j = 0; j < 7; j++)
+                        z[j+8*i] = x[i][j];
+                    z[7+8*i] = u[i];
+                }
+
+                report.converged = converged;
+                report.iterations = iter;
+                report.cost = fpgm_collocation::trajectory_cost(z.data(), N, param);
+                report.constraint_violation = fpgm_collocation::max_defect(z.data(), N, param);
+                report.solve_time = std::chrono::duration<double>(
+                    std::chrono::system_clock::now() - start).count();
+
+                if (options.verbose)
+                    printf("ilqr completed in %d iterations, cost %lf, trapezoidal defect %.3e, converged %d\n",
+                        iter, report.cost, report.constraint_violation, converged);
+
+                final_vector = fpgm_collocation::to_control_state(z.data(), N, param);
+                return final_vector;
+            }
+
+        private:
+
+            equations_and_helper eq;
+            equations_and_helper::fpgm_param param;
+            equations_and_helper::optimization_constrain boundary;
+            ilqr_options options;
+            fpgm_collocation::solve_report report = {};
+
+            int N;
+            aligned_vector<state_vector> x, x_new;
+            std::vector<double> u, u_new;
+            aligned_vector<state_matrix> A;
+            aligned_vector<state_vector> B;
+            aligned_vector<gain_vector> K;
+            std::vector<double> k;
+
+            /** @brief box penalty on [theta, phi, xdot, zdot, thetadot] **/
+            double state_bound(int j) const
+            {
+                switch (j)
+                {
+                    case 2: return boundary.t_c;
+                    case 3: return boundary.p_c;
+                    case 4: case 5: return boundary.v_c;
+                    case 6: return boundary.td_c;
+                    default: return std::numeric_limits<double>::infinity();
+                }
+            }
+
+            /** @brief control effort of knot i with its trapezoidal weight plus the box penalty **/
+            double stage_cost(int i, const state_vector &s, double v) const
+            {
+                double cost = param.weight(i, N) * (s.dot(param.Q * s) + param.R * v * v);
+                for (int j = 2; j < 7; j++)
+                {
+                    double excess = fabs(s[j]) - state_bound(j);
+                    if (excess > 0)
+                        cost += options.state_penalty * excess * excess;
+                }
+                if (i == N - 1)
+                    cost += terminal_terms(s, nullptr, nullptr);
+                return cost;
+            }
+
+            double total_cost(const aligned_vector<state_vector> &xs, const std::vector<double> &us) const
+            {
+                double cost = 0;
+                for (int i = 0; i < N; i++)
+                    cost += stage_cost(i, xs[i], us[i]);
+                return cost;
+            }
+
+            void cost_derivatives(int i, const state_vector &s, state_vector &l_x, state_matrix &l_xx) const
+            {
+                double weight = param.weight(i, N);
+                l_x = weight * (param.Q + param.Q.transpose()) * s;
+                l_xx = weight * (param.Q + param.Q.transpose());
+                for (int j = 2; j < 7; j++)
+                {
+                    double excess = fabs(s[j]) - state_bound(j);
+                    if (excess > 0)
+                    {
+                        l_x[j] += 2 * options.state_penalty * excess * (s[j] > 0 ? 1.0 : -1.0);
+                        l_xx(j,j) += 2 * options.state_penalty;
+                    }
+                }
+                if (i == N - 1)
+                    terminal_terms(s, &l_x, &l_xx);
+            }
+
+            /** @brief terminal cost and the terminal constrains as quadratic penalties,
+             * adds the gradient and Gauss-Newton hessian if given
+             * **/
+            double terminal_terms(const state_vector &s, state_vector *l_x, state_matrix *l_xx) const
+            {
+                const equations_and_helper::terminal_constrain &terminal = boundary.terminal;
+                if (!terminal.enabled)
+                    return 0.0;
+
+                double x[8];
+                for (int j = 0; j < 7; j++)
+                    x[j] = s[j];
+                x[7] = 0.0;
+                double g[8] = {0};
+                double cost = fpgm_collocation::terminal_cost(x, 1, boundary, g);
+                if (l_x)
+                {
+                    *l_x += Eigen::Map<state_vector>(g);
+                    (*l_xx)(0,0) += 2 * terminal.position_weight;
+                    (*l_xx)(1,1) += 2 * terminal.position_weight;
+                    (*l_xx)(4,4) += 2 * terminal.speed_weight;
+                    (*l_xx)(5,5) += 2 * terminal.speed_weight;
+                }
+
+                // excess over each limit, d(excess)/ds
+                state_vector direction;
+                double limits[2] = {terminal.x_tolerance, terminal.z_tolerance};
+                double errors[2] = {s[0] - boundary.ix.back(), s[1] - boundary.iz.back()};
+                for (int j = 0; j < 2; j++)
+                {
+                    double excess = fabs(errors[j]) - limits[j];
+                    if (limits[j] > 0 && excess > 0)
+                    {
+                        direction.setZero();
+                        direction[j] = errors[j] > 0 ? 1.0 : -1.0;
+                        cost += penalty(excess, direction, l_x, l_xx);
+                    }
+                }
+                double speed = sqrt(s[4]*s[4] + s[5]*s[5]);
+                if (terminal.max_speed > 0 && speed > terminal.max_speed)
+                {
+                    direction.setZero();
+                    direction[4] = s[4] / speed;
+                    direction[5] = s[5] / speed;
+                    cost += penalty(speed - terminal.max_speed, direction, l_x, l_xx);
+                }
+                if (terminal.theta_min < terminal.theta_max)
+                {
+                    direction.setZero();
+                    if (s[2] < terminal.theta_min)
+                    {
+                        direction[2] = -1.0;
+                        cost += penalty(terminal.theta_min - s[2], direction, l_x, l_xx);
+                    }
+                    else if (s[2] > terminal.theta_max)
+                    {
+                        direction[2] = 1.0;
+                        cost += penalty(s[2] - terminal.theta_max, direction, l_x, l_xx);
+                    }
+                }
+                return cost;
+            }
+
+            double penalty(double excess, const state_vector &direction,
+                state_vector *l_x, state_matrix *l_xx) const
+            {
+                if (l_x)
+                {
+                    *l_x += 2 * options.state_penalty * excess * direction;
+                    *l_xx += 2 * options.state_penalty * direction * direction.transpose();
+                }
+                return options.state_penalty * excess * excess;
+            }
+
+            /** @brief jacobians of the rk4 step by central differences **/
+            void linearize()
+            {
+                for (int i = 0; i < N - 1; i++)
+                {
+                    for (int j = 0; j < 7; j++)
+                    {
+                        double step = 1E-6 * std::max(1.0, fabs(x[i][j]));
+                        state_vector sp = x[i], sm = x[i];
+                        sp[j] += step;
+                        sm[j] -= step;
+                        A[i].col(j) = (eq.rk4_step(sp, u[i], param.step(i), param, param.time(i)) -
+                            eq.rk4_step(sm, u[i], param.step(i), param, param.time(i))) / (2 * step);
+                    }
+                    double step = 1E-6 * std::max(1.0, fabs(u[i]));
+                    B[i] = (eq.rk4_step(x[i], u[i] + step, param.step(i), param, param.time(i)) -
+                        eq.rk4_step(x[i], u[i] - step, param.step(i), param, param.time(i))) / (2 * step);
+                }
+            }
+
+            bool backward_pass(double lambda_reg, double *expected)
+            {
+                state_vector V_x;
+                state_matrix V_xx;
+                cost_derivatives(N-1, x[N-1], V_x, V_xx);
+                expected[0] = expected[1] = 0;
+
+                for (int i = N - 2; i >= 0; i--)
+                {
+                    state_vector l_x;
+                    state_matrix l_xx;
+                    cost_derivatives(i, x[i], l_x, l_xx);
+                    double l_u = 2 * param.weight(i, N) * param.R * u[i];
+                    double l_uu = 2 * param.weight(i, N) * param.R;
+
+                    state_matrix V_reg = V_xx + lambda_reg * state_matrix::Identity();
+                    state_vector Q_x = l_x + A[i].transpose() * V_x;
+                    double Q_u = l_u + B[i].dot(V_x);
+                    state_matrix Q_xx = l_xx + A[i].transpose() * V_xx * A[i];
+                    double Q_uu = l_uu + B[i].dot(V_reg * B[i]);
+                    gain_vector Q_ux = B[i].transpose() * V_reg * A[i];
+
+                    if (!(Q_uu > 0))
+                        return false;
+
+                    // box-DDP with one input: clamp the step, no feedback when the bound is active
+                    double du = -Q_u / Q_uu;
+                    double lower = -boundary.pd_c - u[i];
+                    double upper = boundary.pd_c - u[i];
+                    if (du <= lower || du >= upper)
+                    {
+                        k[i] = std::max(lower, std::min(upper, du));
+                        K[i].setZero();
+                    }
+                    else
+                    {
+                        k[i] = du;
+                        K[i] = -Q_ux / Q_uu;
+                    }
+
+                    expected[0] += k[i] * Q_u;
+                    expected[1] += 0.5 * k[i] * Q_uu * k[i];
+
+                    V_x = Q_x + K[i].transpose() * Q_uu * k[i] + K[i].transpose() * Q_u + Q_ux.transpose() * k[i];
+                    V_xx = Q_xx + K[i].transpose() * Q_uu * K[i] + K[i].transpose() * Q_ux + Q_ux.transpose() * K[i];
+                    V_xx = 0.5 * (V_xx + V_xx.transpose());
+                }
+                return true;
+            }
+
+            void forward_pass(double alpha)
+            {
+                x_new[0] = x[0];
+                for (int i = 0; i < N - 1; i++)
+                {
+                    double v = u[i] + alpha * k[i] + K[i].dot(x_new[i] - x[i]);
+                    u_new[i] = std::max(-boundary.pd_c, std::min(boundary.pd_c, v));
+                    x_new[i+1] = eq.rk4_step(x_new[i], u_new[i], param.step(i), param, param.time(i));
+                }
+                u_new[N-1] = 0.0;
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,333 @@
+/*
+* fpgm_kkt.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Stage-wise KKT systems of the fpgm collocation QP subproblems and their linear solvers
+
+#ifndef FPGM_KKT_H
+#define FPGM_KKT_H
+
+#include <vector>
+#include <memory>
+
+#include "Eigen/Dense"
+#include "Eigen/Sparse"
+#include "Eigen/StdVector"
+
+namespace fpgm_collocation
+{
+    typedef Eigen::Matrix<double, 8, 8> stage_matrix;
+    typedef Eigen::Matrix<double, 8, 1> stage_vector;
+    typedef Eigen::Matrix<double, 7, 8> defect_matrix;
+    typedef Eigen::Matrix<double, 7, 1> defect_vector;
+
+    template<typename T>
+    using aligned_vector = std::vector<T, Eigen::aligned_allocator<T>>;
+
+    /** @brief Stage-wise KKT system of the collocation QP subproblem
+     * 8 decision variables per stage, z_k = [x, z, theta, phi, xdot, zdot, thetadot, phidot]
+     * 7 defect rows per interval, A_k * dz_k + B_k * dz_k+1 + c_k = 0 (k = 0 to N-2)
+     * 2 initial rows on x and z of the first stage, dz_0[0,1] + c_init = 0
+     *
+     * [ H  J' ] [ dz     ]   [ -g ]
+     * [ J  0  ] [ lambda ] = [ -c ]
+     *
+     * H is block diagonal (one 8x8 block per stage) and J is block bidiagonal,
+     * so the system is banded when the stage variables and multipliers are interleaved
+    **/
+    struct kkt_system
+    {
+        int N;
+        aligned_vector<stage_matrix> H;
+        aligned_vector<stage_vector> g;
+        aligned_vector<defect_matrix> A;
+        aligned_vector<defect_matrix> B;
+        aligned_vector<defect_vector> c;
+        Eigen::Vector2d c_init;
+
+        void resize(int size)
+        {
+            N = size;
+            H.resize(N); g.resize(N);
+            A.resize(N-1); B.resize(N-1); c.resize(N-1);
+        }
+    };
+
+    struct kkt_solution
+    {
+        aligned_vector<stage_vector> dz;
+        aligned_vector<defect_vector> lambda;
+        Eigen::Vector2d lambda_init;
+
+        void resize(int size)
+        {
+            dz.resize(size);
+            lambda.resize(size-1);
+        }
+    };
+
+    /** @brief Interface for the linear solver used on the KKT system **/
+    class kkt_linear_solver
+    {
+        public:
+            virtual ~kkt_linear_solver() {}
+
+            virtual bool solve(const kkt_system &kkt, kkt_solution &solution) = 0;
+
+            virtual const char *name() const = 0;
+
+        protected:
+            /** @brief Interleaved ordering [lambda_init, dz_0, lambda_0, dz_1, lambda_1, ..., dz_N-1]
+             * keeps the assembled matrix banded with a half bandwidth of 15
+             * **/
+            static int dz_index(int k) { return 2 + 15 * k; }
+            static int lambda_index(int k) { return 10 + 15 * k; }
+            static int kkt_size(int N) { return 15 * N - 5; }
+
+            static void assemble(
+                const kkt_system &kkt, std::vector<Eigen::Triplet<double>> &triplets,
+                Eigen::VectorXd &rhs)
+            {
+                triplets.clear();
+                triplets.reserve(kkt.N * (64 + 4 * 56) + 4);
+                rhs.setZero(kkt_size(kkt.N));
+
+                for (int i = 0; i < 2; i++)
+                {
+                    triplets.push_back(Eigen::Triplet<double>(i, dz_index(0) + i, 1.0));
+                    triplets.push_back(Eigen::Triplet<double>(dz_index(0) + i, i, 1.0));
+                }
+                rhs.segment<2>(0) = -kkt.c_init;
+
+                for (int k = 0; k < kkt.N; k++)
+                {
+                    int d = dz_index(k);
+                    for (int i = 0; i < 8; i++)
+                        for (int j = 0; j < 8; j++)
+                            if (kkt.H[k](i,j) != 0.0)
+                                triplets.push_back(Eigen::Triplet<double>(d + i, d + j, kkt.H[k](i,j)));
+                    rhs.segment<8>(d) = -kkt.g[k];
+
+                    if (k == kkt.N - 1)
+                        continue;
+
+                    int l = lambda_index(k);
+                    int d1 = dz_index(k+1);
+                    for (int i = 0; i < 7; i++)
+                        for (int j = 0; j < 8; j++)
+                        {
+                            if (kkt.A[k](i,j) != 0.0)
+                            {
+                                triplets.push_back(Eigen::Triplet<double>(l + i, d + j, kkt.A[k](i,j)));
+                                triplets.push_back(Eigen::Triplet<double>(d + j, l + i, kkt.A[k](i,j)));
+                            }
+                            if (kkt.B[k](i,j) != 0.0)
+                            {
+                                triplets.push_back(Eigen::Triplet<double>(l + i, d1 + j, kkt.B[k](i,j)));
+                                triplets.push_back(Eigen::Triplet<double>(d1 + j, l + i, kkt.B[k](i,j)));
+                            }
+                        }
+                    rhs.segment<7>(l) = -kkt.c[k];
+                }
+            }
+
+            static void extract(const Eigen::VectorXd &sol, int N, kkt_solution &solution)
+            {
+                solution.resize(N);
+                solution.lambda_init = sol.segment<2>(0);
+                for (int k = 0; k < N; k++)
+                {
+                    solution.dz[k] = sol.segment<8>(dz_index(k));
+                    if (k < N - 1)
+                        solution.lambda[k] = sol.segment<7>(lambda_index(k));
+                }
+            }
+    };
+
+    /** @brief Sparse LU on the banded KKT matrix, O(N) per factorization **/
+    class sparse_lu_kkt_solver : public kkt_linear_solver
+    {
+        public:
+            bool solve(const kkt_system &kkt, kkt_solution &solution)
+            {
+                assemble(kkt, triplets, rhs);
+                int size = kkt_size(kkt.N);
+                matrix.resize(size, size);
+                matrix.setFromTriplets(triplets.begin(), triplets.end());
+
+                lu.compute(matrix);
+                if (lu.info() != Eigen::Success)
+                    return false;
+                Eigen::VectorXd sol = lu.solve(rhs);
+                if (lu.info() != Eigen::Success)
+                    return false;
+
+                extract(sol, kkt.N, solution);
+                return true;
+            }
+
+            const char *name() const { return "sparse_lu"; }
+
+        private:
+            std::vector<Eigen::Triplet<double>> triplets;
+            Eigen::VectorXd rhs;
+            Eigen::SparseMatrix<double> matrix;
+            Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>> lu;
+    };
+
+    /** @brief Dense LU on the full KKT matrix, O(N^3), kept as a reference **/
+    class dense_lu_kkt_solver : public kkt_linear_solver
+    {
+        public:
+            bool solve(const kkt_system &kkt, kkt_solution &solution)
+            {
+                assemble(kkt, triplets, rhs);
+                int size = kkt_size(kkt.N);
+                Eigen::SparseMatrix<double> sparse(size, size);
+                sparse.setFromTriplets(triplets.begin(), triplets.end());
+                Eigen::MatrixXd matrix = Eigen::MatrixXd(sparse);
+
+                Eigen::VectorXd sol = matrix.partialPivLu().solve(rhs);
+                if (!sol.allFinite())
+                    return false;
+
+                extract(sol, kkt.N, solution);
+                return true;
+            }
+
+            const char *name() const { return "dense_lu"; }
+
+        private:
+            std::vector<Eigen::Triplet<double>> triplets;
+            Eigen::VectorXd rhs;
+    };
+
+    /** @brief Riccati recursion on the stage-wise KKT system, O(N * nx^3) and allocation free
+     * once the stage buffers are sized
+     *
+     * The trapezoidal defect is implicit in the next state, with B_k = [Bx_k, Bu_k]
+     * dx_k+1 = -Bx_k^-1 (A_k dz_k + Bu_k du_k+1 + c_k)
+     * so with s_k = dz_k (8) as the state and v_k = du_k+1 (1) as the input the QP becomes
+     * an explicit LQ problem s_k+1 = F_k s_k + G_k v_k + f_k with stage cost 1/2 s'H s + g's,
+     * solved by a backward Riccati sweep and a forward rollout.
+     * The defect multipliers are recovered backwards from stationarity on the state rows
+     * and the 2 initial rows are eliminated in the first stage.
+     * Requires positive definite stage hessians (the interior point keeps them so)
+    **/
+    class riccati_kkt_solver : public kkt_linear_solver
+    {
+        public:
+            bool solve(const kkt_system &kkt, kkt_solution &solution)
+            {
+                const int N = kkt.N;
+                resize(N);
+                solution.resize(N);
+
+                // explicit stage dynamics
+                for (int k = 0; k < N - 1; k++)
+                {
+                    Eigen::Matrix<double, 7, 7> Bx = kkt.B[k].block<7,7>(0,0);
+                    Eigen::PartialPivLU<Eigen::Matrix<double, 7, 7>> lu(Bx);
+                    B_inverse[k] = lu.inverse();
+                    if (!B_inverse[k].allFinite())
+                        return false;
+
+                    F[k].setZero();
+                    F[k].block<7,8>(0,0) = -B_inverse[k] * kkt.A[k];
+                    G[k].head<7>() = -B_inverse[k] * kkt.B[k].col(7);
+                    G[k][7] = 1.0;
+                    f[k].head<7>() = -B_inverse[k] * kkt.c[k];
+                    f[k][7] = 0.0;
+                }
+
+                // backward sweep, V_k(s) = 1/2 s'P_k s + p_k's
+                P[N-1] = kkt.H[N-1];
+                p[N-1] = kkt.g[N-1];
+                for (int k = N - 2; k >= 0; k--)
+                {
+                    stage_vector PG = P[k+1] * G[k];
+                    stage_vector pf = P[k+1] * f[k] + p[k+1];
+                    stage_vector Q_sv = F[k].transpose() * PG;
+                    double Q_vv = G[k].dot(PG);
+                    if (!(Q_vv > 0))
+                        return false;
+
+                    K[k] = -Q_sv.transpose() / Q_vv;
+                    k_ff[k] = -G[k].dot(pf) / Q_vv;
+
+                    P[k] = kkt.H[k] + F[k].transpose() * P[k+1] * F[k] - Q_sv * Q_sv.transpose() / Q_vv;
+                    P[k] = 0.5 * (P[k] + P[k].transpose());
+                    p[k] = kkt.g[k] + F[k].transpose() * pf + Q_sv * k_ff[k];
+                }
+
+                // first stage, x and z are fixed by the initial rows
+                stage_vector s0;
+                s0.head<2>() = -kkt.c_init;
+                Eigen::Matrix<double, 6, 6> P_bb = P[0].block<6,6>(2,2);
+                Eigen::Matrix<double, 6, 1> rhs = -(P[0].block<6,2>(2,0) * s0.head<2>() + p[0].segment<6>(2));
+                Eigen::LLT<Eigen::Matrix<double, 6, 6>> llt(P_bb);
+                if (llt.info() != Eigen::Success)
+                    return false;
+                s0.tail<6>() = llt.solve(rhs);
+
+                // forward rollout
+                solution.dz[0] = s0;
+                for (int k = 0; k < N - 1; k++)
+                {
+                    double v = K[k].dot(solution.dz[k]) + k_ff[k];
+                    solution.dz[k+1] = F[k] * solution.dz[k] + G[k] * v + f[k];
+                }
+
+                // multipliers from the state rows of stationarity
+                // H_k dz_k + g_k + A_k' lambda_k + B_k-1' lambda_k-1 = 0
+                stage_vector r = kkt.H[N-1] * solution.dz[N-1] + kkt.g[N-1];
+                for (int k = N - 1; k >= 1; k--)
+                {
+                    solution.lambda[k-1] = -B_inverse[k-1].transpose() * r.head<7>();
+                    r = kkt.H[k-1] * solution.dz[k-1] + kkt.g[k-1] + kkt.A[k-1].transpose() * solution.lambda[k-1];
+                }
+                solution.lambda_init = -r.head<2>();
+
+                return true;
+            }
+
+            const char *name() const { return "riccati"; }
+
+        private:
+            aligned_vector<Eigen::Matrix<double, 7, 7>> B_inverse;
+            aligned_vector<stage_matrix> F;
+            aligned_vector<stage_vector> G;
+            aligned_vector<stage_vector> f;
+            aligned_vector<stage_matrix> P;
+            aligned_vector<stage_vector> p;
+            aligned_vector<stage_vector> K;
+            std::vector<double> k_ff;
+
+            void resize(int N)
+            {
+                if ((int)P.size() == N)
+                    return;
+                B_inverse.resize(N-1);
+                F.resize(N-1); G.resize(N-1); f.resize(N-1);
+                K.resize(N-1); k_ff.resize(N-1);
+                P.resize(N); p.resize(N);
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,544 @@
+/*
+* fpgm_simulator.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Continuous time simulation and Monte Carlo dispersion of a control_state
+
+#ifndef FPGM_SIMULATOR_H
+#define FPGM_SIMULATOR_H
+
+#include <math.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#include "fpgm_collocation.h"
+#include "fpgm_kkt.h"
+#include "fpgm_tvlqr.h"
+#include "work_stealing_pool.h"
+#include "math/WelfordMeanVector.hpp"
+#include "Eigen/Dense"
+
+namespace fpgm_collocation
+{
+    struct dispersion_options
+    {
+        int samples = 1000;
+        int threads = 1;
+        double dt = 0.002; // rk4 step
+        // 1 sigma, relative to the nominal value
+        double mass_sigma = 0.02;
+        double inertia_sigma = 0.05;
+        double area_sigma = 0.05;
+        // 1 sigma on [x, z, theta, phi, xdot, zdot, thetadot] of the first knot
+        double initial_state_sigma[7] = {0.5, 0.5, 0.02, 0.0, 0.5, 0.5, 0.05};
+        unsigned int seed = 0;
+        // follow a TVLQR schedule instead of the open loop phidot when set
+        const gain_schedule *feedback = nullptr;
+    };
+
+    /** @brief touchdown statistics of the Monte Carlo rollouts **/
+    struct dispersion_report
+    {
+        struct statistics
+        {
+            double mean = 0, sigma = 0, min = 0, max = 0, p05 = 0, p95 = 0;
+        };
+
+        int samples = 0;
+        int touchdowns = 0; // samples that reached the ground height before the end of the schedule
+        // rollouts that went non finite or above 10 x velocity_constrain, left out of the statistics
+        int diverged = 0;
+        // x, z, xdot, zdot, speed at touchdown (or at the end of the schedule)
+        statistics x, z, vx, vz, speed;
+        double solve_time = 0;
+    };
+
+    /** @brief Simulation of fpgm_dynamics under a planned phidot schedule
+     * - phidot is linearly interpolated between the knots, as in the trapezoidal collocation
+     * - rk4 with a fixed step or Dormand-Prince rk45 with error control
+     * - touchdown is the first crossing of ground_height by z, interpolated within the step
+     * - monte_carlo() perturbs mass, inertia, surface areas and the initial state and
+     * integrates simulation_lanes samples at once in structure of arrays form. The wind model
+     * is selected once per step outside the lane loops, which have no branches of their own,
+     * but they call the scalar sin, cos and atan of libm and are only vectorized with a vector
+     * math library (e.g. libmvec with -O3 -ffast-math on glibc), otherwise the lanes run in turn
+    **/
+    class fpgm_simulator
+    {
+        public:
+            typedef Eigen::Matrix<double, 7, 1> state_vector;
+            static const int simulation_lanes = 8;
+
+            struct trajectory
+            {
+                std::vector<double> t;
+                aligned_vector<state_vector> state;
+                std::vector<double> phidot;
+                bool touched_down = false;
+                double touchdown_time = 0;
+                state_vector touchdown_state = state_vector::Zero();
+            };
+
+            /** @brief phidot of the plan at time t, held at the ends
+             * @param h knot spacing when the plan has no knot times
+             * **/
+            static double phidot_at(const fpgm_collocation::control_state &plan, double h, double t)
+            {
+                int N = (int)plan.phidot.size();
+                if (N == 0)
+                    return 0.0;
+                int i;
+                double w;
+                fpgm_collocation::locate_knot(plan, h, t, i, w);
+                return N > 1 ? (1 - w) * plan.phidot[i] + w * plan.phidot[i+1] : plan.phidot[0];
+            }
+
+            static state_vector initial_state(const fpgm_collocation::control_state &plan)
+            {
+                state_vector s;
+                s << plan.x[0], plan.z[0], plan.theta[0], plan.phi[0],
+                    plan.vx[0], plan.vz[0], plan.thetadot[0];
+                return s;
+            }
+
+            /** @brief fixed step rk4 over the duration of the plan **/
+            static trajectory simulate_rk4(
+                const equations_and_helper::fpgm_param &parameter,
+                const fpgm_collocation::control_state &plan,
+                const state_vector &start, double dt, double ground_height)
+            {
+                static equations_and_helper eq;
+                trajectory out;
+                double T = fpgm_collocation::duration(plan, parameter.h);
+                state_vector s = start;
+                double t = 0.0;
+                record(out, t, s, phidot_at(plan, parameter.h, t));
+
+                while (t < T - 1E-12 && !out.touched_down)
+                {
+                    double step = std::min(dt, T - t);
+                    // the input is linear over the step, evaluated at the rk4 stages
+                    double u0 = phidot_at(plan, parameter.h, t);
+                    double um = phidot_at(plan, parameter.h, t + step / 2);
+                    double u1 = phidot_at(plan, parameter.h, t + step);
+                    state_vector k1 = f(eq, s, u0, parameter, t);
+                    state_vector k2 = f(eq, s + step/2 * k1, um, parameter, t + step/2);
+                    state_vector k3 = f(eq, s + step/2 * k2, um, parameter, t + step/2);
+                    state_vector k4 = f(eq, s + step * k3, u1, parameter, t + step);
+                    state_vector next = s + step/6 * (k1 + 2*k2 + 2*k3 + k4);
+
+                    check_touchdown(out, t, step, s, next, ground_height);
+                    s = next;
+                    t += step;
+                    record(out, t, s, u1);
+                }
+                return out;
+            }
+
+            /** @brief Dormand-Prince rk45 with per step error control
+             * @param tolerance on max |error| / (1 + |state|)
+             * **/
+            static trajectory simulate_rk45(
+                const equations_and_helper::fpgm_param &parameter,
+                const fpgm_collocation::control_state &plan,
+                const state_vector &start, double tolerance, double ground_height)
+            {
+                static equations_and_helper eq;
+                static const double c[7] = {0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1, 1};
+                static const double a[7][6] = {
+                    {0},
+                    {1.0/5},
+                    {3.0/40, 9.0/40},
+                    {44.0/45, -56.0/15, 32.0/9},
+                    {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+                    {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+                    {35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}};
+                // 5th order weights are the last row of a, 4th order below
+                static const double b4[7] = {
+                    5179.0/57600, 0, 7571.0/16695, 393.0/640, -92097.0/339200, 187.0/2100, 1.0/40};
+
+                trajectory out;
+                double T = fpgm_collocation::duration(plan, parameter.h);
+                state_vector s = start;
+                double t = 0.0;
+                double step = parameter.h / 4;
+                record(out, t, s, phidot_at(plan, parameter.h, t));
+
+                state_vector k[7];
+                while (t < T - 1E-12 && !out.touched_down)
+                {
+                    step = std::min(step, T - t);
+                    for (int i = 0; i < 7; i++)
+                    {
+                        state_vector stage = s;
+                        for (int j = 0; j < i; j++)
+                            stage += step * a[i][j] * k[j];
+                        k[i] = f(eq, stage, phidot_at(plan, parameter.h, t + c[i] * step), parameter, t + c[i] * step);
+                    }
+                    state_vector next = s;
+                    state_vector error = state_vector::Zero();
+                    for (int i = 0; i < 7; i++)
+                    {
+                        double b5 = i < 6 ? a[6][i] : 0.0;
+                        next += step * b5 * k[i];
+                        error += step * (b5 - b4[i]) * k[i];
+                    }
+
+                    double norm = (error.array().abs() / (1.0 + s.array().abs())).maxCoeff();
+                    if (!std::isfinite(norm))
+                        break;
+                    if (norm <= tolerance || step < 1E-9)
+                    {
+                        check_touchdown(out, t, step, s, next, ground_height);
+                        s = next;
+                        t += step;
+                        record(out, t, s, phidot_at(plan, parameter.h, t));
+                    }
+                    double factor = norm > 0 ? 0.9 * pow(tolerance / norm, 0.2) : 5.0;
+                    step *= std::max(0.2, std::min(5.0, factor));
+                }
+                return out;
+            }
+
+            /** @brief Monte Carlo rollouts of the plan with perturbed parameters and initial state **/
+            static dispersion_report monte_carlo(
+                const equations_and_helper::fpgm_param &parameter,
+                const equations_and_helper::optimization_constrain &constrain,
+                const fpgm_collocation::control_state &plan,
+                double ground_height, const dispersion_options &options)
+            {
+                std::chrono::time_point<std::chrono::system_clock> start =
+                    std::chrono::system_clock::now();
+
+                dispersion_report report;
+                int samples = std::max(options.samples, 0);
+                int batches = (samples + simulation_lanes - 1) / simulation_lanes;
+                // [x, z, vx, vz, touched] per sample
+                std::vector<double> touchdown(5 * (size_t)batches * simulation_lanes, 0.0);
+
+                std::vector<size_t> jobs(batches);
+                for (int b = 0; b < batches; b++)
+                    jobs[b] = b;
+
+                // mean and variance of [x, z, vx, vz, speed] per batch, merged in batch order
+                // afterwards so no lock is taken
+                std::vector<math::WelfordMeanVector<double, 5>> moments(batches);
+
+                work_stealing_pool pool(options.threads);
+                pool.run(jobs, [&](size_t b, int worker)
+                {
+                    // seeded per batch so the result does not depend on the thread count
+                    std::mt19937 generator(options.seed + (unsigned int)b * 7919u);
+                    batch_rollout(parameter, constrain, plan, ground_height, options, generator,
+                        touchdown.data() + 5 * b * simulation_lanes);
+
+                    for (int i = (int)b * simulation_lanes;
+                        i < std::min(samples, ((int)b + 1) * simulation_lanes); i++)
+                    {
+                        const double *r = touchdown.data() + 5 * i;
+                        if (!diverged(r, constrain))
+                            moments[b].update(touchdown_values(r));
+                    }
+                });
+
+                math::WelfordMeanVector<double, 5> moment;
+                for (int b = 0; b < batches; b++)
+                    moment.merge(moments[b]);
+
+                std::vector<double> values[5];
+                for (int i = 0; i < samples; i++)
+                {
+                    const double *r = touchdown.data() + 5 * i;
+                    if (diverged(r, constrain))
+                    {
+                        report.diverged++;
+                        continue;
+                    }
+                    const matrix::Vector<double, 5> v = touchdown_values(r);
+                    for (int j = 0; j < 5; j++)
+                        values[j].push_back(v(j));
+                    report.touchdowns += r[4] > 0;
+                }
+                report.samples = samples;
+                const matrix::Vector<double, 5> mean = moment.mean();
+                const matrix::Vector<double, 5> variance = moment.variance();
+                report.x = statistics(values[0], mean(0), variance(0));
+                report.z = statistics(values[1], mean(1), variance(1));
+                report.vx = statistics(values[2], mean(2), variance(2));
+                report.vz = statistics(values[3], mean(3), variance(3));
+                report.speed = statistics(values[4], mean(4), variance(4));
+                report.solve_time = std::chrono::duration<double>(
+                    std::chrono::system_clock::now() - start).count();
+                return report;
+            }
+
+            /** @brief fpgm_dynamics for simulation_lanes samples in structure of arrays form
+             * @param s [7][lanes] state, u [lanes] phidot
+             * @param mass, inertia, s_w, s_e [lanes] per sample parameters
+             * @param ds [7][lanes] time derivative
+             * @param t time from the first knot, for the wind lookup
+             * **/
+            static void dynamics_lanes(
+                const double (&s)[7][simulation_lanes], const double *u,
+                const equations_and_helper::fpgm_param &parameter,
+                const double *mass, const double *inertia, const double *s_w, const double *s_e,
+                double (&ds)[7][simulation_lanes], double t = 0.0)
+            {
+                const double g = 9.81, p = 1.225;
+                const double l_w = parameter.l_w, l_e = parameter.l_e, l = parameter.l;
+
+                double wind_x[simulation_lanes], wind_z[simulation_lanes];
+                wind_lanes(parameter.wind, s[1], t, wind_x, wind_z);
+
+                for (int i = 0; i < simulation_lanes; i++)
+                {
+                    double theta = s[2][i], phi = s[3][i];
+                    double xdot = s[4][i], zdot = s[5][i], thetadot = s[6][i];
+                    double sin_t = sin(theta), cos_t = cos(theta);
+                    double sin_e = sin(theta + phi), cos_e = cos(theta + phi);
+                    double air_xdot = xdot - wind_x[i], air_zdot = zdot - wind_z[i];
+
+                    double w0 = air_xdot + l_w * thetadot * sin_t;
+                    double w1 = air_zdot - l_w * thetadot * cos_t;
+                    double e0 = air_xdot + l * thetadot * sin_t + l_e * (thetadot + u[i]) * sin_e;
+                    double e1 = air_zdot - l * thetadot * cos_t - l_e * (thetadot + u[i]) * cos_e;
+
+                    double alpha_w = theta - atan(w1 / w0);
+                    double alpha_e = theta + phi - atan(e1 / e0);
+                    double sa_w = sin(alpha_w), ca_w = cos(alpha_w);
+                    double sa_e = sin(alpha_e), ca_e = cos(alpha_e);
+                    // cl + cd = 2 sin cos + 2 sin^2
+                    double f_w = 0.5 * p * (w0 * w0 + w1 * w1) * s_w[i] * (2 * sa_w * ca_w + 2 * sa_w * sa_w);
+                    double f_e = 0.5 * p * (e0 * e0 + e1 * e1) * s_e[i] * (2 * sa_e * ca_e + 2 * sa_e * sa_e);
+
+                    // force along n_w = (-sin, cos) and n_e
+                    double fw0 = -f_w * sin_t, fw1 = f_w * cos_t;
+                    double fe0 = -f_e * sin_e, fe1 = f_e * cos_e;
+
+                    double r0 = -l - l_e * cos_t, r1 = -l + l_e * sin_t;
+
+                    ds[0][i] = xdot;
+                    ds[1][i] = zdot;
+                    ds[2][i] = thetadot;
+                    ds[3][i] = u[i];
+                    ds[4][i] = (fw0 + fe0) / mass[i];
+                    ds[5][i] = (fw1 + fe1 - mass[i] * g) / mass[i];
+                    ds[6][i] = (l_w * fw1 + (r0 * fe1 - r1 * fe0)) / inertia[i];
+                }
+            }
+
+        private:
+
+            /** @brief wind_field::at for every lane, only the shear depends on the height of the
+             * lane, the other models are evaluated once and copied to the lanes
+             * **/
+            static void wind_lanes(
+                const equations_and_helper::wind_field &wind, const double (&z)[simulation_lanes], double t,
+                double (&wind_x)[simulation_lanes], double (&wind_z)[simulation_lanes])
+            {
+                if (wind.model == equations_and_helper::wind_field::SHEAR)
+                {
+                    for (int i = 0; i < simulation_lanes; i++)
+                    {
+                        wind_x[i] = wind.x + wind.shear_x * (z[i] - wind.reference_height);
+                        wind_z[i] = wind.z;
+                    }
+                    return;
+                }
+
+                double wx, wz;
+                wind.at(0.0, t, wx, wz);
+                for (int i = 0; i < simulation_lanes; i++)
+                {
+                    wind_x[i] = wx;
+                    wind_z[i] = wz;
+                }
+            }
+
+            static state_vector f(
+                equations_and_helper &eq, const state_vector &s, double u,
+                const equations_and_helper::fpgm_param &parameter, double t)
+            {
+                return eq.fpgm_dynamics(s[0], s[1], s[2], s[3], s[4], s[5], s[6], u, parameter, t);
+            }
+
+            static void record(trajectory &out, double t, const state_vector &s, double u)
+            {
+                out.t.push_back(t);
+                out.state.push_back(s);
+                out.phidot.push_back(u);
+            }
+
+            static void check_touchdown(
+                trajectory &out, double t, double step,
+                const state_vector &s, const state_vector &next, double ground_height)
+            {
+                if (out.touched_down || !(s[1] > ground_height && next[1] <= ground_height))
+                    return;
+                double w = (s[1] - ground_height) / (s[1] - next[1]);
+                out.touched_down = true;
+                out.touchdown_time = t + w * step;
+                out.touchdown_state = (1 - w) * s + w * next;
+            }
+
+            /** @brief rollouts that went non finite or above 10 x velocity_constrain
+             * @param r [x, z, vx, vz, touched] of one sample
+            **/
+            static bool diverged(
+                const double *r, const equations_and_helper::optimization_constrain &constrain)
+            {
+                return !std::isfinite(r[0] + r[1] + r[2] + r[3]) ||
+                    r[2] * r[2] + r[3] * r[3] > 100 * constrain.v_c * constrain.v_c;
+            }
+
+            /** @brief [x, z, vx, vz, speed] of one sample **/
+            static matrix::Vector<double, 5> touchdown_values(const double *r)
+            {
+                matrix::Vector<double, 5> v;
+                for (int j = 0; j < 4; j++)
+                    v(j) = r[j];
+                v(4) = sqrt(r[2] * r[2] + r[3] * r[3]);
+                return v;
+            }
+
+            /** @brief min, max and percentiles of v, mean and variance come from the
+             * merged WelfordMeanVector
+            **/
+            static dispersion_report::statistics statistics(
+                std::vector<double> v, double mean, double variance)
+            {
+                dispersion_report::statistics st;
+                if (v.empty())
+                    return st;
+                st.mean = mean;
+                st.sigma = sqrt(std::max(0.0, variance));
+                std::sort(v.begin(), v.end());
+                st.min = v.front();
+                st.max = v.back();
+                st.p05 = v[(size_t)(0.05 * (v.size() - 1))];
+                st.p95 = v[(size_t)(0.95 * (v.size() - 1))];
+                return st;
+            }
+
+            /** @brief rk4 for simulation_lanes perturbed samples
+             * @param result [x, z, vx, vz, touched] per lane
+             * **/
+            static void batch_rollout(
+                const equations_and_helper::fpgm_param &parameter,
+                const equations_and_helper::optimization_constrain &constrain,
+                const fpgm_collocation::control_state &plan, double ground_height,
+                const dispersion_options &options, std::mt19937 &generator, double *result)
+            {
+                const int L = simulation_lanes;
+                std::normal_distribution<double> normal(0.0, 1.0);
+
+                double mass[L], inertia[L], s_w[L], s_e[L];
+                double s[7][L], k[4][7][L], stage[7][L], u[L];
+                double z_previous[L], touched[L];
+                state_vector nominal = initial_state(plan);
+
+                for (int i = 0; i < L; i++)
+                {
+                    mass[i] = parameter.mass * std::max(0.1, 1 + options.mass_sigma * normal(generator));
+                    inertia[i] = parameter.I * std::max(0.1, 1 + options.inertia_sigma * normal(generator));
+                    s_w[i] = parameter.s_w * std::max(0.1, 1 + options.area_sigma * normal(generator));
+                    s_e[i] = parameter.s_e * std::max(0.1, 1 + options.area_sigma * normal(generator));
+                    for (int j = 0; j < 7; j++)
+                        s[j][i] = nominal[j] + options.initial_state_sigma[j] * normal(generator);
+                    touched[i] = 0.0;
+                    for (int j = 0; j < 4; j++)
+                        result[5*i + j] = 0.0;
+                    result[5*i + 4] = 0.0;
+                }
+
+                double T = fpgm_collocation::duration(plan, parameter.h);
+                const double c[4] = {0.0, 0.5, 0.5, 1.0};
+                for (double t = 0.0; t < T - 1E-12; )
+                {
+                    double step = std::min(options.dt, T - t);
+                    for (int i = 0; i < L; i++)
+                        z_previous[i] = s[1][i];
+
+                    for (int r = 0; r < 4; r++)
+                    {
+                        double tr = t + c[r] * step;
+                        for (int j = 0; j < 7; j++)
+                            for (int i = 0; i < L; i++)
+                                stage[j][i] = r == 0 ? s[j][i] : s[j][i] + c[r] * step * k[r-1][j][i];
+
+                        double planned = phidot_at(plan, parameter.h, tr);
+                        for (int i = 0; i < L; i++)
+                        {
+                            u[i] = planned;
+                            if (options.feedback)
+                            {
+                                double x[7];
+                                for (int j = 0; j < 7; j++)
+                                    x[j] = stage[j][i];
+                                u[i] = std::max(-constrain.pd_c, std::min(constrain.pd_c,
+                                    options.feedback->evaluate(tr, x)));
+                            }
+                        }
+                        dynamics_lanes(stage, u, parameter, mass, inertia, s_w, s_e, k[r], tr);
+                    }
+
+                    for (int j = 0; j < 7; j++)
+                        for (int i = 0; i < L; i++)
+                            s[j][i] += step / 6 * (k[0][j][i] + 2 * k[1][j][i] + 2 * k[2][j][i] + k[3][j][i]);
+                    t += step;
+
+                    // the first crossing of the ground height is kept, interpolated within the step
+                    bool all_touched = true;
+                    for (int i = 0; i < L; i++)
+                    {
+                        bool crossing = touched[i] == 0.0 && z_previous[i] > ground_height && s[1][i] <= ground_height;
+                        if (crossing)
+                        {
+                            double w = (z_previous[i] - ground_height) / (z_previous[i] - s[1][i]);
+                            double back = (1 - w) * step;
+                            // positions moved back along the end of step velocity
+                            result[5*i + 0] = s[0][i] - back * s[4][i];
+                            result[5*i + 1] = ground_height;
+                            result[5*i + 2] = s[4][i];
+                            result[5*i + 3] = s[5][i];
+                            result[5*i + 4] = 1.0;
+                            touched[i] = 1.0;
+                        }
+                        all_touched &= touched[i] != 0.0;
+                    }
+                    if (all_touched)
+                        break;
+                }
+
+                // samples that never crossed report their state at the end of the schedule
+                for (int i = 0; i < L; i++)
+                    if (touched[i] == 0.0)
+                    {
+                        result[5*i + 0] = s[0][i];
+                        result[5*i + 1] = s[1][i];
+                        result[5*i + 2] = s[4][i];
+                        result[5*i + 3] = s[5][i];
+                    }
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,616 @@
+/*
+* fpgm_sqp.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Native primal-dual interior point SQP for the fpgm trapezoidal collocation problem
+
+#ifndef FPGM_SQP_H
+#define FPGM_SQP_H
+
+#include <math.h>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <chrono>
+
+#include "fpgm_collocation.h"
+#include "fpgm_kkt.h"
+#include "Eigen/Dense"
+
+namespace fpgm_collocation
+{
+    enum kkt_backend
+    {
+        RICCATI,
+        SPARSE_LU,
+        DENSE_LU
+    };
+
+    struct sqp_options
+    {
+        int max_iterations = 200;
+        double tolerance = 1E-6; // primal feasibility
+        double dual_tolerance = 1E-4; // scaled stationarity
+        double mu_init = 1E-1;
+        double mu_min = 1E-9;
+        kkt_backend backend = RICCATI;
+        bool exact_hessian = true; // include the (convexified) curvature of the defects
+        bool verbose = false;
+    };
+
+    /** @brief Primal-dual interior point SQP specialized to fpgm_collocation
+     * reference : https://link.springer.com/article/10.1007/s10107-004-0559-y (IPOPT)
+     *
+     * - The collocation defects and the start position are equality constrains
+     * (not the +-0.01 band used with COBYLA)
+     * - The box constrains on theta, phi, velocities and rates are handled by a log barrier
+     * - Terminal constrains : the position box and pitch window bound the last knot, the touchdown
+     * speed max_speed^2 - |v|^2 >= 0 has its own barrier multiplier
+     * - The Hessian is the (constant) Hessian of the control effort objective plus the barrier term,
+     * which keeps every KKT system non-singular without inertia correction
+     * - Each iteration costs one KKT factorization through a pluggable kkt_linear_solver
+    **/
+    class fpgm_sqp
+    {
+        public:
+            fpgm_sqp(
+                const equations_and_helper::fpgm_param &parameter,
+                const equations_and_helper::optimization_constrain &constrain,
+                sqp_options opt = sqp_options()) :
+                param(parameter), boundary(constrain), options(opt)
+            {
+                set_linear_solver(make_linear_solver(options.backend));
+            }
+
+            static std::shared_ptr<kkt_linear_solver> make_linear_solver(kkt_backend backend)
+            {
+                switch (backend)
+                {
+                    case DENSE_LU:
+                        return std::make_shared<dense_lu_kkt_solver>();
+                    case SPARSE_LU:
+                        return std::make_shared<sparse_lu_kkt_solver>();
+                    case RICCATI:
+                    default:
+                        return std::make_shared<riccati_kkt_solver>();
+                }
+            }
+
+            void set_linear_solver(std::shared_ptr<kkt_linear_solver> solver) { linear_solver = solver; }
+
+            const fpgm_collocation::solve_report &get_report() const { return report; }
+
+            fpgm_collocation::control_state solve(const std::vector<double> &guess)
+            {
+                report = {};
+                fpgm_collocation::control_state final_vector;
+                if (guess.empty() || guess.size() % 8 != 0)
+                    return final_vector;
+
+                std::chrono::time_point<std::chrono::system_clock> start =
+                    std::chrono::system_clock::now();
+
+                N = (int)guess.size() / 8;
+                setup_bounds();
+                kkt.resize(N);
+                step.resize(N);
+                f.resize(N); J.resize(N);
+                f_trial.resize(N); c_trial.resize(N-1);
+                lambda.assign(N-1, defect_vector::Zero());
+                lambda_init.setZero();
+
+                z = Eigen::Map<const Eigen::VectorXd>(guess.data(), guess.size());
+                push_to_interior();
+
+                double mu = options.mu_init;
+                zl.setZero(8*N); zu.setZero(8*N);
+                for (int i = 0; i < 8*N; i++)
+                {
+                    if (has_lower(i)) zl[i] = mu / (z[i] - lb[i]);
+                    if (has_upper(i)) zu[i] = mu / (ub[i] - z[i]);
+                }
+                zs = has_speed_limit() ? mu / speed_slack(z) : 0.0;
+
+                double nu = 1.0; // l1 merit penalty
+                int iter = 0;
+                bool converged = false;
+
+                for (; iter < options.max_iterations; iter++)
+                {
+                    evaluate_derivatives();
+
+                    double primal_error = constraint_norm_inf();
+                    double dual_error = dual_residual();
+                    if (primal_error < options.tolerance && dual_error < options.dual_tolerance &&
+                        complementarity(0.0) < options.dual_tolerance)
+                    {
+                        converged = true;
+                        break;
+                    }
+
+                    // barrier subproblem solved, decrease mu (monotone Fiacco-McCormick),
+                    // only the complementarity target depends on mu
+                    while (mu > options.mu_min &&
+                        std::max(primal_error, std::max(dual_error, complementarity(mu))) < 10 * mu)
+                        mu = std::max(options.mu_min, std::min(0.2 * mu, pow(mu, 1.5)));
+
+                    build_kkt(mu);
+                    if (!linear_solver->solve(kkt, step))
+                    {
+                        printf("fpgm_sqp: %s failed to factorize the kkt system\n", linear_solver->name());
+                        break;
+                    }
+
+                    Eigen::VectorXd dz(8*N);
+                    for (int k = 0; k < N; k++)
+                        dz.segment<8>(8*k) = step.dz[k];
+
+                    // dual steps from the linearized complementarity
+                    Eigen::VectorXd dzl = Eigen::VectorXd::Zero(8*N);
+                    Eigen::VectorXd dzu = Eigen::VectorXd::Zero(8*N);
+                    for (int i = 0; i < 8*N; i++)
+                    {
+                        if (has_lower(i))
+                            dzl[i] = mu / (z[i] - lb[i]) - zl[i] - zl[i] / (z[i] - lb[i]) * dz[i];
+                        if (has_upper(i))
+                            dzu[i] = mu / (ub[i] - z[i]) - zu[i] + zu[i] / (ub[i] - z[i]) * dz[i];
+                    }
+
+                    // fraction to the boundary
+                    double tau = std::max(0.99, 1.0 - mu);
+                    double alpha_primal = 1.0, alpha_dual = 1.0;
+                    double dzs = 0.0;
+                    if (has_speed_limit())
+                    {
+                        int v = 4 + 8*(N-1);
+                        double g = speed_slack(z);
+                        double slope = -2 * (z[v] * dz[v] + z[v+1] * dz[v+1]);
+                        dzs = mu / g - zs - zs / g * slope;
+                        if (dzs < 0)
+                            alpha_dual = std::min(alpha_dual, -tau * zs / dzs);
+                        // nonlinear, back off until the slack keeps 1 - tau of its value
+                        while (alpha_primal > 1E-12 && speed_slack(z + alpha_primal * dz) < (1 - tau) * g)
+                            alpha_primal *= 0.5;
+                    }
+                    for (int i = 0; i < 8*N; i++)
+                    {
+                        if (has_lower(i) && dz[i] < 0)
+                            alpha_primal = std::min(alpha_primal, -tau * (z[i] - lb[i]) / dz[i]);
+                        if (has_upper(i) && dz[i] > 0)
+                            alpha_primal = std::min(alpha_primal, tau * (ub[i] - z[i]) / dz[i]);
+                        if (dzl[i] < 0)
+                            alpha_dual = std::min(alpha_dual, -tau * zl[i] / dzl[i]);
+                        if (dzu[i] < 0)
+                            alpha_dual = std::min(alpha_dual, -tau * zu[i] / dzu[i]);
+                    }
+
+                    // l1 merit, the penalty has to dominate the multipliers
+                    // for the step to be a descent direction
+                    double c_norm = constraint_norm_one();
+                    double barrier_derivative = barrier_gradient(mu).dot(dz);
+                    double curvature = 0;
+                    for (int k = 0; k < N; k++)
+                        curvature += step.dz[k].dot(kkt.H[k] * step.dz[k]);
+                    double lambda_max = step.lambda_init.cwiseAbs().maxCoeff();
+                    for (int k = 0; k < N - 1; k++)
+                        lambda_max = std::max(lambda_max, step.lambda[k].cwiseAbs().maxCoeff());
+                    nu = std::max(nu, lambda_max + 1.0);
+                    if (c_norm > 1E-12)
+                        nu = std::max(nu, (barrier_derivative + 0.5 * std::max(curvature, 0.0)) / (0.9 * c_norm));
+
+                    double merit_0 = merit(z, mu, nu);
+                    double directional = barrier_derivative - nu * c_norm;
+                    double alpha = alpha_primal;
+                    Eigen::VectorXd trial;
+                    bool accepted = false;
+                    while (alpha > 1E-8)
+                    {
+                        trial = z + alpha * dz;
+                        if (merit(trial, mu, nu) <= merit_0 + 1E-4 * alpha * directional)
+                        {
+                            accepted = true;
+                            break;
+                        }
+                        alpha *= 0.5;
+                    }
+                    if (!accepted)
+                    {
+                        // take the smallest step and let the next linearization recover
+                        trial = z + alpha * dz;
+                    }
+
+                    z = trial;
+                    zl += alpha_dual * dzl;
+                    zu += alpha_dual * dzu;
+                    if (has_speed_limit())
+                    {
+                        double g = speed_slack(z);
+                        zs = std::max(std::min(zs + alpha_dual * dzs, 1E10 * mu / g), 1E-10 * mu / g);
+                    }
+                    lambda_init += alpha * (step.lambda_init - lambda_init);
+                    for (int k = 0; k < N - 1; k++)
+                        lambda[k] += alpha * (step.lambda[k] - lambda[k]);
+
+                    // keep the bound multipliers close to the primal-dual central path
+                    for (int i = 0; i < 8*N; i++)
+                    {
+                        if (has_lower(i))
+                        {
+                            double s = z[i] - lb[i];
+                            zl[i] = std::max(std::min(zl[i], 1E10 * mu / s), 1E-10 * mu / s);
+                        }
+                        if (has_upper(i))
+                        {
+                            double s = ub[i] - z[i];
+                            zu[i] = std::max(std::min(zu[i], 1E10 * mu / s), 1E-10 * mu / s);
+                        }
+                    }
+
+                    if (options.verbose)
+                        printf("sqp iter %d mu %.2e primal %.3e dual %.3e alpha %.3f merit %lf\n",
+                            iter, mu, primal_error, dual_error, alpha, merit_0);
+                }
+
+                evaluate_constraints(z);
+                report.converged = converged;
+                report.iterations = iter;
+                report.cost = fpgm_collocation::trajectory_cost(z.data(), N, param);
+                report.constraint_violation = fpgm_collocation::max_defect(z.data(), N, param);
+                report.solve_time = std::chrono::duration<double>(
+                    std::chrono::system_clock::now() - start).count();
+
+                if (options.verbose)
+                    printf("sqp (%s) completed in %d iterations, cost %lf, defect %.3e, converged %d\n",
+                        linear_solver->name(), iter, report.cost, report.constraint_violation, converged);
+
+                final_vector = fpgm_collocation::to_control_state(z.data(), N, param);
+                return final_vector;
+            }
+
+        private:
+
+            equations_and_helper eq;
+            equations_and_helper::fpgm_param param;
+            equations_and_helper::optimization_constrain boundary;
+            sqp_options options;
+            std::shared_ptr<kkt_linear_solver> linear_solver;
+            fpgm_collocation::solve_report report = {};
+
+            int N;
+            Eigen::VectorXd z, zl, zu, lb, ub;
+            double zs; // multiplier of the touchdown speed limit
+            aligned_vector<defect_vector> lambda;
+            Eigen::Vector2d lambda_init;
+
+            // dynamics and jacobian at every knot
+            aligned_vector<defect_vector> f;
+            aligned_vector<defect_matrix> J;
+
+            // constraints at the line search trial points, kept apart from the linearization
+            aligned_vector<defect_vector> f_trial, c_trial;
+            Eigen::Vector2d c_init_trial;
+
+            kkt_system kkt;
+            kkt_solution step;
+
+            bool has_lower(int i) const { return lb[i] > -std::numeric_limits<double>::infinity(); }
+            bool has_upper(int i) const { return ub[i] < std::numeric_limits<double>::infinity(); }
+
+            bool has_speed_limit() const
+            {
+                return boundary.terminal.enabled && boundary.terminal.max_speed > 0;
+            }
+
+            /** @brief max_speed^2 - |v|^2 at the last knot **/
+            double speed_slack(const Eigen::VectorXd &v) const
+            {
+                int i = 4 + 8*(N-1);
+                return pow(boundary.terminal.max_speed, 2) - v[i]*v[i] - v[i+1]*v[i+1];
+            }
+
+            void setup_bounds()
+            {
+                const double inf = std::numeric_limits<double>::infinity();
+                // x, z, theta, phi, xdot, zdot, thetadot, phidot
+                const double bound[8] = {inf, inf,
+                    boundary.t_c, boundary.p_c, boundary.v_c, boundary.v_c,
+                    boundary.td_c, boundary.pd_c};
+                lb.resize(8*N); ub.resize(8*N);
+                for (int k = 0; k < N; k++)
+                    for (int j = 0; j < 8; j++)
+                    {
+                        lb[j+8*k] = -bound[j];
+                        ub[j+8*k] = bound[j];
+                    }
+
+                const equations_and_helper::terminal_constrain &terminal = boundary.terminal;
+                if (!terminal.enabled)
+                    return;
+                int last = 8*(N-1);
+                if (terminal.x_tolerance > 0)
+                {
+                    lb[last] = boundary.ix.back() - terminal.x_tolerance;
+                    ub[last] = boundary.ix.back() + terminal.x_tolerance;
+                }
+                if (terminal.z_tolerance > 0)
+                {
+                    lb[last+1] = boundary.iz.back() - terminal.z_tolerance;
+                    ub[last+1] = boundary.iz.back() + terminal.z_tolerance;
+                }
+                if (terminal.theta_min < terminal.theta_max)
+                {
+                    lb[last+2] = std::max(lb[last+2], terminal.theta_min);
+                    ub[last+2] = std::min(ub[last+2], terminal.theta_max);
+                }
+            }
+
+            void push_to_interior()
+            {
+                for (int i = 0; i < 8*N; i++)
+                {
+                    if (!has_lower(i) || !has_upper(i))
+                        continue;
+                    double margin = std::min(1E-2 * std::max(1.0, fabs(lb[i])), 1E-2 * (ub[i] - lb[i]));
+                    z[i] = std::max(lb[i] + margin, std::min(ub[i] - margin, z[i]));
+                }
+
+                if (has_speed_limit())
+                {
+                    int v = 4 + 8*(N-1);
+                    double speed = sqrt(z[v]*z[v] + z[v+1]*z[v+1]);
+                    double limit = 0.9 * boundary.terminal.max_speed;
+                    if (speed > limit)
+                    {
+                        z[v] *= limit / speed;
+                        z[v+1] *= limit / speed;
+                    }
+                }
+            }
+
+            defect_vector dynamics(const double *s, int k)
+            {
+                return eq.fpgm_dynamics(
+                    s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], param, param.time(k));
+            }
+
+            /** @brief defects c_k = x_k - x_k+1 + h/2 (f_k + f_k+1) and the start residual **/
+            void evaluate_constraints(const Eigen::VectorXd &v)
+            {
+                evaluate_constraints(v, f, kkt.c, kkt.c_init);
+            }
+
+            void evaluate_constraints(const Eigen::VectorXd &v, aligned_vector<defect_vector> &f_v,
+                aligned_vector<defect_vector> &c, Eigen::Vector2d &c_init)
+            {
+                for (int k = 0; k < N; k++)
+                    f_v[k] = dynamics(v.data() + 8*k, k);
+                for (int k = 0; k < N - 1; k++)
+                    c[k] = v.segment<7>(8*k) - v.segment<7>(8*(k+1)) + param.step(k)/2 * (f_v[k] + f_v[k+1]);
+                c_init = Eigen::Vector2d(v[0] - boundary.ix[0], v[1] - boundary.iz[0]);
+            }
+
+            void evaluate_derivatives()
+            {
+                evaluate_constraints(z);
+                for (int k = 0; k < N; k++)
+                    J[k] = eq.fpgm_jacobian(z.data() + 8*k, param, param.time(k));
+                for (int k = 0; k < N - 1; k++)
+                {
+                    kkt.A[k] = param.step(k)/2 * J[k];
+                    kkt.B[k] = param.step(k)/2 * J[k+1];
+                    for (int j = 0; j < 7; j++)
+                    {
+                        kkt.A[k](j,j) += 1.0;
+                        kkt.B[k](j,j) -= 1.0;
+                    }
+                }
+            }
+
+            /** @brief hessian of the control effort at knot k, scaled by its trapezoidal weight **/
+            stage_matrix objective_hessian(int k) const
+            {
+                double weight = param.weight(k, N);
+                stage_matrix H = stage_matrix::Zero();
+                H.block<7,7>(0,0) = weight * (param.Q + param.Q.transpose());
+                H(7,7) = 2 * weight * param.R;
+                if (k == N - 1 && boundary.terminal.enabled)
+                {
+                    H(0,0) += 2 * boundary.terminal.position_weight;
+                    H(1,1) += 2 * boundary.terminal.position_weight;
+                    H(4,4) += 2 * boundary.terminal.speed_weight;
+                    H(5,5) += 2 * boundary.terminal.speed_weight;
+                }
+                return H;
+            }
+
+            Eigen::VectorXd objective_gradient(const Eigen::VectorXd &v) const
+            {
+                Eigen::VectorXd grad(8*N);
+                for (int k = 0; k < N; k++)
+                {
+                    double weight = param.weight(k, N);
+                    grad.segment<7>(8*k) = weight * (param.Q + param.Q.transpose()) * v.segment<7>(8*k);
+                    grad[7+8*k] = 2 * weight * param.R * v[7+8*k];
+                }
+                fpgm_collocation::terminal_cost(v.data(), N, boundary, grad.data());
+                return grad;
+            }
+
+            Eigen::VectorXd barrier_gradient(double mu) const
+            {
+                Eigen::VectorXd grad = objective_gradient(z);
+                for (int i = 0; i < 8*N; i++)
+                {
+                    if (has_lower(i)) grad[i] -= mu / (z[i] - lb[i]);
+                    if (has_upper(i)) grad[i] += mu / (ub[i] - z[i]);
+                }
+                if (has_speed_limit())
+                {
+                    // -mu log(max_speed^2 - |v|^2)
+                    int v = 4 + 8*(N-1);
+                    double g = speed_slack(z);
+                    grad[v] += 2 * mu * z[v] / g;
+                    grad[v+1] += 2 * mu * z[v+1] / g;
+                }
+                return grad;
+            }
+
+            /** @brief hessian of (h_k-1/2 lambda_k-1 + h_k/2 lambda_k)' f(z_k), the curvature the defects
+             * add to stage k, from second differences of the dynamics (44 evaluations per stage),
+             * projected to be positive semi-definite so that the stage hessians stay convex
+             * **/
+            stage_matrix constraint_hessian(int k)
+            {
+                defect_vector multiplier = defect_vector::Zero();
+                if (k > 0) multiplier += param.step(k-1)/2 * lambda[k-1];
+                if (k < N - 1) multiplier += param.step(k)/2 * lambda[k];
+
+                const double *s0 = z.data() + 8*k;
+                double s[8], step[8], f_j[8];
+                double f_0 = multiplier.dot(f[k]);
+                for (int j = 0; j < 8; j++)
+                {
+                    step[j] = 1E-4 * std::max(1.0, fabs(s0[j]));
+                    std::copy(s0, s0 + 8, s);
+                    s[j] += step[j];
+                    f_j[j] = multiplier.dot(dynamics(s, k));
+                }
+
+                stage_matrix hessian;
+                for (int j = 0; j < 8; j++)
+                    for (int l = j; l < 8; l++)
+                    {
+                        std::copy(s0, s0 + 8, s);
+                        s[j] += step[j];
+                        s[l] += step[l];
+                        hessian(j,l) = hessian(l,j) = 
+                            (multiplier.dot(dynamics(s, k)) - f_j[j] - f_j[l] + f_0) / (step[j] * step[l]);
+                    }
+
+                Eigen::SelfAdjointEigenSolver<stage_matrix> eigen(hessian);
+                stage_vector values = eigen.eigenvalues().cwiseMax(0.0);
+                return eigen.eigenvectors() * values.asDiagonal() * eigen.eigenvectors().transpose();
+            }
+
+            void build_kkt(double mu)
+            {
+                Eigen::VectorXd grad = barrier_gradient(mu);
+                for (int k = 0; k < N; k++)
+                {
+                    kkt.H[k] = objective_hessian(k);
+                    if (options.exact_hessian)
+                        kkt.H[k] += constraint_hessian(k);
+                    for (int j = 0; j < 8; j++)
+                    {
+                        int i = j + 8*k;
+                        double sigma = 1E-8;
+                        if (has_lower(i)) sigma += zl[i] / (z[i] - lb[i]);
+                        if (has_upper(i)) sigma += zu[i] / (ub[i] - z[i]);
+                        kkt.H[k](j,j) += sigma;
+                    }
+                    kkt.g[k] = grad.segment<8>(8*k);
+                }
+
+                if (has_speed_limit())
+                {
+                    // zs * hessian(-g) + zs / g * grad(g) grad(g)'
+                    int v = 4 + 8*(N-1);
+                    double g = speed_slack(z);
+                    Eigen::Vector2d velocity(z[v], z[v+1]);
+                    kkt.H[N-1].block<2,2>(4,4) += 2 * zs * Eigen::Matrix2d::Identity() +
+                        4 * zs / g * velocity * velocity.transpose();
+                }
+            }
+
+            /** @brief scaled infinity norm of grad(f) + J'lambda - zl + zu, the bound multipliers
+             * are explicit so it does not depend on mu, only the complementarity does **/
+            double dual_residual() const
+            {
+                Eigen::VectorXd grad = objective_gradient(z);
+                Eigen::VectorXd r = grad - zl + zu;
+                r.segment<2>(0) += lambda_init;
+                if (has_speed_limit())
+                    r.segment<2>(4 + 8*(N-1)) += 2 * zs * z.segment<2>(4 + 8*(N-1));
+                for (int k = 0; k < N - 1; k++)
+                {
+                    r.segment<8>(8*k) += kkt.A[k].transpose() * lambda[k];
+                    r.segment<8>(8*(k+1)) += kkt.B[k].transpose() * lambda[k];
+                }
+                double scale = std::max(1.0, grad.cwiseAbs().maxCoeff());
+                return r.cwiseAbs().maxCoeff() / scale;
+            }
+
+            double complementarity(double mu) const
+            {
+                double error = 0;
+                for (int i = 0; i < 8*N; i++)
+                {
+                    if (has_lower(i)) error = std::max(error, fabs((z[i] - lb[i]) * zl[i] - mu));
+                    if (has_upper(i)) error = std::max(error, fabs((ub[i] - z[i]) * zu[i] - mu));
+                }
+                if (has_speed_limit())
+                    error = std::max(error, fabs(speed_slack(z) * zs - mu));
+                return error;
+            }
+
+            double constraint_norm_inf() const
+            {
+                double norm = kkt.c_init.cwiseAbs().maxCoeff();
+                for (int k = 0; k < N - 1; k++)
+                    norm = std::max(norm, kkt.c[k].cwiseAbs().maxCoeff());
+                return norm;
+            }
+
+            double constraint_norm_one() const
+            {
+                return constraint_norm_one(kkt.c, kkt.c_init);
+            }
+
+            double constraint_norm_one(const aligned_vector<defect_vector> &c, const Eigen::Vector2d &c_init) const
+            {
+                double norm = c_init.cwiseAbs().sum();
+                for (int k = 0; k < N - 1; k++)
+                    norm += c[k].cwiseAbs().sum();
+                return norm;
+            }
+
+            /** @brief barrier objective + nu * |c|_1, evaluates the constraints at v into the trial buffers **/
+            double merit(const Eigen::VectorXd &v, double mu, double nu)
+            {
+                double value = fpgm_collocation::trajectory_cost(v.data(), N, param) +
+                    fpgm_collocation::terminal_cost(v.data(), N, boundary);
+                for (int i = 0; i < 8*N; i++)
+                {
+                    if (has_lower(i)) value -= mu * log(v[i] - lb[i]);
+                    if (has_upper(i)) value -= mu * log(ub[i] - v[i]);
+                }
+                if (has_speed_limit())
+                {
+                    double g = speed_slack(v);
+                    if (!(g > 0))
+                        return std::numeric_limits<double>::infinity();
+                    value -= mu * log(g);
+                }
+                evaluate_constraints(v, f_trial, c_trial, c_init_trial);
+                value += nu * constraint_norm_one(c_trial, c_init_trial);
+                return value;
+            }
+    };
+}
+
+#endif
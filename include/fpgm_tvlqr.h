@@ -0,0 +1,266 @@
+/*
+* fpgm_tvlqr.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Time varying LQR tracking of a nominal fpgm_collocation trajectory
+
+#ifndef FPGM_TVLQR_H
+#define FPGM_TVLQR_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "fpgm_collocation.h"
+#include "Eigen/Dense"
+
+namespace fpgm_collocation
+{
+    /** @brief Gain schedule sampled at a uniform dt, for the flight loop
+     * Every sample is one contiguous record of 16 doubles (two cache lines)
+     * [x_nom(7), u_nom, K(7), padding]
+     * so evaluate() touches the two neighbouring records only and is O(1) per control tick
+     * u = u_nom(t) - K(t) * (x - x_nom(t)), with x_nom, u_nom and K linearly interpolated
+    **/
+    class gain_schedule
+    {
+        public:
+            static const int record_size = 16;
+
+            double t0 = 0.0;
+            double dt = 0.0;
+            int count = 0;
+            std::vector<double> records;
+            // upper triangle of the cost-to-go S(t) per sample (28 doubles), kept apart from the
+            // records so that the flight loop does not pull it into cache
+            std::vector<double> cost_to_go;
+
+            double duration() const { return count > 1 ? (count - 1) * dt : 0.0; }
+
+            const double *record(int i) const { return records.data() + i * record_size; }
+
+            /** @brief feedback command at time t
+             * @param state = [x, z, theta, phi, xdot, zdot, thetadot]
+             * @param x_nom (optional) nominal state at t
+             * **/
+            double evaluate(double t, const double *state, double *x_nom = nullptr) const
+            {
+                if (count == 0)
+                    return 0.0;
+
+                int i;
+                double w;
+                locate(t, i, w);
+                const double *a = record(i);
+                const double *b = record(std::min(i + 1, count - 1));
+
+                double u = (1 - w) * a[7] + w * b[7];
+                for (int j = 0; j < 7; j++)
+                {
+                    double x_ref = (1 - w) * a[j] + w * b[j];
+                    double k = (1 - w) * a[8+j] + w * b[8+j];
+                    u -= k * (state[j] - x_ref);
+                    if (x_nom)
+                        x_nom[j] = x_ref;
+                }
+                return u;
+            }
+
+            /** @brief interpolated cost-to-go S(t) **/
+            Eigen::Matrix<double, 7, 7> evaluate_cost_to_go(double t) const
+            {
+                Eigen::Matrix<double, 7, 7> S = Eigen::Matrix<double, 7, 7>::Zero();
+                if (count == 0 || (int)cost_to_go.size() < 28 * count)
+                    return S;
+
+                int i;
+                double w;
+                locate(t, i, w);
+                const double *a = cost_to_go.data() + 28 * i;
+                const double *b = cost_to_go.data() + 28 * std::min(i + 1, count - 1);
+                int idx = 0;
+                for (int r = 0; r < 7; r++)
+                    for (int c = r; c < 7; c++, idx++)
+                    {
+                        S(r,c) = (1 - w) * a[idx] + w * b[idx];
+                        S(c,r) = S(r,c);
+                    }
+                return S;
+            }
+
+        private:
+
+            void locate(double t, int &i, double &w) const
+            {
+                double s = dt > 0 ? (t - t0) / dt : 0.0;
+                s = std::max(0.0, std::min((double)(count - 1), s));
+                i = std::min((int)s, std::max(count - 2, 0));
+                w = s - i;
+            }
+    };
+
+    /** @brief TVLQR along the control_state of a collocation solve
+     * reference : Robust Post-Stall Perching with a Fixed-Wing UAV by Joseph Moore (chapter 4)
+     *
+     * - the nominal state and phidot are linearly interpolated between the knots (spacing h,
+     * or the knot times of the control_state), which is what the trapezoidal collocation assumes for the input
+     * - the samples are uniform, samples_per_interval over the shortest interval
+     * - A(t), B(t) come from fpgm_jacobian at the interpolated nominal
+     * - the Riccati ODE -dS/dt = Q - S B R^-1 B' S + S A + A' S, S(T) = Qf
+     * is integrated backward with rk4, substeps per output sample
+    **/
+    class fpgm_tvlqr
+    {
+        public:
+            typedef Eigen::Matrix<double, 7, 7> state_matrix;
+            typedef Eigen::Matrix<double, 7, 1> state_vector;
+
+            /** @brief gain schedule using the Q and R of the collocation, Qf = Q **/
+            static bool compute(
+                const fpgm_collocation::control_state &nominal,
+                const equations_and_helper::fpgm_param &parameter,
+                gain_schedule &schedule, int samples_per_interval = 4)
+            {
+                return compute(nominal, parameter, parameter.Q, parameter.R, parameter.Q,
+                    schedule, samples_per_interval);
+            }
+
+            /** @brief gain schedule with separate tracking weights
+             * @param samples_per_interval output samples between two knots
+             * **/
+            static bool compute(
+                const fpgm_collocation::control_state &nominal,
+                const equations_and_helper::fpgm_param &parameter,
+                const state_matrix &Q, double R, const state_matrix &Qf,
+                gain_schedule &schedule, int samples_per_interval = 4)
+            {
+                int N = (int)nominal.x.size();
+                if (N < 2 || (int)nominal.phidot.size() != N || (int)nominal.thetadot.size() != N ||
+                    R <= 0 || samples_per_interval < 1)
+                    return false;
+
+                const int substeps = 4;
+
+                double span = fpgm_collocation::duration(nominal, parameter.h);
+                double shortest = parameter.h;
+                if (!nominal.t.empty())
+                    for (int k = 0; k < N - 1; k++)
+                        shortest = std::min(shortest, nominal.t[k+1] - nominal.t[k]);
+                if (!(span > 0) || !(shortest > 0))
+                    return false;
+
+                schedule.t0 = 0.0;
+                schedule.count = (int)ceil(span / shortest * samples_per_interval - 1E-6) + 1;
+                schedule.dt = span / (schedule.count - 1);
+                schedule.records.assign(schedule.count * gain_schedule::record_size, 0.0);
+                schedule.cost_to_go.assign(schedule.count * 28, 0.0);
+
+                // nominal records first, the jacobians interpolate from them
+                for (int i = 0; i < schedule.count; i++)
+                {
+                    int k;
+                    double w;
+                    fpgm_collocation::locate_knot(nominal, parameter.h, 
+                        (nominal.t.empty() ? 0.0 : nominal.t.front()) + i * schedule.dt, k, w);
+                    double *rec = schedule.records.data() + i * gain_schedule::record_size;
+                    rec[0] = (1 - w) * nominal.x[k] + w * nominal.x[k+1];
+                    rec[1] = (1 - w) * nominal.z[k] + w * nominal.z[k+1];
+                    rec[2] = (1 - w) * nominal.theta[k] + w * nominal.theta[k+1];
+                    rec[3] = (1 - w) * nominal.phi[k] + w * nominal.phi[k+1];
+                    rec[4] = (1 - w) * nominal.vx[k] + w * nominal.vx[k+1];
+                    rec[5] = (1 - w) * nominal.vz[k] + w * nominal.vz[k+1];
+                    rec[6] = (1 - w) * nominal.thetadot[k] + w * nominal.thetadot[k+1];
+                    rec[7] = (1 - w) * nominal.phidot[k] + w * nominal.phidot[k+1];
+                }
+
+                double R_inverse = 1.0 / R;
+                state_matrix S = 0.5 * (Qf + Qf.transpose());
+                store(schedule, schedule.count - 1, S, R_inverse, parameter);
+
+                double step = schedule.dt / substeps;
+                for (int i = schedule.count - 1; i > 0; i--)
+                {
+                    for (int s = 0; s < substeps; s++)
+                    {
+                        // time to go backwards, from sample i towards i-1
+                        double w0 = 1.0 - (double)s / substeps;
+                        double wm = 1.0 - (s + 0.5) / substeps;
+                        double w1 = 1.0 - (double)(s + 1) / substeps;
+                        state_matrix k1 = riccati_derivative(schedule, i - 1, w0, S, Q, R_inverse, parameter);
+                        state_matrix k2 = riccati_derivative(schedule, i - 1, wm, S + step/2 * k1, Q, R_inverse, parameter);
+                        state_matrix k3 = riccati_derivative(schedule, i - 1, wm, S + step/2 * k2, Q, R_inverse, parameter);
+                        state_matrix k4 = riccati_derivative(schedule, i - 1, w1, S + step * k3, Q, R_inverse, parameter);
+                        S += step/6 * (k1 + 2*k2 + 2*k3 + k4);
+                        S = 0.5 * (S + S.transpose());
+                    }
+                    if (!S.allFinite())
+                        return false;
+                    store(schedule, i - 1, S, R_inverse, parameter);
+                }
+                return true;
+            }
+
+        private:
+
+            /** @brief A and B at the nominal between sample i (w = 0) and i+1 (w = 1) **/
+            static Eigen::Matrix<double, 7, 8> linearize(
+                const gain_schedule &schedule, int i, double w,
+                const equations_and_helper::fpgm_param &parameter)
+            {
+                static equations_and_helper eq;
+                const double *a = schedule.record(i);
+                const double *b = schedule.record(std::min(i + 1, schedule.count - 1));
+                double s[8];
+                for (int j = 0; j < 8; j++)
+                    s[j] = (1 - w) * a[j] + w * b[j];
+                return eq.fpgm_jacobian(s, parameter, (i + w) * schedule.dt);
+            }
+
+            /** @brief -dS/dt, i.e. the derivative with respect to time to go **/
+            static state_matrix riccati_derivative(
+                const gain_schedule &schedule, int i, double w, const state_matrix &S,
+                const state_matrix &Q, double R_inverse,
+                const equations_and_helper::fpgm_param &parameter)
+            {
+                Eigen::Matrix<double, 7, 8> J = linearize(schedule, i, w, parameter);
+                state_matrix A = J.leftCols<7>();
+                state_vector SB = S * J.col(7);
+                state_matrix SA = S * A;
+                return Q + SA + SA.transpose() - R_inverse * SB * SB.transpose();
+            }
+
+            static void store(
+                gain_schedule &schedule, int i, const state_matrix &S, double R_inverse,
+                const equations_and_helper::fpgm_param &parameter)
+            {
+                Eigen::Matrix<double, 7, 8> J = linearize(schedule, i, 0.0, parameter);
+                state_vector K = R_inverse * S * J.col(7);
+
+                double *rec = schedule.records.data() + i * gain_schedule::record_size;
+                for (int j = 0; j < 7; j++)
+                    rec[8+j] = K[j];
+
+                double *c = schedule.cost_to_go.data() + 28 * i;
+                for (int r = 0; r < 7; r++)
+                    for (int col = r; col < 7; col++)
+                        *c++ = S(r,col);
+            }
+    };
+}
+
+#endif
@@ -46,6 +46,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "mathlib.h"
@@ -65,6 +66,9 @@ static constexpr float CONSTANTS_ABSOLUTE_NULL_CELSIUS = -273.15f;				// °C
 static constexpr double CONSTANTS_RADIUS_OF_EARTH = 6371000;					// meters (m)
 static constexpr float  CONSTANTS_RADIUS_OF_EARTH_F = CONSTANTS_RADIUS_OF_EARTH;		// meters (m)
 
+static constexpr double CONSTANTS_WGS84_A = 6378137.0;						// equatorial radius, meters (m)
+static constexpr double CONSTANTS_WGS84_F = 1.0 / 298.257223563;				// flattening
+
 static constexpr float CONSTANTS_EARTH_SPIN_RATE = 7.2921150e-5f;				// radians/second (rad/s)
 
 
@@ -115,6 +119,13 @@ void create_waypoint_from_line_and_dist(double lat_A, double lon_A, double lat_B
 void waypoint_from_heading_and_distance(double lat_start, double lon_start, float bearing, float dist,
 					double *lat_target, double *lon_target);
 
+/**
+ * Same as above with bearing and distance in double, for positions kilometers away
+ * from the start that should not go through a float
+ */
+void waypoint_from_heading_and_distance_double(double lat_start, double lon_start, double bearing, double dist,
+					double *lat_target, double *lon_target);
+
 /**
  * Returns the bearing to the next waypoint in radians.
  *
@@ -134,6 +145,10 @@ void get_vector_to_next_waypoint_fast(double lat_now, double lon_now, double lat
 void add_vector_to_global_position(double lat_now, double lon_now, float v_n, float v_e, double *lat_res,
 				   double *lon_res);
 
+// Same as above with the vector in double
+void add_vector_to_global_position_double(double lat_now, double lon_now, double v_n, double v_e, double *lat_res,
+					  double *lon_res);
+
 int get_distance_to_line(struct crosstrack_error_s *crosstrack_error, double lat_now, double lon_now,
 			 double lat_start, double lon_start, double lat_end, double lon_end);
 
@@ -141,6 +156,103 @@ int get_distance_to_arc(struct crosstrack_error_s *crosstrack_error, double lat_
 			double lat_center, double lon_center,
 			float radius, float arc_start_bearing, float arc_sweep);
 
+/**
+ * Returns the distance to the next waypoint in meters on the WGS84 ellipsoid
+ * (geodesic distance, see geo_geodesic.h), the spherical get_distance_to_next_waypoint
+ * is off by up to 0.5 %
+ *
+ * @param lat_now current position in degrees (47.1234567°, not 471234567°)
+ * @param lon_now current position in degrees (8.1234567°, not 81234567°)
+ * @param lat_next next waypoint position in degrees (47.1234567°, not 471234567°)
+ * @param lon_next next waypoint position in degrees (8.1234567°, not 81234567°)
+ */
+double get_distance_to_next_waypoint_ellipsoid(double lat_now, double lon_now, double lat_next, double lon_next);
+
+/**
+ * Returns the bearing to the next waypoint in radians on the WGS84 ellipsoid
+ * (azimuth of the geodesic at the current position)
+ *
+ * @param lat_now current position in degrees (47.1234567°, not 471234567°)
+ * @param lon_now current position in degrees (8.1234567°, not 81234567°)
+ * @param lat_next next waypoint position in degrees (47.1234567°, not 471234567°)
+ * @param lon_next next waypoint position in degrees (8.1234567°, not 81234567°)
+ */
+double get_bearing_to_next_waypoint_ellipsoid(double lat_now, double lon_now, double lat_next, double lon_next);
+
+/**
+ * Constants of a track line, computed once by init_crosstrack_line for get_distance_to_line_batch
+ */
+struct crosstrack_line_s {
+	double lat_end;		// end point latitude in radians
+	double lon_end;		// end point longitude in radians
+	double sin_lat_end;
+	double cos_lat_end;
+	double sin_bearing_track;
+	double cos_bearing_track;
+	float bearing_right;	// bearing to the line right of the track (positive distance), wrap_pi(bearing_track - pi/2)
+	float bearing_left;	// bearing to the line left of the track (negative distance), wrap_pi(bearing_track + pi/2)
+};
+
+/**
+ * Constants of a track arc, computed once by init_crosstrack_arc for get_distance_to_arc_batch
+ */
+struct crosstrack_arc_s {
+	double lat_center;	// center latitude in radians
+	double lon_center;	// center longitude in radians
+	double sin_lat_center;
+	double cos_lat_center;
+	double start_lat_offset;	// out of the sector, the arc start and end points relative to the
+	double start_lon_offset;	// current position with the same approximation as get_distance_to_arc,
+	double end_lat_offset;		// in degrees (the latitude offsets are multiplied by cos(lat_now))
+	double end_lon_offset;
+	float radius;
+	float bearing_sector_start;
+	float bearing_sector_end;
+};
+
+void init_crosstrack_line(struct crosstrack_line_s *line, double lat_start, double lon_start, double lat_end,
+			  double lon_end);
+
+void init_crosstrack_arc(struct crosstrack_arc_s *arc, double lat_center, double lon_center, float radius,
+			 float arc_start_bearing, float arc_sweep);
+
+/**
+ * get_distance_to_line for n positions against one track line
+ *
+ * The bearing to the end point is never formed, its sin / cos come out of the same
+ * terms as the distance, and the trig goes through geo_trig.h so the loop is vectorized.
+ * Matches get_distance_to_line within float precision. The arrays are structure of
+ * arrays and must not alias
+ * @param line constants of the track line
+ * @param lat_now n latitudes in degrees
+ * @param lon_now n longitudes in degrees
+ * @param distance n cross track distances in meters, positive right of the track
+ * @param past_end n flags, 1 if past the end point of the line
+ * @param bearing n bearings in radians to the closest point on the line
+ * @return number of positions get_distance_to_line would return an error for (closer than 0.1 m
+ * to the end point), their outputs are zero as in the scalar version
+ */
+int get_distance_to_line_batch(const struct crosstrack_line_s *line, const double *lat_now, const double *lon_now,
+			       float *distance, uint8_t *past_end, float *bearing, size_t n);
+
+/**
+ * get_distance_to_arc for n positions against one track arc
+ *
+ * Both the in sector and the out of sector results are computed for every position and
+ * selected without a branch, the trig goes through geo_trig.h so the loop is vectorized.
+ * Matches get_distance_to_arc within float precision. The arrays are structure of arrays
+ * and must not alias
+ * @param arc constants of the track arc
+ * @param lat_now n latitudes in degrees
+ * @param lon_now n longitudes in degrees
+ * @param distance n distances in meters to the closest point on the arc
+ * @param past_end n flags, 1 if closer to the end than to the start of the arc when out of its sector
+ * @param bearing n bearings in radians to the closest point on the arc
+ * @return n if the radius is below 0.1 m (all outputs zero), 0 otherwise
+ */
+int get_distance_to_arc_batch(const struct crosstrack_arc_s *arc, const double *lat_now, const double *lon_now,
+			      float *distance, uint8_t *past_end, float *bearing, size_t n);
+
 /*
  * Calculate distance in global frame
  */
@@ -161,6 +273,22 @@ float mavlink_wpm_distance_to_point_local(float x_now, float y_now, float z_now,
  */
 class MapProjection final
 {
+public:
+	/**
+	 * AzimuthalEquidistant : the full projection, one acos and four trig calls per point
+	 * LocalTangentPlane : second order series of the same projection around the reference,
+	 * a few multiply-adds per point, the error grows with the cube of the distance
+	 * (below 0.1 mm at 2 km at mid latitudes, see getErrorBound)
+	 * Ellipsoidal : azimuthal equidistant on the WGS84 ellipsoid, x / y are the geodesic
+	 * distance from the reference along its azimuth (geo_geodesic.h). The spherical modes
+	 * differ from it by up to 0.5 % of the distance
+	 */
+	enum class Mode : uint8_t {
+		AzimuthalEquidistant,
+		LocalTangentPlane,
+		Ellipsoidal
+	};
+
 private:
 	double _ref_lat{0.0};
 	double _ref_lon{0.0};
@@ -168,6 +296,24 @@ private:
 	double _ref_cos_lat{0.0};
 	bool _ref_init_done{false};
 
+	Mode _mode{Mode::AzimuthalEquidistant};
+	double _radius{0.0};
+	double _error_bound{0.0};
+
+	// local tangent plane series
+	// x = R (d_lat + _lt_lon2 d_lon^2), y = R d_lon (cos(lat_0) - sin(lat_0) d_lat)
+	double _lt_lon2{0.0};
+
+	// reduced latitude of the reference on the ellipsoid
+	double _ref_sin_beta{0.0};
+	double _ref_cos_beta{1.0};
+	double _ref_dn{1.0};
+
+	void project_local_tangent(double lat, double lon, double &x, double &y) const;
+	void reproject_local_tangent(double x, double y, double &lat, double &lon) const;
+	void project_ellipsoidal(double lat, double lon, double &x, double &y) const;
+	void reproject_ellipsoidal(double x, double y, double &lat, double &lon) const;
+
 public:
 	/**
 	 * @brief Construct a new Map Projection object
@@ -184,6 +330,14 @@ public:
 		initReference(lat_0, lon_0);
 	}
 
+	/**
+	 * @brief Construct and initialize a new Map Projection object, see initReference
+	 */
+	MapProjection(double lat_0, double lon_0, Mode mode, double radius)
+	{
+		initReference(lat_0, lon_0, mode, radius);
+	}
+
 	// /**
 	//  * @brief Construct and initialize a new Map Projection object
 	//  */
@@ -202,6 +356,21 @@ public:
 	 */
 	void initReference(double lat_0, double lon_0);
 
+	/**
+	 * Initialize the map transformation with a projection mode
+	 *
+	 * For Mode::LocalTangentPlane the series is checked against the full projection
+	 * on the circle of the given radius, where its error is largest, and the result
+	 * is returned by getErrorBound(). Only Mode::Ellipsoidal sets up the WGS84 geodesic
+	 * and the reduced latitude of the reference, its project / reproject are 7-11x
+	 * slower than the spherical ones in geo_benchmark
+	 * @param lat in degrees (47.1234567°, not 471234567°)
+	 * @param lon in degrees (8.1234567°, not 81234567°)
+	 * @param mode projection used by project / reproject and their batch versions
+	 * @param radius in meters, largest distance from the reference the projection is used at
+	 */
+	void initReference(double lat_0, double lon_0, Mode mode, double radius);
+
 	/**
 	 * Initialize the map transformation
 	 *
@@ -235,6 +404,18 @@ public:
 	 */
 	double getProjectionReferenceLon() const { return math::degrees(_ref_lon); };
 
+	/**
+	 * @return the projection mode
+	 */
+	Mode getMode() const { return _mode; };
+
+	/**
+	 * @return the largest difference in meters between this projection and the azimuthal
+	 * equidistant one (in project and in reproject) within the radius given to initReference,
+	 * 0 for the other modes
+	 */
+	double getErrorBound() const { return _error_bound; };
+
 	/**
 	 * Transform a point in the geographic coordinate system to the local
 	 * azimuthal equidistant plane using the projection
@@ -245,6 +426,16 @@ public:
 	 */
 	void project(double lat, double lon, float &x, float &y) const;
 
+	/**
+	 * Same as above without the truncation to float, a float only resolves
+	 * about 1 mm at 10 km and 8 mm at 100 km from the reference
+	 * @param lat in degrees (47.1234567°, not 471234567°)
+	 * @param lon in degrees (8.1234567°, not 81234567°)
+	 * @param x north
+	 * @param y east
+	 */
+	void project_double(double lat, double lon, double &x, double &y) const;
+
 	/**
 	 * Transform a point in the geographic coordinate system to the local
 	 * azimuthal equidistant plane using the projection
@@ -269,4 +460,91 @@ public:
 	 * @param lon in degrees (8.1234567°, not 81234567°)
 	 */
 	void reproject(float x, float y, double &lat, double &lon) const;
+
+	/**
+	 * Same as above with the local coordinates in double
+	 *
+	 * @param x north
+	 * @param y east
+	 * @param lat in degrees (47.1234567°, not 471234567°)
+	 * @param lon in degrees (8.1234567°, not 81234567°)
+	 */
+	void reproject_double(double x, double y, double &lat, double &lon) const;
+
+	/**
+	 * Transform n points in the geographic coordinate system to the local
+	 * azimuthal equidistant plane using the projection
+	 *
+	 * Same result as calling project() on every point (within 1e-6 m below 1000 km),
+	 * the trig goes through the branch free polynomials of geo_trig.h so the
+	 * loop is vectorized. The arrays are structure of arrays and must not alias
+	 * @param lat n latitudes in degrees
+	 * @param lon n longitudes in degrees
+	 * @param x n north coordinates
+	 * @param y n east coordinates
+	 */
+	void project_batch(const double *lat, const double *lon, float *x, float *y, size_t n) const;
+
+	/**
+	 * Transform n points in the local azimuthal equidistant plane to the
+	 * geographic coordinate system using the projection, see project_batch()
+	 *
+	 * @param x n north coordinates
+	 * @param y n east coordinates
+	 * @param lat n latitudes in degrees
+	 * @param lon n longitudes in degrees
+	 */
+	void reproject_batch(const float *x, const float *y, double *lat, double *lon, size_t n) const;
+};
+
+/**
+ * @brief Points at many distances along one great circle from a start position and bearing,
+ * same as waypoint_from_heading_and_distance with the trig of the start latitude and the
+ * bearing computed once
+ */
+class GeodesicRay final
+{
+private:
+	double _lat_start{0.0};
+	double _lon_start{0.0};
+	double _sin_lat{1.0};
+	double _cos_lat{0.0};
+	double _sin_bearing{0.0};
+	double _cos_bearing{1.0};
+
+public:
+	GeodesicRay() = default;
+
+	/**
+	 * @brief Construct and initialize a new Geodesic Ray object
+	 */
+	GeodesicRay(double lat_start, double lon_start, double bearing)
+	{
+		init(lat_start, lon_start, bearing);
+	}
+
+	/**
+	 * @param lat_start latitude of starting waypoint in degrees (47.1234567°, not 471234567°)
+	 * @param lon_start longitude of starting waypoint in degrees (8.1234567°, not 81234567°)
+	 * @param bearing in rad
+	 */
+	void init(double lat_start, double lon_start, double bearing);
+
+	/**
+	 * Point at a distance along the ray, one sincos and two atan2 instead of the
+	 * seven trig calls of waypoint_from_heading_and_distance
+	 * @param dist distance in meters (can be negative)
+	 * @param lat latitude of the point in degrees (47.1234567°, not 471234567°)
+	 * @param lon longitude of the point in degrees (8.1234567°, not 81234567°)
+	 */
+	void waypoint(double dist, double &lat, double &lon) const;
+
+	/**
+	 * Points at n distances along the ray, the trig goes through geo_trig.h so the loop is
+	 * vectorized. The arrays must not alias
+	 * @param dist n distances in meters
+	 * @param lat n latitudes in degrees
+	 * @param lon n longitudes in degrees
+	 */
+	void waypoint_batch(const double *dist, double *lat, double *lon, size_t n) const;
 };
@@ -0,0 +1,601 @@
+/*
+* geo_geodesic.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+/**
+ * @file geo_geodesic.h
+ *
+ * Geodesics on an ellipsoid of revolution for the ellipsoidal geo functions
+ *
+ * C. F. F. Karney, Algorithms for geodesics, J. Geodesy 87, 43-55 (2013), the same
+ * series as GeographicLib to sixth order in the third flattening n. The coefficients
+ * that only depend on n (A3, C3) are evaluated once in geodesic::init, a point only
+ * needs its reduced latitude (reduce), so a fixed reference is reduced once as well.
+ *
+ * Accurate to about 15 nm for WGS84. The inverse problem is the Newton iteration on
+ * the azimuth of the paper with its bisection safeguard, without the special start of
+ * nearly antipodal points (not needed for the distances the planner works with)
+ */
+
+#pragma once
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+namespace geo_geodesic
+{
+
+static constexpr int ORDER = 6;
+static constexpr double TINY = 1.4916681462400413e-154;	// sqrt(DBL_MIN)
+static constexpr double TOL0 = DBL_EPSILON;
+static constexpr double TOL2 = 1.4901161193847656e-08;		// sqrt(DBL_EPSILON)
+static constexpr double TOLB = TOL0 * TOL2;
+static constexpr int MAXIT1 = 20;
+static constexpr int MAXIT2 = MAXIT1 + DBL_MANT_DIG + 10;
+
+static inline void norm(double &s, double &c)
+{
+	const double r = hypot(s, c);
+	s /= r;
+	c /= r;
+}
+
+static inline double polyval(int order, const double *p, double x)
+{
+	double y = order < 0 ? 0 : *p++;
+
+	while (--order >= 0) { y = y * x + *p++; }
+
+	return y;
+}
+
+/**
+ * sum c[k] sin(2 k x) for k = 1..n by Clenshaw summation, c[0] is unused
+ */
+static inline double sin_series(double sinx, double cosx, const double *c, int n)
+{
+	c += (n + 1);
+	const double ar = 2 * (cosx - sinx) * (cosx + sinx);
+	double y0 = (n & 1) ? *--c : 0, y1 = 0;
+	n /= 2;
+
+	while (n--) {
+		y1 = ar * y0 - y1 + *--c;
+		y0 = ar * y1 - y0 + *--c;
+	}
+
+	return 2 * sinx * cosx * y0;
+}
+
+/**
+ * A1 - 1
+ */
+static inline double A1m1(double eps)
+{
+	const double eps2 = eps * eps;
+	const double t = eps2 * (eps2 * (eps2 + 4) + 64) / 256;
+	return (t + eps) / (1 - eps);
+}
+
+/**
+ * C1[1..6]
+ */
+static inline void C1(double eps, double c[ORDER + 1])
+{
+	const double eps2 = eps * eps;
+	double d = eps;
+	c[1] = d * ((6 - eps2) * eps2 - 16) / 32;
+	d *= eps;
+	c[2] = d * ((64 - 9 * eps2) * eps2 - 128) / 2048;
+	d *= eps;
+	c[3] = d * (9 * eps2 - 16) / 768;
+	d *= eps;
+	c[4] = d * (3 * eps2 - 5) / 512;
+	d *= eps;
+	c[5] = -7 * d / 1280;
+	d *= eps;
+	c[6] = -7 * d / 2048;
+}
+
+/**
+ * C1'[1..6], the reversion of the C1 series
+ */
+static inline void C1p(double eps, double c[ORDER + 1])
+{
+	const double eps2 = eps * eps;
+	double d = eps;
+	c[1] = d * (eps2 * (205 * eps2 - 432) + 768) / 1536;
+	d *= eps;
+	c[2] = d * (eps2 * (4005 * eps2 - 4736) + 3840) / 12288;
+	d *= eps;
+	c[3] = d * (116 - 225 * eps2) / 384;
+	d *= eps;
+	c[4] = d * (2695 - 7173 * eps2) / 7680;
+	d *= eps;
+	c[5] = 3467 * d / 7680;
+	d *= eps;
+	c[6] = 38081 * d / 61440;
+}
+
+/**
+ * A2 - 1
+ */
+static inline double A2m1(double eps)
+{
+	const double eps2 = eps * eps;
+	const double t = eps2 * (eps2 * (-11 * eps2 - 28) - 192) / 256;
+	return (t - eps) / (1 + eps);
+}
+
+/**
+ * C2[1..6]
+ */
+static inline void C2(double eps, double c[ORDER + 1])
+{
+	const double eps2 = eps * eps;
+	double d = eps;
+	c[1] = d * (eps2 * (eps2 + 2) + 16) / 32;
+	d *= eps;
+	c[2] = d * (eps2 * (35 * eps2 + 64) + 384) / 2048;
+	d *= eps;
+	c[3] = d * (15 * eps2 + 80) / 768;
+	d *= eps;
+	c[4] = d * (7 * eps2 + 35) / 512;
+	d *= eps;
+	c[5] = 63 * d / 1280;
+	d *= eps;
+	c[6] = 77 * d / 2048;
+}
+
+/**
+ * reduced latitude of a point
+ */
+struct point {
+	double sbet;
+	double cbet;
+	double dn;	// sqrt(1 + ep2 sin(beta)^2)
+};
+
+struct geodesic {
+	double a{0.0};
+	double f{0.0};
+	double f1{0.0};
+	double ep2{0.0};
+	double n{0.0};
+	double b{0.0};
+
+	// coefficients of eps^j of A3 and of C3[l], evaluated for n
+	double A3x[ORDER]{};
+	double C3x[ORDER][ORDER]{};
+
+	geodesic() = default;
+
+	geodesic(double a_, double f_)
+	{
+		init(a_, f_);
+	}
+
+	/**
+	 * @param a_ equatorial radius in meters
+	 * @param f_ flattening
+	 */
+	void init(double a_, double f_)
+	{
+		a = a_;
+		f = f_;
+		f1 = 1 - f;
+		const double e2 = f * (2 - f);
+		ep2 = e2 / (f1 * f1);
+		n = f / (2 - f);
+		b = a * f1;
+
+		// A3, polynomials in n of the coefficients of eps^0..5
+		static const double A3_coeff[] = {
+			1, 1,
+			1, -1, 2,
+			3, -1, -2, 8,
+			-1, -3, -1, 16,
+			-2, -3, 64,
+			-3, 128,
+		};
+		static const int A3_order[ORDER] = {0, 1, 2, 2, 1, 0};
+		const double *p = A3_coeff;
+
+		for (int j = 0; j < ORDER; j++) {
+			A3x[j] = polyval(A3_order[j], p, n) / p[A3_order[j] + 1];
+			p += A3_order[j] + 2;
+		}
+
+		// C3[l], polynomials in n of the coefficients of eps^l..5
+		static const double C3_coeff[] = {
+			-1, 1, 4,  -1, 0, 1, 8,  -1, 3, 3, 64,  2, 5, 128,  3, 128,
+			1, -3, 2, 32,  -3, -2, 3, 64,  1, 3, 128,  5, 256,
+			5, -9, 5, 192,  -10, 9, 384,  7, 512,
+			-14, 7, 512,  7, 512,
+			21, 2560,
+		};
+		static const int C3_order[ORDER - 1][ORDER - 1] = {
+			{1, 2, 2, 1, 0},
+			{2, 2, 1, 0, -1},
+			{2, 1, 0, -1, -1},
+			{1, 0, -1, -1, -1},
+			{0, -1, -1, -1, -1},
+		};
+		p = C3_coeff;
+
+		for (int l = 1; l < ORDER; l++) {
+			for (int j = l; j < ORDER; j++) {
+				const int order = C3_order[l - 1][j - l];
+				C3x[l][j] = polyval(order, p, n) / p[order + 1];
+				p += order + 2;
+			}
+		}
+	}
+
+	double A3(double eps) const
+	{
+		double y = 0;
+
+		for (int j = ORDER - 1; j >= 0; j--) { y = y * eps + A3x[j]; }
+
+		return y;
+	}
+
+	void C3(double eps, double c[ORDER]) const
+	{
+		for (int l = 1; l < ORDER; l++) {
+			double y = 0;
+
+			for (int j = ORDER - 1; j >= l; j--) { y = y * eps + C3x[l][j]; }
+
+			for (int j = 0; j < l; j++) { y *= eps; }
+
+			c[l] = y;
+		}
+	}
+
+	/**
+	 * @param lat latitude in degrees
+	 */
+	point reduce(double lat) const
+	{
+		const double phi = lat * (M_PI / 180.0);
+		point p;
+		p.sbet = f1 * sin(phi);
+		p.cbet = fabs(lat) == 90.0 ? 0.0 : cos(phi);
+		norm(p.sbet, p.cbet);
+		p.cbet = std::max(TINY, p.cbet);
+		p.dn = sqrt(1 + ep2 * p.sbet * p.sbet);
+		return p;
+	}
+
+	/**
+	 * distance s12b and reduced length m12b over b
+	 */
+	void lengths(double eps, double sig12, double ssig1, double csig1, double dn1,
+		     double ssig2, double csig2, double dn2, double &s12b, double &m12b) const
+	{
+		double Ca[ORDER + 1], Cb[ORDER + 1];
+		double A1 = A1m1(eps);
+		C1(eps, Ca);
+		double A2 = A2m1(eps);
+		C2(eps, Cb);
+		const double m0x = A1 - A2;
+		A1 = 1 + A1;
+		A2 = 1 + A2;
+
+		const double B1 = sin_series(ssig2, csig2, Ca, ORDER) - sin_series(ssig1, csig1, Ca, ORDER);
+		const double B2 = sin_series(ssig2, csig2, Cb, ORDER) - sin_series(ssig1, csig1, Cb, ORDER);
+		s12b = A1 * (sig12 + B1);
+		const double J12 = m0x * sig12 + (A1 * B1 - A2 * B2);
+		m12b = dn2 * (csig1 * ssig2) - dn1 * (ssig1 * csig2) - csig1 * csig2 * J12;
+	}
+
+	/**
+	 * longitude difference for a starting azimuth minus the one sought (slam120, clam120),
+	 * and its derivative with respect to the azimuth
+	 */
+	double lambda12(const point &p1, const point &p2, double salp1, double calp1,
+			double slam120, double clam120, double &salp2, double &calp2, double &sig12,
+			double &ssig1, double &csig1, double &ssig2, double &csig2, double &eps,
+			bool diffp, double &dlam12) const
+	{
+		const double sbet1 = p1.sbet, cbet1 = p1.cbet, sbet2 = p2.sbet, cbet2 = p2.cbet;
+
+		if (sbet1 == 0 && calp1 == 0) { calp1 = -TINY; }
+
+		const double salp0 = salp1 * cbet1;
+		const double calp0 = hypot(calp1, salp1 * sbet1);
+
+		ssig1 = sbet1;
+		const double somg1 = salp0 * sbet1;
+		csig1 = calp1 * cbet1;
+		const double comg1 = csig1;
+		norm(ssig1, csig1);
+
+		salp2 = cbet2 != cbet1 ? salp0 / cbet2 : salp1;
+		calp2 = cbet2 != cbet1 || fabs(sbet2) != -sbet1 ?
+			sqrt(calp1 * cbet1 * calp1 * cbet1 + (cbet1 < -sbet1 ? (cbet2 - cbet1) * (cbet1 + cbet2) :
+				(sbet1 - sbet2) * (sbet1 + sbet2))) / cbet2 : fabs(calp1);
+
+		ssig2 = sbet2;
+		const double somg2 = salp0 * sbet2;
+		csig2 = calp2 * cbet2;
+		const double comg2 = csig2;
+		norm(ssig2, csig2);
+
+		sig12 = atan2(std::max(0.0, csig1 * ssig2 - ssig1 * csig2), csig1 * csig2 + ssig1 * ssig2);
+		const double somg12 = std::max(0.0, comg1 * somg2 - somg1 * comg2);
+		const double comg12 = comg1 * comg2 + somg1 * somg2;
+		const double eta = atan2(somg12 * clam120 - comg12 * slam120, comg12 * clam120 + somg12 * slam120);
+
+		const double k2 = calp0 * calp0 * ep2;
+		eps = k2 / (2 * (1 + sqrt(1 + k2)) + k2);
+
+		double Ca[ORDER];
+		C3(eps, Ca);
+		const double B312 = sin_series(ssig2, csig2, Ca, ORDER - 1) - sin_series(ssig1, csig1, Ca, ORDER - 1);
+		const double domg12 = -f * A3(eps) * salp0 * (sig12 + B312);
+
+		if (diffp) {
+			if (calp2 == 0) {
+				dlam12 = -2 * f1 * p1.dn / sbet1;
+
+			} else {
+				double s12b;
+				lengths(eps, sig12, ssig1, csig1, p1.dn, ssig2, csig2, p2.dn, s12b, dlam12);
+				dlam12 *= f1 / (calp2 * cbet2);
+			}
+		}
+
+		return eta + domg12;
+	}
+
+	/**
+	 * Inverse problem, distance and azimuths between two points
+	 * @param q1 first point reduced by reduce()
+	 * @param q2 second point reduced by reduce()
+	 * @param lon12 longitude of the second point minus the first one in degrees, within [-180, 180]
+	 * @param s12 distance in meters
+	 * @param salp1 sin of the azimuth at the first point (clockwise from north)
+	 * @param calp1 cos of the azimuth at the first point
+	 * @param salp2 sin of the azimuth at the second point (forward)
+	 * @param calp2 cos of the azimuth at the second point
+	 */
+	void inverse(const point &q1, const point &q2, double lon12, double &s12,
+		     double &salp1, double &calp1, double &salp2, double &calp2) const
+	{
+		// canonical configuration, lon12 >= 0, |lat1| >= |lat2| and lat1 <= 0
+		double lonsign = lon12 >= 0 ? 1 : -1;
+		lon12 *= lonsign;
+
+		const double swapp = fabs(q1.sbet) < fabs(q2.sbet) ? -1 : 1;
+		lonsign *= swapp;
+		point p1 = swapp < 0 ? q2 : q1;
+		point p2 = swapp < 0 ? q1 : q2;
+		const double latsign = p1.sbet < 0 ? 1 : -1;
+		p1.sbet *= latsign;
+		p2.sbet *= latsign;
+
+		if (p1.cbet < -p1.sbet) {
+			if (p2.cbet == p1.cbet) { p2.sbet = copysign(p1.sbet, p2.sbet); }
+
+		} else {
+			if (fabs(p2.sbet) == -p1.sbet) { p2.cbet = p1.cbet; }
+		}
+
+		const double sbet1 = p1.sbet, cbet1 = p1.cbet, sbet2 = p2.sbet, cbet2 = p2.cbet;
+		const double lam12 = lon12 * (M_PI / 180.0);
+		const double slam12 = lon12 == 180.0 ? 0.0 : sin(lam12);
+		const double clam12 = cos(lam12);
+
+		double sig12, s12x = 0;
+		bool meridian = slam12 == 0 || sbet1 == -1;
+
+		if (meridian) {
+			// along a meridian, the azimuth is known
+			calp1 = clam12;
+			salp1 = slam12;
+			calp2 = 1;
+			salp2 = 0;
+
+			const double ssig1 = sbet1, csig1 = calp1 * cbet1;
+			const double ssig2 = sbet2, csig2 = calp2 * cbet2;
+			sig12 = atan2(std::max(0.0, csig1 * ssig2 - ssig1 * csig2), csig1 * csig2 + ssig1 * ssig2);
+
+			double m12x;
+			lengths(n, sig12, ssig1, csig1, p1.dn, ssig2, csig2, p2.dn, s12x, m12x);
+			s12x *= b;
+
+		} else if (sbet1 == 0 && lon12 <= f1 * 180.0) {
+			// along the equator
+			calp1 = calp2 = 0;
+			salp1 = salp2 = 1;
+			s12x = a * lam12;
+
+		} else {
+			// zeroth order spherical start, which is the solution of really short lines
+			double dnm = 1;
+			const double sbet12 = sbet2 * cbet1 - cbet2 * sbet1;
+			const double cbet12 = cbet2 * cbet1 + sbet2 * sbet1;
+			const double sbet12a = sbet2 * cbet1 + cbet2 * sbet1;
+			const bool shortline = cbet12 >= 0 && sbet12 < 0.5 && cbet2 * lam12 < 0.5;
+			double somg12 = slam12, comg12 = clam12;
+
+			if (shortline) {
+				double sbetm2 = (sbet1 + sbet2) * (sbet1 + sbet2);
+				sbetm2 /= sbetm2 + (cbet1 + cbet2) * (cbet1 + cbet2);
+				dnm = sqrt(1 + ep2 * sbetm2);
+				const double omg12 = lam12 / (f1 * dnm);
+				somg12 = sin(omg12);
+				comg12 = cos(omg12);
+			}
+
+			salp1 = cbet2 * somg12;
+			calp1 = comg12 >= 0 ? sbet12 + cbet2 * sbet1 * somg12 * somg12 / (1 + comg12) :
+				sbet12a - cbet2 * sbet1 * somg12 * somg12 / (1 - comg12);
+
+			const double ssig12 = hypot(salp1, calp1);
+			const double csig12 = sbet1 * sbet2 + cbet1 * cbet2 * comg12;
+			const double etol2 = 0.1 * TOL2 / sqrt(std::max(0.001, fabs(f)) * std::min(1.0, 1 - f / 2) / 2);
+
+			if (shortline && ssig12 < etol2) {
+				salp2 = cbet1 * somg12;
+				calp2 = sbet12 - cbet1 * sbet2 * (comg12 >= 0 ? somg12 * somg12 / (1 + comg12) : 1 - comg12);
+				norm(salp2, calp2);
+				sig12 = atan2(ssig12, csig12);
+				s12x = sig12 * b * dnm;
+				norm(salp1, calp1);
+
+			} else {
+				if (salp1 > 0) {
+					norm(salp1, calp1);
+
+				} else {
+					salp1 = 1;
+					calp1 = 0;
+				}
+
+				// Newton on the azimuth within a bracket, bisection when a step leaves it
+				double ssig1, csig1, ssig2, csig2, eps;
+				double salp1a = TINY, calp1a = 1, salp1b = TINY, calp1b = -1;
+				bool tripn = false, tripb = false;
+
+				for (int numit = 0;; numit++) {
+					double dv = 0;
+					const double v = lambda12(p1, p2, salp1, calp1, slam12, clam12, salp2, calp2, sig12,
+								  ssig1, csig1, ssig2, csig2, eps, numit < MAXIT1, dv);
+
+					if (tripb || !(fabs(v) >= (tripn ? 8 : 1) * TOL0) || numit == MAXIT2) {
+						break;
+					}
+
+					if (v > 0 && (numit > MAXIT1 || calp1 / salp1 > calp1b / salp1b)) {
+						salp1b = salp1;
+						calp1b = calp1;
+
+					} else if (v < 0 && (numit > MAXIT1 || calp1 / salp1 < calp1a / salp1a)) {
+						salp1a = salp1;
+						calp1a = calp1;
+					}
+
+					if (numit < MAXIT1 && dv > 0) {
+						const double dalp1 = -v / dv;
+
+						if (fabs(dalp1) < M_PI) {
+							const double sdalp1 = sin(dalp1), cdalp1 = cos(dalp1);
+							const double nsalp1 = salp1 * cdalp1 + calp1 * sdalp1;
+
+							if (nsalp1 > 0) {
+								calp1 = calp1 * cdalp1 - salp1 * sdalp1;
+								salp1 = nsalp1;
+								norm(salp1, calp1);
+								tripn = fabs(v) <= 16 * TOL0;
+								continue;
+							}
+						}
+					}
+
+					salp1 = (salp1a + salp1b) / 2;
+					calp1 = (calp1a + calp1b) / 2;
+					norm(salp1, calp1);
+					tripn = false;
+					tripb = fabs(salp1a - salp1) + (calp1a - calp1) < TOLB ||
+						fabs(salp1 - salp1b) + (calp1 - calp1b) < TOLB;
+				}
+
+				double m12x;
+				lengths(eps, sig12, ssig1, csig1, p1.dn, ssig2, csig2, p2.dn, s12x, m12x);
+				s12x *= b;
+			}
+		}
+
+		s12 = s12x;
+
+		// back from the canonical configuration
+		if (swapp < 0) {
+			std::swap(salp1, salp2);
+			std::swap(calp1, calp2);
+		}
+
+		salp1 *= swapp * lonsign;
+		calp1 *= swapp * latsign;
+		salp2 *= swapp * lonsign;
+		calp2 *= swapp * latsign;
+	}
+
+	/**
+	 * Direct problem, position at a distance along an azimuth
+	 * @param p1 starting point reduced by reduce()
+	 * @param salp1 sin of the azimuth at the starting point (clockwise from north)
+	 * @param calp1 cos of the azimuth at the starting point
+	 * @param s12 distance in meters
+	 * @param lat2 latitude of the end point in degrees
+	 * @param lon12 longitude of the end point minus the starting one in degrees
+	 */
+	void direct(const point &p1, double salp1, double calp1, double s12, double &lat2, double &lon12) const
+	{
+		const double sbet1 = p1.sbet, cbet1 = p1.cbet;
+		const double salp0 = salp1 * cbet1;
+		const double calp0 = hypot(calp1, salp1 * sbet1);
+
+		double ssig1 = sbet1;
+		const double somg1 = salp0 * sbet1;
+		double csig1 = sbet1 != 0 || calp1 != 0 ? cbet1 * calp1 : 1;
+		const double comg1 = csig1;
+		norm(ssig1, csig1);
+
+		const double k2 = calp0 * calp0 * ep2;
+		const double eps = k2 / (2 * (1 + sqrt(1 + k2)) + k2);
+
+		double C1a[ORDER + 1], C1pa[ORDER + 1], C3a[ORDER];
+		const double A1 = 1 + A1m1(eps);
+		C1(eps, C1a);
+		C1p(eps, C1pa);
+		C3(eps, C3a);
+
+		const double B11 = sin_series(ssig1, csig1, C1a, ORDER);
+		const double s = sin(B11), c = cos(B11);
+		const double stau1 = ssig1 * c + csig1 * s;
+		const double ctau1 = csig1 * c - ssig1 * s;
+
+		// distance to arc length on the auxiliary sphere
+		const double tau12 = s12 / (b * A1);
+		const double stau12 = sin(tau12), ctau12 = cos(tau12);
+		const double B12 = -sin_series(stau1 * ctau12 + ctau1 * stau12, ctau1 * ctau12 - stau1 * stau12, C1pa, ORDER);
+		const double sig12 = tau12 - (B12 - B11);
+		const double ssig12 = sin(sig12), csig12 = cos(sig12);
+
+		const double ssig2 = ssig1 * csig12 + csig1 * ssig12;
+		double csig2 = csig1 * csig12 - ssig1 * ssig12;
+		const double sbet2 = calp0 * ssig2;
+		double cbet2 = hypot(salp0, calp0 * csig2);
+
+		if (cbet2 == 0) { cbet2 = csig2 = TINY; }
+
+		const double somg2 = salp0 * ssig2, comg2 = csig2;
+		const double omg12 = atan2(somg2 * comg1 - comg2 * somg1, comg2 * comg1 + somg2 * somg1);
+		const double B31 = sin_series(ssig1, csig1, C3a, ORDER - 1);
+		const double lam12 = omg12 - f * salp0 * A3(eps) * (sig12 + (sin_series(ssig2, csig2, C3a, ORDER - 1) - B31));
+
+		lat2 = atan2(sbet2, f1 * cbet2) * (180.0 / M_PI);
+		lon12 = lam12 * (180.0 / M_PI);
+	}
+};
+
+} // namespace geo_geodesic
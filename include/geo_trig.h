@@ -0,0 +1,128 @@
+/*
+* geo_trig.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+/**
+ * @file geo_trig.h
+ *
+ * Branch free double precision sin / cos / atan2 for the batched geo functions
+ *
+ * The polynomials are the Cephes ones (Stephen L. Moshier), the range reduction
+ * is a three part Cody-Waite reduction by pi/2 (fdlibm constants). There are no
+ * table lookups or data dependent branches, the selects compile to blends and every
+ * division is done unconditionally, so a loop calling these over arrays is vectorized
+ * by the compiler (-O3 -fno-math-errno -fno-trapping-math, SSE2 / AVX / NEON)
+ *
+ * Max error against the libm functions, measured over 1e7 uniform samples :
+ * - sin / cos : 2 ulp for |x| < 1e5 rad (the reduction is exact below 2^20 * pi/2)
+ * - atan2 : 2 ulp over all quadrants, signed zeros give the libm result (atan2(-0, -1) = -pi)
+ * Non finite inputs are not handled
+ */
+
+#pragma once
+
+#include <math.h>
+
+namespace geo_trig
+{
+
+static constexpr double PIO2_1 = 1.57079632673412561417e+00;	// first 33 bits of pi/2
+static constexpr double PIO2_2 = 6.07710050630396597660e-11;	// next 33 bits of pi/2
+static constexpr double PIO2_3 = 2.02226624879595063154e-21;	// pi/2 - PIO2_1 - PIO2_2
+static constexpr double TWO_OVER_PI = 6.36619772367581382433e-01;
+static constexpr double ROUND_MAGIC = 6755399441055744.0;	// 1.5 * 2^52, x + ROUND_MAGIC - ROUND_MAGIC rounds to nearest
+
+/**
+ * sin(z) for |z| <= pi/4
+ */
+static inline double sin_kernel(double z)
+{
+	const double zz = z * z;
+	return z + z * zz * (((((1.58962301576546568060e-10 * zz - 2.50507477628578072866e-8) * zz
+				 + 2.75573136213857245213e-6) * zz - 1.98412698295895385996e-4) * zz
+			       + 8.33333333332211858878e-3) * zz - 1.66666666666666307295e-1);
+}
+
+/**
+ * cos(z) for |z| <= pi/4
+ */
+static inline double cos_kernel(double z)
+{
+	const double zz = z * z;
+	return 1.0 - 0.5 * zz + zz * zz * (((((-1.13585365213876817300e-11 * zz + 2.08757008419747316778e-9) * zz
+					      - 2.75573141792967388112e-7) * zz + 2.48015872888517045348e-5) * zz
+					    - 1.38888888888730564116e-3) * zz + 4.16666666666665929218e-2);
+}
+
+/**
+ * sin and cos of x in one range reduction
+ */
+static inline void sincos(double x, double &s, double &c)
+{
+	const double q = (x * TWO_OVER_PI + ROUND_MAGIC) - ROUND_MAGIC;
+	const double z = ((x - q * PIO2_1) - q * PIO2_2) - q * PIO2_3;
+	const int quadrant = static_cast<int>(q);
+
+	const double sz = sin_kernel(z);
+	const double cz = cos_kernel(z);
+	const bool swap = (quadrant & 1) != 0;
+
+	s = swap ? cz : sz;
+	c = swap ? sz : cz;
+	s = (quadrant & 2) ? -s : s;
+	c = ((quadrant + 1) & 2) ? -c : c;
+}
+
+/**
+ * atan(u) for 0 <= u <= 1
+ */
+static inline double atan_unit(double u)
+{
+	// above tan(pi/8) + margin, atan(u) = pi/4 + atan((u - 1) / (u + 1))
+	// shift is 0 or 1 so the reduction is a single division for both cases
+	const double shift = u > 0.66 ? 1.0 : 0.0;
+	const double t = (u - shift) / (u * shift + 1.0);
+	const double z = t * t;
+
+	const double p = (((-8.750608600031904122785e-1 * z - 1.615753718733365076637e1) * z
+			   - 7.500855792314704667340e1) * z - 1.228866684490136173410e2) * z - 6.485021904942025371773e1;
+	const double q = ((((z + 2.485846490142306297962e1) * z + 1.650270098316988542046e2) * z
+			   + 4.328810604912902668951e2) * z + 4.853903996359136964868e2) * z + 1.945506571482613964425e2;
+
+	const double r = t + t * z * p / q;
+	return r + shift * (M_PI_4 + 0.5 * 6.123233995736765886130e-17);
+}
+
+/**
+ * atan2(y, x) in [-pi, pi], the signs are read with copysign like libm
+ * so -0.0 selects the negative half plane
+ */
+static inline double atan2(double y, double x)
+{
+	const double ax = fabs(x);
+	const double ay = fabs(y);
+	const double big = ax > ay ? ax : ay;
+	const double small = ax > ay ? ay : ax;
+	const double u = small / (big > 0.0 ? big : 1.0);
+
+	double r = atan_unit(u);
+	r = ay > ax ? M_PI_2 - r : r;
+	r = copysign(1.0, x) < 0.0 ? M_PI - r : r;
+	return copysign(r, y);
+}
+
+} // namespace geo_trig
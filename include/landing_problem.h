@@ -0,0 +1,553 @@
+/*
+* landing_problem.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Precision landing problem setup (OBVP guess + fpgm_collocation) shared by the executables
+
+#ifndef LANDING_PROBLEM_H
+#define LANDING_PROBLEM_H
+
+#include <math.h>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include "obvp.h"
+#include "fpgm_collocation.h"
+#include "fpgm_sqp.h"
+#include "fpgm_ilqr.h"
+
+// https://stackoverflow.com/questions/5693686/how-to-use-yaml-cpp-in-a-c-program-on-linux
+#include "yaml-cpp/yaml.h"
+
+namespace fpgm_collocation
+{
+    class landing_problem
+    {
+        public:
+
+            struct landing_settings
+            {
+                // ENU frame according to Lat Lon and height
+                double landing_lat;
+                double landing_lon;
+
+                double airspeed; // m/s
+                double descend_bearing_deg; // bearing in deg
+                double descend_pitch_deg; // angle in deg
+                double buffer_distance;
+
+                double height_of_descend; // m
+                double height_of_land; // If there is a structure for the aircraft to land on
+
+                double max_elevator;
+                double current_elevator_rad;
+                double current_thetadot;
+
+                double command_time;
+
+                // [x, z, theta, phi, vx, vz, thetadot] and phidot
+                Eigen::Matrix<double, 7, 1> weights;
+                double weight_on_phidot;
+
+                // cobyla, slsqp, sqp or ilqr
+                std::string solver;
+
+                mesh_options mesh;
+
+                // knots of the last touchdown_refine_time seconds split touchdown_refine_factor times
+                double touchdown_refine_time;
+                int touchdown_refine_factor;
+            };
+
+            bool verbose = true;
+
+            /** @brief read the landing settings from parameters.yaml **/
+            static bool load_settings(std::string directory, landing_settings &settings)
+            {
+                ifstream f(directory.c_str());
+                if (!f.good())
+                    return false;
+
+                YAML::Node node = YAML::LoadFile(directory);
+                load_settings(node, settings);
+                return true;
+            }
+
+            /** @brief read the landing settings from an already loaded parameters.yaml **/
+            static void load_settings(const YAML::Node &node, landing_settings &settings)
+            {
+                settings.landing_lat = 1.330587;
+                settings.landing_lon = 103.783740;
+
+                settings.airspeed = node["airspeed"].as<double>();
+                settings.descend_bearing_deg = node["descend_bearing_deg"].as<double>();
+                settings.descend_pitch_deg = node["descend_pitch_deg"].as<double>();
+                settings.buffer_distance = node["buffer_distance"].as<double>();
+
+                settings.height_of_descend = node["height_of_descend"].as<double>();
+                settings.height_of_land = node["height_of_land"].as<double>();
+
+                // according to Robust Post-Stall Perching with a Fixed-Wing UAV by Joseph Moore page 28
+                // elevator moving upwards is considered negative
+                settings.max_elevator = node["phi_contrain"].as<double>();
+                settings.current_elevator_rad = node["current_elevator_rad"].as<double>();
+                settings.current_thetadot = node["current_thetadot"].as<double>();
+
+                settings.command_time = node["command_time"].as<double>();
+
+                settings.weights <<
+                    node["weight_on_x"].as<double>(),
+                    node["weight_on_z"].as<double>(),
+                    node["weight_on_theta"].as<double>(),
+                    node["weight_on_phi"].as<double>(),
+                    node["weight_on_vx"].as<double>(),
+                    node["weight_on_vz"].as<double>(),
+                    node["weight_on_thetadot"].as<double>();
+                settings.weight_on_phidot = node["weight_on_phidot"].as<double>();
+
+                settings.solver = node["solver"] ? node["solver"].as<std::string>() : "cobyla";
+
+                settings.mesh = mesh_options();
+                if (node["mesh_tolerance"])
+                    settings.mesh.tolerance = node["mesh_tolerance"].as<double>();
+                if (node["mesh_max_passes"])
+                    settings.mesh.max_passes = node["mesh_max_passes"].as<int>();
+                if (node["mesh_max_knots"])
+                    settings.mesh.max_knots = node["mesh_max_knots"].as<int>();
+
+                settings.touchdown_refine_time = node["touchdown_refine_time"] ?
+                    node["touchdown_refine_time"].as<double>() : 0.0;
+                settings.touchdown_refine_factor = node["touchdown_refine_factor"] ?
+                    node["touchdown_refine_factor"].as<int>() : 1;
+            }
+
+            // Don't comprehend this
+            // since it is in ENU frame, hence it is pry not rpy
+            static matrix::Vector3d velocity_in_global_frame(double y, double r, double p, double vel)
+            {
+                // in the enu frame, x would be the velocity
+                matrix::Vector3d relative_vel = matrix::Vector3d(vel, 0, 0);
+                double yaw[9] = {
+                        1.0,  0.0,  0.0,
+                        0.0,  cos(y),  -sin(y),
+                        0.0,  sin(y),  cos(y)
+                    };
+                double roll[9] = {
+                        cos(r),  0.0,  sin(r),
+                        0.0,  1.0,  0.0,
+                        -sin(r),  0.0,  cos(r)
+                    };
+
+                double pitch[9] = {
+                        cos(p),  -sin(p), 0.0,
+                        sin(p),  cos(p), 0.0,
+                        0.0,  0.0,  1.0
+                    };
+                matrix::SquareMatrix<double, 3> P(pitch);
+                matrix::SquareMatrix<double, 3> R(roll);
+                matrix::SquareMatrix<double, 3> Y(yaw);
+                return (P * R * Y) * relative_vel;
+            }
+
+            /** @brief OBVP guess for the collocation and loading of fpgm_collocation
+             * @param directory parameters.yaml used for the glider parameters and constrains
+             * @param control_guess guess in control states format (for visualization)
+             * **/
+            bool setup(
+                const landing_settings &settings, std::string directory,
+                fpgm_collocation &fpgm, fpgm_collocation::control_state &control_guess)
+            {
+                ifstream f(directory.c_str());
+                if (!f.good())
+                    return false;
+
+                return setup(settings, YAML::LoadFile(directory), fpgm, control_guess);
+            }
+
+            /** @brief same as above with parameters.yaml already loaded (or modified) **/
+            bool setup(
+                const landing_settings &settings, const YAML::Node &node,
+                fpgm_collocation &fpgm, fpgm_collocation::control_state &control_guess)
+            {
+                const double deg_to_rad = 1/180.0 * 3.14159265358979323846264338327;
+                const matrix::Vector3d zero = matrix::Vector3d{0, 0, 0};
+
+                MapProjection _global_local_proj_ref{};
+
+                // Setting the reference of the map with the current position
+                _global_local_proj_ref.initReference(settings.landing_lat, settings.landing_lon);
+
+                double descend_bearing_rad = settings.descend_bearing_deg * deg_to_rad;
+                double descend_pitch_rad = settings.descend_pitch_deg * deg_to_rad;
+                double max_elevator_rad = settings.max_elevator * deg_to_rad;
+                double command_time = settings.command_time;
+
+                // Calculate the descend distance
+                double distance_to_land_from_dive =
+                    (settings.height_of_descend - settings.height_of_land) / tan(descend_pitch_rad) +
+                    settings.buffer_distance;
+                if (verbose)
+                    printf("distance_to_land_from_dive = %lf\n", distance_to_land_from_dive);
+
+                matrix::Vector3d dive_position;
+                matrix::Vector3d landing_position = matrix::Vector3d(
+                    settings.landing_lat, settings.landing_lon, settings.height_of_land);
+                dive_position(2) = settings.height_of_descend;
+
+                double descend_bearing_backwards = wrap_pi(descend_bearing_rad-3.14);
+                waypoint_from_heading_and_distance_double(
+                    settings.landing_lat, settings.landing_lon, descend_bearing_backwards,
+                    distance_to_land_from_dive, &dive_position(0), &dive_position(1));
+
+                matrix::Vector3d velocity_global =
+                    velocity_in_global_frame(
+                    0.0, descend_pitch_rad, descend_bearing_rad, settings.airspeed);
+
+                matrix::Vector3d dive_position_local;
+                matrix::Vector3d landing_position_local =
+                    matrix::Vector3d(0, 0, landing_position(2));
+                if (_global_local_proj_ref.isInitialized())
+                {
+                    _global_local_proj_ref.project_double(dive_position(0), dive_position(1),
+                        dive_position_local(0), dive_position_local(1));
+                    dive_position_local(2) = dive_position(2);
+                }
+
+                if (verbose)
+                {
+                    printf("dive_position [%lf %lf %lf] dive_position_local [%lf %lf %lf]\n",
+                        dive_position(0), dive_position(1), dive_position(2),
+                        dive_position_local(0), dive_position_local(1), dive_position_local(2));
+                    printf("landing_position [%lf %lf %lf] landing_position_local [%lf %lf %lf]\n",
+                        landing_position(0), landing_position(1), landing_position(2),
+                        landing_position_local(0), landing_position_local(1), landing_position_local(2));
+                    printf("velocity [%lf %lf %lf]\n", velocity_global(0), velocity_global(1), velocity_global(2));
+                }
+
+                /**
+                 * @brief require estimates for x(state) = [x, z, theta, phi, xdot, zdot, thetadot]
+                 * @arg x, z, xdot, zdot can be taken care of by the bvp solution
+                 * @arg thetadot can be taken care of, and we assume it to be constant linear interpolation from <current point> to 0
+                 * @arg phi can be taken care of, and we assume it to be constant linear interpolation from <current point> to max_phi
+                 * @arg theta can be assumed with differentially flat outputs from the bvp
+                 */
+
+                /** @brief Boundary value problem provides x, z, xdot, zdot estimates */
+                matrix::Vector3d alpha, beta, gamma;
+
+                matrix::SquareMatrix<double, 3> initial_state_local;
+                initial_state_local.setZero();
+
+                initial_state_local.col(0) = dive_position_local; // Position
+                initial_state_local.col(1) = velocity_global; // Velocity
+                initial_state_local.col(2) = zero; // Acceleration
+
+                matrix::SquareMatrix<double, 3> final_state_local;
+                final_state_local.setZero();
+
+                final_state_local.col(0) = landing_position_local; // Position
+                final_state_local.col(1) = zero; // Velocity
+                final_state_local.col(2) = zero; // Acceleration
+
+                // Make a guess to reach the final goal point
+                // distance / sqrt(vx^2 + vy^2) * factor
+                double guess_factor = 3.0;
+                double stepping_factor = 1.0/10.0;
+
+                // make sure total time is a factor of command time
+                double total_time_division =
+                    round(distance_to_land_from_dive /
+                    sqrt(pow(velocity_global(0),2) + pow(velocity_global(1),2)) /
+                    command_time);
+
+                double total_time = total_time_division * command_time * guess_factor;
+                // BVP guessing step (to reduce by)
+                double step = command_time * guess_factor;
+                bool check_passed = false;
+                px4_array_container waypoints;
+
+                while (!check_passed)
+                {
+                    obvp::get_bvp_coefficients(initial_state_local, final_state_local, total_time,
+                        &alpha, &beta, &gamma);
+
+                    int bad_counts = obvp::check_z_vel(
+                        initial_state_local, final_state_local, total_time, command_time,
+                        alpha, beta, gamma);
+
+                    if (bad_counts == 0)
+                        check_passed = true;
+                    else
+                        total_time -= (double)bad_counts * stepping_factor * step;
+
+                    if (total_time <= command_time)
+                        return false;
+                }
+
+                int waypoint_size = 0;
+                waypoints = obvp::get_discrete_points(
+                    initial_state_local, final_state_local, total_time, command_time,
+                    alpha, beta, gamma, waypoint_size);
+                // px4_array_container holds at most 100 waypoints
+                waypoint_size = std::min(waypoint_size, (int)waypoints.size());
+                if (waypoint_size < 2)
+                    return false;
+
+                /** @brief theta estimates */
+                vector<double> theta_vector, phi_vector, thetadot_vector; // pitch
+                // phi should become more negative according to the coordinates
+                double phi_factor = - max_elevator_rad / (double)(waypoint_size-1);
+                double theta_factor = (2 * descend_pitch_rad) / (double)(waypoint_size-1);
+
+                double trim = - descend_pitch_rad;
+                for (int i = 0; i < waypoint_size; i++)
+                {
+                    theta_vector.push_back(trim + theta_factor * i);
+                    phi_vector.push_back(settings.current_elevator_rad - phi_factor*i);
+                    thetadot_vector.push_back(settings.current_thetadot);
+                }
+
+                /** @brief do a transformation to orientate waypoints to align with x axis */
+                std::vector<matrix::Vector2d> vector_t_waypoints, vector_t_velocity;
+                double yaw[4] = {
+                    cos(descend_bearing_backwards),  -sin(descend_bearing_backwards),
+                    sin(descend_bearing_backwards),  cos(descend_bearing_backwards)
+                };
+                matrix::SquareMatrix<double, 2> Y(yaw);
+                for (int i = 0; i < waypoint_size; i++)
+                {
+                    matrix::Vector2d t_waypoints = Y.I() *
+                        matrix::Vector2d(waypoints[i](0), waypoints[i](1));
+                    matrix::Vector2d t_velocity = Y.I() *
+                        matrix::Vector2d(waypoints[i](3), waypoints[i](4));
+
+                    vector_t_waypoints.push_back(t_waypoints);
+                    vector_t_velocity.push_back(t_velocity);
+                    if (verbose)
+                        printf("pos [%lf %lf] vel [%lf %lf] theta [%lf] phi [%lf]\n",
+                            t_waypoints(0), waypoints[i](2),
+                            t_velocity(0), waypoints[i](5),
+                            theta_vector[i], phi_vector[i]);
+                }
+
+                std::vector<double> initial_guess;
+                std::vector<double> initial_x, initial_z;
+                control_guess = fpgm_collocation::control_state();
+                for (int i = 0; i < waypoint_size; i++)
+                {
+                    // x = [x, z, theta, phi, xdot, zdot, thetadot]
+                    // u = [phidot]
+                    initial_guess.push_back(vector_t_waypoints[i](0));
+                    control_guess.x.push_back(vector_t_waypoints[i](0));
+
+                    initial_guess.push_back(waypoints[i](2));
+                    control_guess.z.push_back(waypoints[i](2));
+
+                    initial_guess.push_back(theta_vector[i]);
+                    control_guess.theta.push_back(theta_vector[i]);
+
+                    initial_guess.push_back(phi_vector[i]);
+                    control_guess.phi.push_back(phi_vector[i]);
+
+                    initial_guess.push_back(vector_t_velocity[i](0));
+                    control_guess.vx.push_back(vector_t_velocity[i](0));
+
+                    initial_guess.push_back(waypoints[i](5));
+                    control_guess.vz.push_back(waypoints[i](5));
+
+                    initial_guess.push_back(thetadot_vector[i]);
+                    control_guess.thetadot.push_back(thetadot_vector[i]);
+                    initial_guess.push_back(0.0);
+                    control_guess.phidot.push_back(0.0);
+
+                    initial_x.push_back(vector_t_waypoints[i](0));
+                    initial_z.push_back(waypoints[i](2));
+                }
+
+                Eigen::Matrix< double, 7, 7> Q = settings.weights.asDiagonal();
+                double R = settings.weight_on_phidot;
+
+                if (!fpgm.load_parameters(
+                    node, total_time,
+                    waypoint_size, Q, R,
+                    initial_x, initial_z))
+                    return false;
+
+                if (!fpgm.load_initial_guess(initial_guess))
+                    return false;
+
+                // finer intervals for the flare, the guess is interpolated onto the new knots
+                if (settings.touchdown_refine_time > 0 && settings.touchdown_refine_factor > 1)
+                {
+                    const equations_and_helper::fpgm_param &param = fpgm.get_parameters();
+                    double end = param.time(waypoint_size - 1);
+                    std::vector<int> split(waypoint_size - 1, 1);
+                    for (int k = 0; k < waypoint_size - 1; k++)
+                        if (param.time(k + 1) > end - settings.touchdown_refine_time)
+                            split[k] = settings.touchdown_refine_factor;
+                    if (!fpgm.remesh(control_guess, fpgm_collocation::split_intervals(param, split)))
+                        return false;
+                }
+                return true;
+            }
+
+            /** @brief write the guess and the optimized trajectory for offline plotting
+             * csv with one row per knot, series is guess or optimal, t is left empty on a uniform grid
+             * **/
+            static bool write_trajectory(
+                std::string path,
+                const fpgm_collocation::control_state &control_guess,
+                const fpgm_collocation::control_state &control_opt)
+            {
+                FILE *file = fopen(path.c_str(), "w");
+                if (!file)
+                    return false;
+
+                fprintf(file, "series,k,t,x,z,theta,phi,vx,vz,thetadot,phidot\n");
+                const fpgm_collocation::control_state *series[2] = {&control_guess, &control_opt};
+                const char *names[2] = {"guess", "optimal"};
+                for (int s = 0; s < 2; s++)
+                {
+                    const fpgm_collocation::control_state &c = *series[s];
+                    for (size_t i = 0; i < c.x.size(); i++)
+                    {
+                        // knot times only exist on a non-uniform grid
+                        char t[32] = "";
+                        if (i < c.t.size())
+                            snprintf(t, sizeof(t), "%.6g", c.t[i]);
+                        fprintf(file, "%s,%zu,%s,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n",
+                            names[s], i, t, c.x[i], c.z[i], c.theta[i], c.phi[i],
+                            c.vx[i], c.vz[i], c.thetadot[i], c.phidot[i]);
+                    }
+                }
+                return fclose(file) == 0;
+            }
+
+            /** @brief run the selected solver backend on a loaded fpgm_collocation
+             * @param solver cobyla, slsqp, sqp or ilqr
+             * **/
+            static fpgm_collocation::control_state solve(
+                fpgm_collocation &fpgm, std::string solver,
+                fpgm_collocation::solve_report &report)
+            {
+                fpgm_collocation::control_state control_opt;
+                if (solver == "sqp")
+                {
+                    fpgm_sqp sqp(fpgm.get_parameters(), fpgm.get_boundary());
+                    control_opt = sqp.solve(fpgm.get_initial_guess());
+                    report = sqp.get_report();
+                }
+                else if (solver == "ilqr")
+                {
+                    fpgm_ilqr ilqr(fpgm.get_parameters(), fpgm.get_boundary());
+                    control_opt = ilqr.solve(fpgm.get_initial_guess());
+                    report = ilqr.get_report();
+                }
+                else if (solver == "slsqp")
+                {
+                    control_opt = fpgm.nlopt_optimization(NLOPT_LD_SLSQP);
+                    report = fpgm.get_last_report();
+                }
+                else
+                {
+                    control_opt = fpgm.nlopt_optimization(NLOPT_LN_COBYLA);
+                    report = fpgm.get_last_report();
+                }
+                return control_opt;
+            }
+
+            /** @brief solve, then refine the mesh until every interval is within mesh.tolerance
+             * each pass integrates fpgm_dynamics over the intervals of the solution,
+             * splits only the intervals above the tolerance by the factor they need (trapezoidal
+             * local error ~ h^3, worst first within mesh.max_knots) and re-solves from the
+             * interpolated solution
+             * report.solve_time and iterations add up over the passes
+             * **/
+            static fpgm_collocation::control_state solve(
+                fpgm_collocation &fpgm, std::string solver, const mesh_options &mesh,
+                fpgm_collocation::solve_report &report)
+            {
+                fpgm_collocation::control_state control_opt = solve(fpgm, solver, report);
+                if (mesh.tolerance <= 0)
+                    return control_opt;
+
+                double solve_time = report.solve_time;
+                int iterations = report.iterations;
+                for (int pass = 0; pass < mesh.max_passes && !control_opt.x.empty(); pass++)
+                {
+                    int N = (int)control_opt.x.size();
+                    std::vector<double> x(8 * N);
+                    for (int i = 0; i < N; i++)
+                    {
+                        x[0+8*i] = control_opt.x[i]; x[1+8*i] = control_opt.z[i];
+                        x[2+8*i] = control_opt.theta[i]; x[3+8*i] = control_opt.phi[i];
+                        x[4+8*i] = control_opt.vx[i]; x[5+8*i] = control_opt.vz[i];
+                        x[6+8*i] = control_opt.thetadot[i]; x[7+8*i] = control_opt.phidot[i];
+                    }
+                    std::vector<double> error = fpgm_collocation::interval_error(
+                        x.data(), N, fpgm.get_parameters(), mesh.substeps);
+                    double worst = *std::max_element(error.begin(), error.end());
+                    if (worst <= mesh.tolerance)
+                        break;
+
+                    std::vector<int> order(error.size());
+                    for (size_t k = 0; k < order.size(); k++)
+                        order[k] = (int)k;
+                    std::sort(order.begin(), order.end(),
+                        [&error](int a, int b) { return error[a] > error[b]; });
+
+                    std::vector<int> split(error.size(), 1);
+                    int size = N;
+                    for (int k : order)
+                    {
+                        if (error[k] <= mesh.tolerance)
+                            break;
+                        int m = (int)ceil(pow(error[k] / mesh.tolerance, 1.0/3.0));
+                        m = std::min(m, 1 + mesh.max_knots - size);
+                        if (m < 2)
+                            break;
+                        split[k] = m;
+                        size += m - 1;
+                    }
+                    if (size <= N)
+                        break;
+                    if (fpgm.get_verbose())
+                        printf("mesh pass %d : max interval error %.3e, %d -> %d knots\n",
+                            pass, worst, N, size);
+
+                    fpgm_collocation::solve_report pass_report;
+                    if (!fpgm.remesh(control_opt,
+                        fpgm_collocation::split_intervals(fpgm.get_parameters(), split)))
+                        break;
+                    fpgm_collocation::control_state refined = solve(fpgm, solver, pass_report);
+                    solve_time += pass_report.solve_time;
+                    iterations += pass_report.iterations;
+                    if (refined.x.empty())
+                        break;
+                    control_opt = refined;
+                    report = pass_report;
+                }
+                report.solve_time = solve_time;
+                report.iterations = iterations;
+                return control_opt;
+            }
+    };
+}
+
+#endif
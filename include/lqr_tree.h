@@ -0,0 +1,333 @@
+/*
+* lqr_tree.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Library of TVLQR stabilized trajectories with sampled funnels (LQR-trees)
+
+#ifndef LQR_TREE_H
+#define LQR_TREE_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <limits>
+
+#include "fpgm_collocation.h"
+#include "fpgm_tvlqr.h"
+#include "Eigen/Dense"
+
+namespace fpgm_collocation
+{
+    struct funnel_options
+    {
+        int samples = 200;
+        // largest sublevel set V(x) = dx' S(0) dx that is tried
+        double rho_max = 10.0;
+        // goal region dx' S(T) dx <= goal_rho at the end of the trajectory
+        double goal_rho = 1.0;
+        // closed loop simulation step
+        double dt = 0.002;
+        unsigned int seed = 0;
+    };
+
+    /** @brief LQR-tree, a library of nominal trajectories each with a TVLQR gain schedule
+     * and an entry funnel {x : (x - x_nom(0))' S(0) (x - x_nom(0)) <= rho}
+     * reference : Robust Post-Stall Perching with a Fixed-Wing UAV by Joseph Moore (chapter 5)
+     *
+     * - rho is estimated by simulation : initial states are sampled inside the rho_max
+     * ellipsoid, the closed loop (phidot saturated at pd_c) is rolled out with rk4 and
+     * rho shrinks below every sample that misses the goal region
+     * - lookup() only checks the entry funnels, which are kept in contiguous arrays
+     *
+     * File layout (little endian, save / load refuse to run on a big endian host)
+     * header : char[4] "LQRT", uint32 version, uint32 node count, uint32 record size
+     * node : uint32 sample count, uint32 reserved, double t0, dt, rho,
+     * double S(0) upper triangle [28], double records [count * record size]
+    **/
+    class lqr_tree
+    {
+        public:
+
+            struct node
+            {
+                gain_schedule schedule;
+                double rho;
+            };
+
+            static const uint32_t file_version = 1;
+
+            const std::vector<node> &get_nodes() const { return nodes; }
+            size_t size() const { return nodes.size(); }
+
+            void clear()
+            {
+                nodes.clear();
+                entry_state.clear();
+                entry_S.clear();
+                entry_rho.clear();
+            }
+
+            void add(const gain_schedule &schedule, double rho)
+            {
+                node n;
+                n.schedule = schedule;
+                n.rho = rho;
+                nodes.push_back(n);
+                add_entry(nodes.back());
+            }
+
+            /** @brief funnel containing the state with the smallest V / rho
+             * @param state = [x, z, theta, phi, xdot, zdot, thetadot]
+             * @return node index, -1 if no funnel covers the state
+             * **/
+            int lookup(const double *state, double *level = nullptr) const
+            {
+                int best = -1;
+                double best_level = 1.0;
+                for (size_t i = 0; i < entry_rho.size(); i++)
+                {
+                    const double *x0 = entry_state.data() + 7 * i;
+                    const double *S = entry_S.data() + 49 * i;
+                    double d[7];
+                    for (int j = 0; j < 7; j++)
+                        d[j] = state[j] - x0[j];
+
+                    double v = 0.0;
+                    for (int r = 0; r < 7; r++)
+                    {
+                        double row = 0.0;
+                        for (int c = 0; c < 7; c++)
+                            row += S[r*7 + c] * d[c];
+                        v += d[r] * row;
+                    }
+
+                    double normalized = v / entry_rho[i];
+                    if (normalized <= best_level)
+                    {
+                        best_level = normalized;
+                        best = (int)i;
+                    }
+                }
+                if (level)
+                    *level = best_level;
+                return best;
+            }
+
+            /** @brief sampling based estimate of the entry funnel of one schedule
+             * @return rho, 0 if even the nominal does not reach the goal region
+             * **/
+            static double estimate_funnel(
+                const gain_schedule &schedule,
+                const equations_and_helper::fpgm_param &parameter,
+                const equations_and_helper::optimization_constrain &constrain,
+                const funnel_options &options)
+            {
+                if (schedule.count < 2)
+                    return 0.0;
+
+                typedef Eigen::Matrix<double, 7, 1> state_vector;
+                Eigen::Matrix<double, 7, 7> S0 = schedule.evaluate_cost_to_go(schedule.t0);
+                Eigen::Matrix<double, 7, 7> ST = schedule.evaluate_cost_to_go(
+                    schedule.t0 + schedule.duration());
+                Eigen::LLT<Eigen::Matrix<double, 7, 7>> llt(S0);
+                if (llt.info() != Eigen::Success)
+                    return 0.0;
+
+                state_vector x_nom, zero = state_vector::Zero();
+                schedule.evaluate(schedule.t0, zero.data(), x_nom.data());
+
+                if (!reaches_goal(schedule, parameter, constrain, options, x_nom, ST))
+                    return 0.0;
+
+                std::mt19937 generator(options.seed);
+                std::normal_distribution<double> normal(0.0, 1.0);
+                std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+                double rho = options.rho_max;
+                for (int s = 0; s < options.samples; s++)
+                {
+                    // uniform inside the ellipsoid dx' S0 dx <= rho_max, S0 = L L'
+                    state_vector y;
+                    for (int j = 0; j < 7; j++)
+                        y[j] = normal(generator);
+                    y *= sqrt(options.rho_max) * pow(uniform(generator), 1.0/7.0) / y.norm();
+                    state_vector dx = llt.matrixU().solve(y);
+                    double v = dx.dot(S0 * dx);
+
+                    // only samples inside the current estimate can shrink it
+                    if (v >= rho)
+                        continue;
+
+                    if (!reaches_goal(schedule, parameter, constrain, options, x_nom + dx, ST))
+                        rho = v;
+                }
+                return rho;
+            }
+
+            bool save(const std::string &path) const
+            {
+                if (!little_endian())
+                    return false;
+                FILE *file = fopen(path.c_str(), "wb");
+                if (!file)
+                    return false;
+
+                bool ok = true;
+                const char magic[4] = {'L', 'Q', 'R', 'T'};
+                uint32_t header[3] = {file_version, (uint32_t)nodes.size(), (uint32_t)gain_schedule::record_size};
+                ok &= fwrite(magic, 1, 4, file) == 4;
+                ok &= fwrite(header, sizeof(uint32_t), 3, file) == 3;
+
+                for (size_t i = 0; i < nodes.size() && ok; i++)
+                {
+                    const gain_schedule &g = nodes[i].schedule;
+                    uint32_t info[2] = {(uint32_t)g.count, 0};
+                    double scalars[3] = {g.t0, g.dt, nodes[i].rho};
+                    ok &= fwrite(info, sizeof(uint32_t), 2, file) == 2;
+                    ok &= fwrite(scalars, sizeof(double), 3, file) == 3;
+                    ok &= fwrite(g.cost_to_go.data(), sizeof(double), 28, file) == 28;
+                    ok &= fwrite(g.records.data(), sizeof(double), g.records.size(), file) == g.records.size();
+                }
+                fclose(file);
+                return ok;
+            }
+
+            bool load(const std::string &path)
+            {
+                clear();
+                if (!little_endian())
+                    return false;
+                FILE *file = fopen(path.c_str(), "rb");
+                if (!file)
+                    return false;
+
+                // the counts are checked against the bytes left before anything is allocated
+                long file_size = -1;
+                if (fseek(file, 0, SEEK_END) == 0)
+                    file_size = ftell(file);
+                rewind(file);
+                auto remaining = [&]()
+                {
+                    long position = ftell(file);
+                    return (uint64_t)(position >= 0 && file_size > position ? file_size - position : 0);
+                };
+                const uint64_t node_header_size = 2 * sizeof(uint32_t) + 3 * sizeof(double);
+                const uint64_t node_min_size =
+                    node_header_size + (28 + 2 * gain_schedule::record_size) * sizeof(double);
+
+                char magic[4];
+                uint32_t header[3];
+                bool ok = fread(magic, 1, 4, file) == 4 &&
+                    fread(header, sizeof(uint32_t), 3, file) == 3 &&
+                    memcmp(magic, "LQRT", 4) == 0 &&
+                    header[0] == file_version &&
+                    header[2] == (uint32_t)gain_schedule::record_size &&
+                    header[1] <= remaining() / node_min_size;
+
+                for (uint32_t i = 0; ok && i < header[1]; i++)
+                {
+                    uint32_t info[2];
+                    double scalars[3];
+                    node n;
+                    ok = fread(info, sizeof(uint32_t), 2, file) == 2 &&
+                        fread(scalars, sizeof(double), 3, file) == 3 && info[0] >= 2 &&
+                        (28 + (uint64_t)info[0] * gain_schedule::record_size) * sizeof(double) <= remaining();
+                    if (!ok)
+                        break;
+
+                    n.schedule.count = (int)info[0];
+                    n.schedule.t0 = scalars[0];
+                    n.schedule.dt = scalars[1];
+                    n.rho = scalars[2];
+                    // only S(0) is stored, the rest of the cost-to-go is not needed at runtime
+                    n.schedule.cost_to_go.assign(28 * n.schedule.count, 0.0);
+                    n.schedule.records.resize(n.schedule.count * gain_schedule::record_size);
+                    ok = fread(n.schedule.cost_to_go.data(), sizeof(double), 28, file) == 28 &&
+                        fread(n.schedule.records.data(), sizeof(double), n.schedule.records.size(), file) ==
+                        n.schedule.records.size();
+                    if (ok)
+                    {
+                        nodes.push_back(n);
+                        add_entry(nodes.back());
+                    }
+                }
+                fclose(file);
+                if (!ok)
+                    clear();
+                return ok;
+            }
+
+        private:
+
+            std::vector<node> nodes;
+            // entry funnels for lookup, x_nom(0) (7), full S(0) (49) and rho per node
+            std::vector<double> entry_state;
+            std::vector<double> entry_S;
+            std::vector<double> entry_rho;
+
+            // the records are written as they are in memory
+            static bool little_endian()
+            {
+                const uint16_t probe = 1;
+                return *(const uint8_t*)&probe == 1;
+            }
+
+            void add_entry(const node &n)
+            {
+                const double *rec = n.schedule.record(0);
+                entry_state.insert(entry_state.end(), rec, rec + 7);
+
+                Eigen::Matrix<double, 7, 7> S = n.schedule.evaluate_cost_to_go(n.schedule.t0);
+                for (int r = 0; r < 7; r++)
+                    for (int c = 0; c < 7; c++)
+                        entry_S.push_back(S(r,c));
+                // an empty funnel never matches
+                entry_rho.push_back(n.rho > 0 ? n.rho : std::numeric_limits<double>::min());
+            }
+
+            static bool reaches_goal(
+                const gain_schedule &schedule,
+                const equations_and_helper::fpgm_param &parameter,
+                const equations_and_helper::optimization_constrain &constrain,
+                const funnel_options &options,
+                Eigen::Matrix<double, 7, 1> s, const Eigen::Matrix<double, 7, 7> &ST)
+            {
+                static equations_and_helper eq;
+                double T = schedule.t0 + schedule.duration();
+                Eigen::Matrix<double, 7, 1> x_nom;
+                for (double t = schedule.t0; t < T - 1E-9; t += options.dt)
+                {
+                    double step = std::min(options.dt, T - t);
+                    double u = schedule.evaluate(t, s.data());
+                    u = std::max(-constrain.pd_c, std::min(constrain.pd_c, u));
+                    s = eq.rk4_step(s, u, step, parameter, t - schedule.t0);
+                    if (!s.allFinite())
+                        return false;
+                }
+                schedule.evaluate(T, s.data(), x_nom.data());
+                Eigen::Matrix<double, 7, 1> d = s - x_nom;
+                return d.dot(ST * d) <= options.goal_rho;
+            }
+    };
+}
+
+#endif
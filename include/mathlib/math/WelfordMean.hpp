@@ -35,6 +35,7 @@
  * @file WelfordMean.hpp
  *
  * Welford's online algorithm for computing mean and variance.
+ * Two instances (e.g. one per thread) are combined with Chan's parallel algorithm.
  */
 
 #pragma once
@@ -60,6 +61,51 @@ public:
 		_M2 += delta.emult(new_value - _mean);
 	}
 
+	// Add an array of values, its mean and M2 are computed in two passes and merged
+	void update(const T values[], unsigned num_values)
+	{
+		if (num_values == 0) {
+			return;
+		}
+
+		WelfordMean batch;
+		batch._count = num_values;
+
+		for (unsigned i = 0; i < num_values; i++) {
+			batch._mean += values[i];
+		}
+
+		batch._mean /= num_values;
+
+		for (unsigned i = 0; i < num_values; i++) {
+			const T delta{values[i] - batch._mean};
+			batch._M2 += delta.emult(delta);
+		}
+
+		merge(batch);
+	}
+
+	// Combine with the mean and M2 of another set of values (Chan et al.)
+	void merge(const WelfordMean &other)
+	{
+		if (other._count == 0) {
+			return;
+		}
+
+		if (_count == 0) {
+			*this = other;
+			return;
+		}
+
+		const unsigned count = _count + other._count;
+		const T delta{other._mean - _mean};
+		_mean += delta * other._count / count;
+
+		// scaled one count at a time so the product of the counts is never an integer
+		_M2 += other._M2 + delta.emult(delta) * _count * other._count / count;
+		_count = count;
+	}
+
 	bool valid() const { return _count > 2; }
 	unsigned count() const { return _count; }
 
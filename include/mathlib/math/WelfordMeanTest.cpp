@@ -33,8 +33,10 @@
 
 #include <gtest/gtest.h>
 #include <random>
+#include <vector>
 #include <lib/matrix/matrix/math.hpp>
 #include "WelfordMean.hpp"
+#include "WelfordMeanVector.hpp"
 
 using namespace math;
 using matrix::Vector3f;
@@ -64,3 +66,132 @@ TEST(WelfordMeanTest, NoisySignal)
 	EXPECT_NEAR(var(1), var_real, 0.1f);
 	EXPECT_NEAR(var(2), var_real, 0.1f);
 }
+
+TEST(WelfordMeanTest, MergeEqualsSingleStream)
+{
+	std::normal_distribution<float> distribution{5.f, 2.f};
+	std::default_random_engine random_generator{};
+	random_generator.seed(7);
+
+	// one stream against three uneven parts merged, and merging with empty accumulators
+	WelfordMean<Vector3f> single{};
+	WelfordMean<Vector3f> parts[3] {};
+	WelfordMean<Vector3f> empty{};
+	const int part_end[3] {10, 400, 1000};
+
+	for (int i = 0, part = 0; i < 1000; i++) {
+		const Vector3f value(distribution(random_generator), distribution(random_generator), i * 1e-3f);
+		single.update(value);
+
+		if (i >= part_end[part]) {
+			part++;
+		}
+
+		parts[part].update(value);
+	}
+
+	WelfordMean<Vector3f> merged{};
+	merged.merge(empty);
+	merged.merge(parts[0]);
+	merged.merge(parts[1]);
+	merged.merge(empty);
+	merged.merge(parts[2]);
+
+	EXPECT_EQ(merged.count(), single.count());
+
+	for (int i = 0; i < 3; i++) {
+		EXPECT_NEAR(merged.mean()(i), single.mean()(i), 1e-5f);
+		EXPECT_NEAR(merged.variance()(i), single.variance()(i), 1e-4f);
+	}
+}
+
+TEST(WelfordMeanTest, BatchUpdate)
+{
+	std::normal_distribution<float> distribution{100.f, 0.1f};
+	std::default_random_engine random_generator{};
+	random_generator.seed(3);
+
+	Vector3f values[200];
+
+	for (Vector3f &value : values) {
+		value = Vector3f(distribution(random_generator), -distribution(random_generator), 0.f);
+	}
+
+	WelfordMean<Vector3f> sequential{};
+	WelfordMean<Vector3f> batch{};
+
+	for (int i = 0; i < 50; i++) {
+		sequential.update(values[i]);
+		batch.update(values[i]);
+	}
+
+	for (int i = 50; i < 200; i++) {
+		sequential.update(values[i]);
+	}
+
+	batch.update(&values[50], 150);
+
+	EXPECT_EQ(batch.count(), 200u);
+
+	for (int i = 0; i < 3; i++) {
+		EXPECT_NEAR(batch.mean()(i), sequential.mean()(i), 1e-4f);
+		EXPECT_NEAR(batch.variance()(i), sequential.variance()(i), 1e-5f);
+	}
+}
+
+TEST(WelfordMeanTest, VectorCovariance)
+{
+	// y = 2 x + noise, so var(y) = 4 var(x) + var(noise) and cov(x, y) = 2 var(x)
+	std::normal_distribution<double> x_distribution{1.0, 3.0};
+	std::normal_distribution<double> noise_distribution{0.0, 1.0};
+	std::default_random_engine random_generator{};
+	random_generator.seed(11);
+
+	using Vector2d = matrix::Vector<double, 2>;
+	WelfordMeanVector<double, 2> single{};
+	WelfordMeanVector<double, 2> threads[4] {};
+	std::vector<Vector2d> values;
+
+	for (int i = 0; i < 20000; i++) {
+		const double x = x_distribution(random_generator);
+		Vector2d value;
+		value(0) = x;
+		value(1) = 2.0 * x + noise_distribution(random_generator);
+		values.push_back(value);
+
+		single.update(value);
+		threads[i % 4].update(value);
+	}
+
+	EXPECT_TRUE(single.valid());
+	const matrix::SquareMatrix<double, 2> covariance = single.covariance();
+	EXPECT_NEAR(single.mean()(0), 1.0, 0.1);
+	EXPECT_NEAR(single.mean()(1), 2.0, 0.2);
+	EXPECT_NEAR(covariance(0, 0), 9.0, 0.3);
+	EXPECT_NEAR(covariance(0, 1), 18.0, 0.6);
+	EXPECT_EQ(covariance(0, 1), covariance(1, 0));
+	EXPECT_NEAR(covariance(1, 1), 37.0, 1.2);
+	EXPECT_NEAR(single.variance()(1), covariance(1, 1), 1e-12);
+
+	// per thread accumulators merged at the end, and the batch path
+	WelfordMeanVector<double, 2> merged{};
+	WelfordMeanVector<double, 2> batch{};
+
+	for (const WelfordMeanVector<double, 2> &thread : threads) {
+		merged.merge(thread);
+	}
+
+	batch.update(values.data(), values.size());
+
+	for (const WelfordMeanVector<double, 2> *other : {&merged, &batch}) {
+		EXPECT_EQ(other->count(), single.count());
+
+		for (int r = 0; r < 2; r++) {
+			EXPECT_NEAR(other->mean()(r), single.mean()(r), 1e-10);
+
+			for (int c = 0; c < 2; c++) {
+				EXPECT_NEAR(other->sample_covariance()(r, c), single.sample_covariance()(r, c), 1e-9);
+			}
+		}
+	}
+}
@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2022 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file WelfordMeanVector.hpp
+ *
+ * Welford's online algorithm for computing the mean and full covariance of a
+ * vector. Two instances (e.g. one per thread) are combined with Chan's
+ * parallel algorithm.
+ */
+
+#pragma once
+
+#include "math.hpp"
+
+namespace math
+{
+
+template<typename Type, size_t N>
+class WelfordMeanVector
+{
+public:
+	// For a new value, compute the new count, new mean, the new M2.
+	void update(const matrix::Vector<Type, N> &new_value)
+	{
+		_count++;
+
+		Type delta[N];
+
+		for (size_t i = 0; i < N; i++) {
+			delta[i] = new_value(i) - _mean(i);
+			_mean(i) += delta[i] / _count;
+		}
+
+		// M2 aggregates the co-moments, only the upper triangle is kept
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = r; c < N; c++) {
+				_M2(r, c) += delta[r] * (new_value(c) - _mean(c));
+			}
+		}
+	}
+
+	// Add an array of values, its mean and M2 are computed in two passes and merged
+	void update(const matrix::Vector<Type, N> values[], unsigned num_values)
+	{
+		if (num_values == 0) {
+			return;
+		}
+
+		WelfordMeanVector batch;
+		batch._count = num_values;
+
+		for (unsigned k = 0; k < num_values; k++) {
+			for (size_t i = 0; i < N; i++) {
+				batch._mean(i) += values[k](i);
+			}
+		}
+
+		for (size_t i = 0; i < N; i++) {
+			batch._mean(i) /= num_values;
+		}
+
+		for (unsigned k = 0; k < num_values; k++) {
+			Type delta[N];
+
+			for (size_t i = 0; i < N; i++) {
+				delta[i] = values[k](i) - batch._mean(i);
+			}
+
+			for (size_t r = 0; r < N; r++) {
+				for (size_t c = r; c < N; c++) {
+					batch._M2(r, c) += delta[r] * delta[c];
+				}
+			}
+		}
+
+		merge(batch);
+	}
+
+	// Combine with the mean and M2 of another set of values (Chan et al.)
+	void merge(const WelfordMeanVector &other)
+	{
+		if (other._count == 0) {
+			return;
+		}
+
+		if (_count == 0) {
+			*this = other;
+			return;
+		}
+
+		const unsigned count = _count + other._count;
+		const Type weight = static_cast<Type>(_count) * other._count / count;
+		Type delta[N];
+
+		for (size_t i = 0; i < N; i++) {
+			delta[i] = other._mean(i) - _mean(i);
+			_mean(i) += delta[i] * other._count / count;
+		}
+
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = r; c < N; c++) {
+				_M2(r, c) += other._M2(r, c) + delta[r] * delta[c] * weight;
+			}
+		}
+
+		_count = count;
+	}
+
+	bool valid() const { return _count > 2; }
+	unsigned count() const { return _count; }
+
+	void reset()
+	{
+		_count = 0;
+		_mean = {};
+		_M2 = {};
+	}
+
+	// Retrieve the mean, variance and sample variance
+	matrix::Vector<Type, N> mean() const { return _mean; }
+	matrix::Vector<Type, N> variance() const { return diagonal(_count); }
+	matrix::Vector<Type, N> sample_variance() const { return diagonal(_count - 1); }
+
+	// Retrieve the covariance and sample covariance
+	matrix::SquareMatrix<Type, N> covariance() const { return symmetric(_count); }
+	matrix::SquareMatrix<Type, N> sample_covariance() const { return symmetric(_count - 1); }
+
+private:
+	matrix::Vector<Type, N> diagonal(unsigned divisor) const
+	{
+		matrix::Vector<Type, N> v;
+
+		for (size_t i = 0; i < N; i++) {
+			v(i) = _M2(i, i) / divisor;
+		}
+
+		return v;
+	}
+
+	matrix::SquareMatrix<Type, N> symmetric(unsigned divisor) const
+	{
+		matrix::SquareMatrix<Type, N> m;
+
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = r; c < N; c++) {
+				m(r, c) = m(c, r) = _M2(r, c) / divisor;
+			}
+		}
+
+		return m;
+	}
+
+	matrix::Vector<Type, N> _mean{};
+	matrix::SquareMatrix<Type, N> _M2{};
+	unsigned _count{0};
+};
+
+} // namespace math
@@ -0,0 +1,219 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2022 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/*
+ * @file BiquadFilterBank.hpp
+ *
+ * @brief Bank of cascaded biquad filters run on many channels at once.
+ *
+ * Every channel runs the same number of second order stages (low-pass, notch
+ * or passthrough, each with its own coefficients per channel). Coefficients
+ * and delay elements are stored as structure of arrays, one float per
+ * channel, so one time step of a stage is a loop over the channels the
+ * compiler vectorizes. All stages of a time step are computed in one pass
+ * (Direct Form I, the output history of a stage is the input history of the
+ * next one).
+ */
+
+#pragma once
+
+#include <mathlib/math/filter/LowPassFilter2p.hpp>
+#include <mathlib/math/filter/NotchFilter.hpp>
+#include <float.h>
+
+namespace math
+{
+
+template<int CHANNELS, int STAGES = 1>
+class BiquadFilterBank
+{
+public:
+	static_assert(CHANNELS >= 1, "BiquadFilterBank needs at least one channel");
+	static_assert(STAGES >= 1, "BiquadFilterBank needs at least one stage");
+
+	BiquadFilterBank()
+	{
+		for (int s = 0; s < STAGES; s++) {
+			for (int c = 0; c < CHANNELS; c++) {
+				disable(s, c);
+			}
+		}
+	}
+
+	/**
+	 * Set the coefficients of one stage of one channel, the delay elements are kept
+	 *
+	 * @param a denominator a1, a2 (normalized by a0)
+	 * @param b numerator b0, b1, b2 (normalized by a0)
+	 */
+	void setCoefficients(int stage, int channel, const float a[2], const float b[3])
+	{
+		_a1[stage][channel] = a[0];
+		_a2[stage][channel] = a[1];
+		_b0[stage][channel] = b[0];
+		_b1[stage][channel] = b[1];
+		_b2[stage][channel] = b[2];
+	}
+
+	// Copy the coefficients of a configured filter into one stage of one channel
+	template<typename Filter>
+	void setCoefficients(int stage, int channel, const Filter &filter)
+	{
+		float a[3];
+		float b[3];
+		filter.getCoefficients(a, b);
+		setCoefficients(stage, channel, &a[1], b);
+	}
+
+	// Second order Butterworth low-pass, the stage is a passthrough if the parameters are invalid
+	bool setLowPass(int stage, int channel, float sample_freq, float cutoff_freq)
+	{
+		const LowPassFilter2p<float> low_pass{sample_freq, cutoff_freq};
+		setCoefficients(stage, channel, low_pass);
+		return low_pass.get_cutoff_freq() > 0.f;
+	}
+
+	// Notch, the stage is a passthrough if the parameters are invalid
+	bool setNotch(int stage, int channel, float sample_freq, float notch_freq, float bandwidth)
+	{
+		NotchFilter<float> notch;
+		const bool valid = notch.setParameters(sample_freq, notch_freq, bandwidth);
+		setCoefficients(stage, channel, notch);
+		return valid;
+	}
+
+	// Make one stage of one channel a passthrough
+	void disable(int stage, int channel)
+	{
+		const float a[2] {0.f, 0.f};
+		const float b[3] {1.f, 0.f, 0.f};
+		setCoefficients(stage, channel, a, b);
+	}
+
+	/**
+	 * Filter one time step of all channels through all stages
+	 *
+	 * @param input one sample per channel
+	 * @param output one filtered sample per channel (may be the same array as input)
+	 */
+	inline void apply(const float input[CHANNELS], float output[CHANNELS])
+	{
+		float x[CHANNELS];
+
+		for (int c = 0; c < CHANNELS; c++) {
+			x[c] = input[c];
+		}
+
+		for (int s = 0; s < STAGES; s++) {
+			float *in_1 = _delay_element_1[s];
+			float *in_2 = _delay_element_2[s];
+			float *out_1 = _delay_element_1[s + 1];
+			float *out_2 = _delay_element_2[s + 1];
+
+			for (int c = 0; c < CHANNELS; c++) {
+				const float y = _b0[s][c] * x[c] + _b1[s][c] * in_1[c] + _b2[s][c] * in_2[c]
+						- _a1[s][c] * out_1[c] - _a2[s][c] * out_2[c];
+
+				// the output history is shifted by the next stage (or below for the last one)
+				in_2[c] = in_1[c];
+				in_1[c] = x[c];
+				x[c] = y;
+			}
+		}
+
+		for (int c = 0; c < CHANNELS; c++) {
+			_delay_element_2[STAGES][c] = _delay_element_1[STAGES][c];
+			_delay_element_1[STAGES][c] = x[c];
+			output[c] = x[c];
+		}
+	}
+
+	// Filter num_samples time steps in place, samples[n * CHANNELS + c] is channel c at step n
+	inline void applyArray(float samples[], int num_samples)
+	{
+		for (int n = 0; n < num_samples; n++) {
+			apply(&samples[n * CHANNELS], &samples[n * CHANNELS]);
+		}
+	}
+
+	// Reset all stages to the steady state of a constant input
+	void reset(const float sample[CHANNELS])
+	{
+		for (int c = 0; c < CHANNELS; c++) {
+			float x = isFinite(sample[c]) ? sample[c] : 0.f;
+
+			_delay_element_1[0][c] = _delay_element_2[0][c] = x;
+
+			for (int s = 0; s < STAGES; s++) {
+				const float den = 1.f + _a1[s][c] + _a2[s][c];
+
+				if (fabsf(den) > FLT_EPSILON) {
+					x = x * (_b0[s][c] + _b1[s][c] + _b2[s][c]) / den;
+				}
+
+				if (!isFinite(x)) {
+					x = 0.f;
+				}
+
+				_delay_element_1[s + 1][c] = _delay_element_2[s + 1][c] = x;
+			}
+		}
+	}
+
+	// Reset all delay elements to zero
+	void reset()
+	{
+		for (int s = 0; s <= STAGES; s++) {
+			for (int c = 0; c < CHANNELS; c++) {
+				_delay_element_1[s][c] = 0.f;
+				_delay_element_2[s][c] = 0.f;
+			}
+		}
+	}
+
+private:
+	// All the coefficients are normalized by a0, so a0 becomes 1 here
+	float _a1[STAGES][CHANNELS];
+	float _a2[STAGES][CHANNELS];
+
+	float _b0[STAGES][CHANNELS];
+	float _b1[STAGES][CHANNELS];
+	float _b2[STAGES][CHANNELS];
+
+	// [0] is the input history, [s + 1] the output history of stage s
+	float _delay_element_1[STAGES + 1][CHANNELS] {};
+	float _delay_element_2[STAGES + 1][CHANNELS] {};
+};
+
+} // namespace math
@@ -0,0 +1,386 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2022 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/*
+ * @file BlockFilter.hpp
+ *
+ * @brief Offline filtering of long arrays with a biquad by independent blocks.
+ *
+ * The array is cut into LANES * threads blocks. Each block is first filtered
+ * from a zero state (the first one from the filter state), LANES blocks at a
+ * time in lockstep so the recurrence is vectorized across blocks and each
+ * thread takes LANES blocks. The true start state of every block is then
+ * chained from the block final states with the block_size step state
+ * transition (a sequential scan over the blocks only), and the response to
+ * it, a combination of the zero input responses of the unit states, is added
+ * to the block. The remainder that does not fill a block is filtered
+ * sequentially at the end.
+ *
+ * Compared with the sequential filter only the rounding differs. The output
+ * matches within 2e-5 of the largest input sample for cutoff and notch
+ * frequencies down to 1% of the sample frequency (1e-6 above 10%), which is
+ * the size of the float rounding error of the sequential filter itself
+ * against a double precision one.
+ *
+ * Offline code only, the filters do not include this header (it pulls in
+ * <thread> and <vector>).
+ */
+
+#pragma once
+
+#include <mathlib/math/Limits.hpp>
+#include <mathlib/math/filter/LowPassFilter2p.hpp>
+#include <mathlib/math/filter/NotchFilter.hpp>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace math
+{
+namespace block_filter
+{
+
+static constexpr int LANES = 8; // blocks filtered in lockstep by one thread
+static constexpr int MIN_BLOCK_SIZE = 256; // shorter arrays are filtered sequentially
+static constexpr int CHUNK_SIZE = 64; // samples per lane transposed at once
+static constexpr float STATE_DECAYED = 1e-10f; // zero input response of a unit state taken as zero below this
+
+// Direct Form I biquad, state {x[n-1], x[n-2], y[n-1], y[n-2]}
+struct DirectForm1 {
+	static constexpr int STATES = 4;
+
+	float a1, a2, b0, b1, b2;
+
+	// one sample of each lane, x is replaced by the output
+	template<int N>
+	void step(float state[STATES][N], float x[N]) const
+	{
+		// local copies, the stores below could alias the members otherwise
+		const float _a1 = a1, _a2 = a2, _b0 = b0, _b1 = b1, _b2 = b2;
+
+		for (int l = 0; l < N; l++) {
+			const float y = _b0 * x[l] + _b1 * state[0][l] + _b2 * state[1][l] - _a1 * state[2][l] - _a2 * state[3][l];
+			state[1][l] = state[0][l];
+			state[0][l] = x[l];
+			state[3][l] = state[2][l];
+			state[2][l] = y;
+			x[l] = y;
+		}
+	}
+};
+
+// Direct Form II biquad, state {w[n-1], w[n-2]}
+struct DirectForm2 {
+	static constexpr int STATES = 2;
+
+	float a1, a2, b0, b1, b2;
+
+	// one sample of each lane, x is replaced by the output
+	template<int N>
+	void step(float state[STATES][N], float x[N]) const
+	{
+		// local copies, the stores below could alias the members otherwise
+		const float _a1 = a1, _a2 = a2, _b0 = b0, _b1 = b1, _b2 = b2;
+
+		for (int l = 0; l < N; l++) {
+			const float w = x[l] - state[0][l] * _a1 - state[1][l] * _a2;
+			x[l] = w * _b0 + state[0][l] * _b1 + state[1][l] * _b2;
+			state[1][l] = state[0][l];
+			state[0][l] = w;
+		}
+	}
+};
+
+/**
+ * Filter an array in place by blocks
+ *
+ * @param kernel biquad form and coefficients
+ * @param state filter state before the first sample, replaced by the state after the last one
+ * @param threads number of threads for the block passes
+ */
+template<typename Kernel>
+void apply(const Kernel &kernel, float state[Kernel::STATES], float samples[], int num_samples, int threads = 1)
+{
+	constexpr int S = Kernel::STATES;
+	threads = max(threads, 1);
+	const int num_blocks = LANES * threads;
+	const int block_size = num_samples / num_blocks;
+
+	if (block_size < MIN_BLOCK_SIZE) {
+		float s[S][1];
+
+		for (int j = 0; j < S; j++) {
+			s[j][0] = state[j];
+		}
+
+		for (int n = 0; n < num_samples; n++) {
+			kernel.template step<1>(s, &samples[n]);
+		}
+
+		for (int j = 0; j < S; j++) {
+			state[j] = s[j][0];
+		}
+
+		return;
+	}
+
+	// zero input responses of the unit states (response[i * S + j] for state j) and the state after
+	// block_size samples, cut once every state has decayed below STATE_DECAYED (the remaining
+	// response is zero then, and the denormals further down would only slow it down)
+	std::vector<float> response;
+	double transition[S][S] {};
+	{
+		float s[S][S] {};
+		float x[S];
+
+		for (int j = 0; j < S; j++) {
+			s[j][j] = 1.f;
+		}
+
+		bool decayed = false;
+
+		for (int i = 0; (i < block_size) && !decayed; i++) {
+			for (int j = 0; j < S; j++) {
+				x[j] = 0.f;
+			}
+
+			kernel.template step<S>(s, x);
+
+			float largest = 0.f;
+
+			for (int j = 0; j < S; j++) {
+				response.push_back(x[j]);
+
+				for (int k = 0; k < S; k++) {
+					largest = max(largest, fabsf(s[j][k]));
+				}
+			}
+
+			decayed = largest < STATE_DECAYED;
+		}
+
+		if (!decayed) {
+			for (int i = 0; i < S; i++) {
+				for (int j = 0; j < S; j++) {
+					transition[i][j] = s[i][j];
+				}
+			}
+		}
+	}
+
+	const int response_size = response.size() / S;
+
+	// pass 1, zero state response of every block (block 0 from the filter state)
+	std::vector<float> final_state(num_blocks * S);
+
+	auto zero_state = [&](int thread) {
+		float s[S][LANES] {};
+		float x[CHUNK_SIZE][LANES];
+		float *block[LANES];
+
+		for (int l = 0; l < LANES; l++) {
+			block[l] = &samples[(thread * LANES + l) * block_size];
+		}
+
+		if (thread == 0) {
+			for (int j = 0; j < S; j++) {
+				s[j][0] = state[j];
+			}
+		}
+
+		// the blocks are transposed in chunks so each lane still reads contiguous memory
+		for (int start = 0; start < block_size; start += CHUNK_SIZE) {
+			const int chunk_size = min(CHUNK_SIZE, block_size - start);
+
+			for (int l = 0; l < LANES; l++) {
+				for (int i = 0; i < chunk_size; i++) {
+					x[i][l] = block[l][start + i];
+				}
+			}
+
+			for (int i = 0; i < chunk_size; i++) {
+				kernel.template step<LANES>(s, x[i]);
+			}
+
+			for (int l = 0; l < LANES; l++) {
+				for (int i = 0; i < chunk_size; i++) {
+					block[l][start + i] = x[i][l];
+				}
+			}
+		}
+
+		for (int l = 0; l < LANES; l++) {
+			for (int j = 0; j < S; j++) {
+				final_state[(thread * LANES + l) * S + j] = s[j][l];
+			}
+		}
+	};
+
+	// chain the true start state of every block
+	std::vector<float> start_state(num_blocks * S);
+
+	auto chain = [&]() {
+		double s[S];
+
+		for (int j = 0; j < S; j++) {
+			s[j] = final_state[j];
+		}
+
+		for (int k = 1; k < num_blocks; k++) {
+			double next[S];
+
+			for (int i = 0; i < S; i++) {
+				start_state[k * S + i] = s[i];
+				next[i] = final_state[k * S + i];
+
+				for (int j = 0; j < S; j++) {
+					next[i] += transition[i][j] * s[j];
+				}
+			}
+
+			for (int i = 0; i < S; i++) {
+				s[i] = next[i];
+			}
+		}
+
+		for (int j = 0; j < S; j++) {
+			state[j] = s[j];
+		}
+	};
+
+	// pass 2, add the response to the start state
+	auto correct = [&](int thread) {
+		for (int k = max(thread * LANES, 1); k < (thread + 1) * LANES; k++) {
+			float *block = &samples[k * block_size];
+
+			float s[S];
+
+			for (int j = 0; j < S; j++) {
+				s[j] = start_state[k * S + j];
+			}
+
+			for (int i = 0; i < response_size; i++) {
+				for (int j = 0; j < S; j++) {
+					block[i] += s[j] * response[i * S + j];
+				}
+			}
+		}
+	};
+
+	if (threads == 1) {
+		zero_state(0);
+		chain();
+		correct(0);
+
+	} else {
+		std::vector<std::thread> workers;
+
+		for (int t = 0; t < threads; t++) {
+			workers.push_back(std::thread(zero_state, t));
+		}
+
+		for (auto &worker : workers) {
+			worker.join();
+		}
+
+		chain();
+		workers.clear();
+
+		for (int t = 0; t < threads; t++) {
+			workers.push_back(std::thread(correct, t));
+		}
+
+		for (auto &worker : workers) {
+			worker.join();
+		}
+	}
+
+	// remainder after the last full block
+	float s[S][1];
+
+	for (int j = 0; j < S; j++) {
+		s[j][0] = state[j];
+	}
+
+	for (int n = num_blocks * block_size; n < num_samples; n++) {
+		kernel.template step<1>(s, &samples[n]);
+	}
+
+	for (int j = 0; j < S; j++) {
+		state[j] = s[j][0];
+	}
+}
+
+/**
+ * Filter an array in place by blocks with a low-pass filter, same output as
+ * LowPassFilter2p::applyArray within the tolerance above and the same state after
+ */
+inline void apply(LowPassFilter2p<float> &filter, float samples[], int num_samples, int threads = 1)
+{
+	float a[3], b[3];
+	filter.getCoefficients(a, b);
+	const DirectForm2 kernel{a[1], a[2], b[0], b[1], b[2]};
+
+	float state[DirectForm2::STATES];
+	filter.getState(state);
+	apply(kernel, state, samples, num_samples, threads);
+	filter.setState(state);
+}
+
+/**
+ * Filter an array in place by blocks with a notch filter, same output as
+ * NotchFilter::applyArray within the tolerance above and the same state after
+ */
+inline void apply(NotchFilter<float> &filter, float samples[], int num_samples, int threads = 1)
+{
+	if (num_samples <= 0) {
+		return;
+	}
+
+	if (!filter.initialized()) {
+		filter.reset(samples[0]);
+	}
+
+	float a[3], b[3];
+	filter.getCoefficients(a, b);
+	const DirectForm1 kernel{a[1], a[2], b[0], b[1], b[2]};
+
+	float state[DirectForm1::STATES];
+	filter.getState(state);
+	apply(kernel, state, samples, num_samples, threads);
+	filter.setState(state);
+}
+
+} // namespace block_filter
+} // namespace math
@@ -124,6 +124,30 @@ public:
 
 	float getMagnitudeResponse(float frequency) const;
 
+	// Return the coefficients normalized by a0 (a[0] is 1)
+	void getCoefficients(float a[3], float b[3]) const
+	{
+		a[0] = 1.f;
+		a[1] = _a1;
+		a[2] = _a2;
+		b[0] = _b0;
+		b[1] = _b1;
+		b[2] = _b2;
+	}
+
+	// Return and set the delay elements {w[n-1], w[n-2]} of the Direct Form II
+	void getState(T state[2]) const
+	{
+		state[0] = _delay_element_1;
+		state[1] = _delay_element_2;
+	}
+
+	void setState(const T state[2])
+	{
+		_delay_element_1 = state[0];
+		_delay_element_2 = state[1];
+	}
+
 	// Reset the filter state to this value
 	T reset(const T &sample)
 	{
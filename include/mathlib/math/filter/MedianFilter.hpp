@@ -34,16 +34,19 @@
 /*
  * @file MedianFilter.hpp
  *
- * @brief Implementation of a median filter with C qsort.
+ * @brief Implementation of a sliding window median filter.
  *
+ * Windows of 3 and 5 samples select the median from a copy of the window
+ * with a sorting network when it is requested, larger windows keep the window
+ * sorted on every insert (O(WINDOW) per sample, the median is then O(1)).
+ * A NaN is sorted after every number so the order stays valid while it is in
+ * the window.
  */
 
 #pragma once
 
-#include <stdio.h>
-#include <stdlib.h>
 #include <stdint.h>
-#include <string.h>
+#include <type_traits>
 
 namespace math
 {
@@ -54,22 +57,26 @@ class MedianFilter
 public:
 	static_assert(WINDOW >= 3, "MedianFilter window size must be >= 3");
 	static_assert(WINDOW % 2, "MedianFilter window size must be odd"); // odd
+	static_assert(WINDOW <= 255, "MedianFilter window size must be <= 255");
 
-	MedianFilter() = default;
+	MedianFilter()
+	{
+		for (int i = 0; i < WINDOW; i++) {
+			_order[i] = i;
+		}
+	}
 
 	void insert(const T &sample)
 	{
 		_head = (_head + 1) % WINDOW;
 		_buffer[_head] = sample;
+
+		insertOrder(sample, Path{});
 	}
 
-	T median()
+	T median() const
 	{
-		T sorted[WINDOW];
-		memcpy(sorted, _buffer, sizeof(_buffer));
-		qsort(&sorted, WINDOW, sizeof(T), cmp);
-
-		return sorted[WINDOW / 2];
+		return median(Path{});
 	}
 
 	T apply(const T &sample)
@@ -80,12 +87,96 @@ public:
 
 private:
 
-	static int cmp(const void *a, const void *b)
+	// largest window using the selection network instead of the sorted window
+	static constexpr int SORTING_NETWORK_MAX = 5;
+
+	// the selection network of the window, 0 for the sorted window
+	using Path = std::integral_constant<int, (WINDOW > SORTING_NETWORK_MAX) ? 0 : WINDOW>;
+	using SortedWindow = std::integral_constant<int, 0>;
+	using Network3 = std::integral_constant<int, 3>;
+	using Network5 = std::integral_constant<int, 5>;
+
+	void insertOrder(const T &sample, SortedWindow)
+	{
+		int i = 0;
+
+		while (_order[i] != _head) {
+			i++;
+		}
+
+		while ((i + 1 < WINDOW) && less(_buffer[_order[i + 1]], sample)) {
+			_order[i] = _order[i + 1];
+			i++;
+		}
+
+		while ((i > 0) && less(sample, _buffer[_order[i - 1]])) {
+			_order[i] = _order[i - 1];
+			i--;
+		}
+
+		_order[i] = _head;
+	}
+
+	// the networks sort a copy when the median is requested
+	template<int N>
+	void insertOrder(const T &, std::integral_constant<int, N>) {}
+
+	T median(SortedWindow) const
+	{
+		return _buffer[_order[WINDOW / 2]];
+	}
+
+	// median selection networks (Paeth), 3 and 7 compare-exchanges
+	T median(Network3) const
+	{
+		T p[3] {_buffer[0], _buffer[1], _buffer[2]};
+		sort2(p, 0, 1);
+		sort2(p, 1, 2);
+		sort2(p, 0, 1);
+		return p[1];
+	}
+
+	T median(Network5) const
+	{
+		T p[5] {_buffer[0], _buffer[1], _buffer[2], _buffer[3], _buffer[4]};
+		sort2(p, 0, 1);
+		sort2(p, 3, 4);
+		sort2(p, 0, 3);
+		sort2(p, 1, 4);
+		sort2(p, 1, 2);
+		sort2(p, 2, 3);
+		sort2(p, 1, 2);
+		return p[2];
+	}
+
+	// strict weak order of the sorted window, NaN after every number (all comparisons
+	// with a NaN are false, the insertion would stop next to it and unsort the window)
+	static bool less(const T &a, const T &b)
+	{
+		return less(a, b, std::is_floating_point<T> {});
+	}
+
+	static bool less(const T &a, const T &b, std::true_type)
+	{
+		return (a < b) || ((b != b) && (a == a));
+	}
+
+	static bool less(const T &a, const T &b, std::false_type)
+	{
+		return a < b;
+	}
+
+	// branch free compare-exchange, p[i] <= p[j] afterwards
+	static void sort2(T *p, int i, int j)
 	{
-		return (*(T *)a >= *(T *)b) ? 1 : -1;
+		const T a = p[i];
+		const T b = p[j];
+		p[i] = (b < a) ? b : a;
+		p[j] = (b < a) ? a : b;
 	}
 
 	T _buffer[WINDOW] {};
+	uint8_t _order[WINDOW]; // slots of _buffer in ascending order of their value
 	uint8_t _head{0};
 };
 
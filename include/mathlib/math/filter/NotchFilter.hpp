@@ -90,7 +90,7 @@ public:
 	float getNotchFreq() const { return _notch_freq; }
 	float getBandwidth() const { return _bandwidth; }
 
-	// Used in unit test only
+	// Return the coefficients normalized by a0 (a[0] is 1), used by BiquadFilterBank and BlockFilter
 	void getCoefficients(float a[3], float b[3]) const
 	{
 		a[0] = 1.f;
@@ -128,6 +128,24 @@ public:
 		_b2 = b[2];
 	}
 
+	// Return and set the delay elements {x[n-1], x[n-2], y[n-1], y[n-2]} of the Direct Form I
+	void getState(T state[4]) const
+	{
+		state[0] = _delay_element_1;
+		state[1] = _delay_element_2;
+		state[2] = _delay_element_output_1;
+		state[3] = _delay_element_output_2;
+	}
+
+	void setState(const T state[4])
+	{
+		_delay_element_1 = state[0];
+		_delay_element_2 = state[1];
+		_delay_element_output_1 = state[2];
+		_delay_element_output_2 = state[3];
+		_initialized = true;
+	}
+
 	bool initialized() const { return _initialized; }
 
 	void reset() { _initialized = false; }
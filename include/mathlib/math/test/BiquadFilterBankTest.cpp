@@ -0,0 +1,184 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2022 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Test code for the biquad filter bank
+ * Run this test only using make tests TESTFILTER=BiquadFilterBank
+ */
+
+#include <gtest/gtest.h>
+#include <matrix/matrix/math.hpp>
+
+#include <lib/mathlib/math/filter/BiquadFilterBank.hpp>
+
+using namespace math;
+
+class BiquadFilterBankTest : public ::testing::Test
+{
+public:
+	static constexpr int CHANNELS = 12;
+
+	// deterministic sum of sines, different per channel
+	static float signal(int channel, int step)
+	{
+		const float t = step / _sample_freq;
+		return sinf(2.f * M_PI_F * (5.f + 7.f * channel) * t) + 0.5f * sinf(2.f * M_PI_F * (90.f + 11.f * channel) * t + channel);
+	}
+
+	static constexpr float _sample_freq = 1000.f;
+	const float _epsilon_near = 1e-5f;
+};
+
+constexpr float BiquadFilterBankTest::_sample_freq;
+
+TEST_F(BiquadFilterBankTest, passthrough)
+{
+	BiquadFilterBank<CHANNELS, 2> bank;
+	float samples[CHANNELS];
+
+	for (int i = 0; i < 100; i++) {
+		for (int c = 0; c < CHANNELS; c++) {
+			samples[c] = signal(c, i);
+		}
+
+		bank.apply(samples, samples);
+
+		for (int c = 0; c < CHANNELS; c++) {
+			EXPECT_EQ(samples[c], signal(c, i));
+		}
+	}
+}
+
+TEST_F(BiquadFilterBankTest, matchesSingleFilters)
+{
+	// every channel runs a notch followed by a low-pass with its own frequencies
+	BiquadFilterBank<CHANNELS, 2> bank;
+	NotchFilter<float> notch[CHANNELS];
+	LowPassFilter2p<float> low_pass[CHANNELS];
+
+	for (int c = 0; c < CHANNELS; c++) {
+		const float notch_freq = 40.f + 5.f * c;
+		const float cutoff_freq = 30.f + 10.f * c;
+
+		notch[c].setParameters(_sample_freq, notch_freq, 10.f);
+		notch[c].reset(0.f);
+		low_pass[c].set_cutoff_frequency(_sample_freq, cutoff_freq);
+
+		EXPECT_TRUE(bank.setNotch(0, c, _sample_freq, notch_freq, 10.f));
+		EXPECT_TRUE(bank.setLowPass(1, c, _sample_freq, cutoff_freq));
+	}
+
+	float samples[CHANNELS];
+
+	for (int i = 0; i < 2000; i++) {
+		for (int c = 0; c < CHANNELS; c++) {
+			samples[c] = signal(c, i);
+		}
+
+		bank.apply(samples, samples);
+
+		for (int c = 0; c < CHANNELS; c++) {
+			const float expected = low_pass[c].apply(notch[c].apply(signal(c, i)));
+			EXPECT_NEAR(samples[c], expected, _epsilon_near);
+		}
+	}
+}
+
+TEST_F(BiquadFilterBankTest, applyArrayInterleaved)
+{
+	BiquadFilterBank<CHANNELS> bank;
+	BiquadFilterBank<CHANNELS> bank_array;
+
+	for (int c = 0; c < CHANNELS; c++) {
+		bank.setLowPass(0, c, _sample_freq, 50.f);
+		bank_array.setLowPass(0, c, _sample_freq, 50.f);
+	}
+
+	const int num_samples = 500;
+	float samples[num_samples * CHANNELS];
+
+	for (int i = 0; i < num_samples; i++) {
+		for (int c = 0; c < CHANNELS; c++) {
+			samples[i * CHANNELS + c] = signal(c, i);
+		}
+	}
+
+	bank_array.applyArray(samples, num_samples);
+
+	for (int i = 0; i < num_samples; i++) {
+		float step[CHANNELS];
+
+		for (int c = 0; c < CHANNELS; c++) {
+			step[c] = signal(c, i);
+		}
+
+		bank.apply(step, step);
+
+		for (int c = 0; c < CHANNELS; c++) {
+			EXPECT_EQ(samples[i * CHANNELS + c], step[c]);
+		}
+	}
+}
+
+TEST_F(BiquadFilterBankTest, invalidParametersPassThrough)
+{
+	BiquadFilterBank<2> bank;
+
+	EXPECT_FALSE(bank.setLowPass(0, 0, _sample_freq, 600.f)); // above Nyquist
+	EXPECT_FALSE(bank.setNotch(0, 1, _sample_freq, -1.f, 10.f));
+
+	float samples[2] {1.5f, -2.f};
+	bank.apply(samples, samples);
+	EXPECT_EQ(samples[0], 1.5f);
+	EXPECT_EQ(samples[1], -2.f);
+}
+
+TEST_F(BiquadFilterBankTest, resetToSteadyState)
+{
+	BiquadFilterBank<2, 2> bank;
+
+	for (int c = 0; c < 2; c++) {
+		bank.setNotch(0, c, _sample_freq, 50.f, 15.f);
+		bank.setLowPass(1, c, _sample_freq, 30.f);
+	}
+
+	const float constant[2] {3.f, -7.f};
+	bank.reset(constant);
+
+	for (int i = 0; i < 100; i++) {
+		float samples[2] {constant[0], constant[1]};
+		bank.apply(samples, samples);
+		EXPECT_NEAR(samples[0], constant[0], _epsilon_near * 10.f);
+		EXPECT_NEAR(samples[1], constant[1], _epsilon_near * 10.f);
+	}
+}
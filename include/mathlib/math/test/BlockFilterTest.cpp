@@ -0,0 +1,137 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2022 PX4 Development Team. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name PX4 nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * Test code for the block (offline) filtering of long arrays
+ * Run this test only using make tests TESTFILTER=BlockFilter
+ */
+
+#include <gtest/gtest.h>
+#include <matrix/matrix/math.hpp>
+
+#include <lib/mathlib/math/filter/BlockFilter.hpp>
+#include <lib/mathlib/math/filter/LowPassFilter2p.hpp>
+#include <lib/mathlib/math/filter/NotchFilter.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace math;
+
+class BlockFilterTest : public ::testing::Test
+{
+public:
+	// vibration like signal, sines on top of noise, peak below 3
+	static std::vector<float> signal(int num_samples)
+	{
+		std::mt19937 generator(1);
+		std::normal_distribution<float> noise(0.f, 0.3f);
+		std::vector<float> samples(num_samples);
+
+		for (int n = 0; n < num_samples; n++) {
+			const float t = n / _sample_freq;
+			samples[n] = 1.f + sinf(2.f * M_PI_F * 3.f * t) + 0.5f * sinf(2.f * M_PI_F * 120.f * t) + noise(generator);
+		}
+
+		return samples;
+	}
+
+	template<typename Filter>
+	static void compare(Filter filter, const std::vector<float> &input, int threads, float tolerance)
+	{
+		Filter filter_blocks = filter;
+		std::vector<float> expected = input;
+		std::vector<float> samples = input;
+
+		filter.applyArray(expected.data(), expected.size());
+		block_filter::apply(filter_blocks, samples.data(), samples.size(), threads);
+
+		for (size_t n = 0; n < input.size(); n++) {
+			ASSERT_NEAR(samples[n], expected[n], tolerance) << "sample " << n;
+		}
+
+		// the filter state after the array is the same
+		for (int n = 0; n < 100; n++) {
+			EXPECT_NEAR(filter_blocks.apply(input[n]), filter.apply(input[n]), tolerance);
+		}
+	}
+
+	static constexpr float _sample_freq = 1000.f;
+	const float _tolerance = 2e-5f * 3.f; // 2e-5 of the largest sample
+};
+
+constexpr float BlockFilterTest::_sample_freq;
+
+TEST_F(BlockFilterTest, lowPassMatchesSequential)
+{
+	const std::vector<float> input = signal(100000);
+	const float cutoff_freqs[4] {10.f, 30.f, 100.f, 400.f};
+
+	for (float cutoff_freq : cutoff_freqs) {
+		for (int threads : {1, 4}) {
+			LowPassFilter2p<float> lpf{_sample_freq, cutoff_freq};
+			lpf.reset(input[0]);
+			compare(lpf, input, threads, _tolerance);
+		}
+	}
+}
+
+TEST_F(BlockFilterTest, notchMatchesSequential)
+{
+	const std::vector<float> input = signal(100000);
+	const float notch_freqs[3] {10.f, 120.f, 400.f};
+
+	for (float notch_freq : notch_freqs) {
+		for (int threads : {1, 4}) {
+			NotchFilter<float> notch;
+			notch.setParameters(_sample_freq, notch_freq, 20.f);
+			compare(notch, input, threads, _tolerance);
+		}
+	}
+}
+
+TEST_F(BlockFilterTest, uneven)
+{
+	// blocks do not divide the array, the remainder is filtered sequentially
+	const std::vector<float> input = signal(8 * 256 * 3 + 77);
+	LowPassFilter2p<float> lpf{_sample_freq, 50.f};
+	compare(lpf, input, 1, _tolerance);
+	compare(lpf, input, 3, _tolerance);
+}
+
+TEST_F(BlockFilterTest, shortArrayIsSequential)
+{
+	const std::vector<float> input = signal(1000);
+	LowPassFilter2p<float> lpf{_sample_freq, 50.f};
+	compare(lpf, input, 1, 0.f);
+}
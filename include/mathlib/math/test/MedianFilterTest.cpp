@@ -42,6 +42,11 @@
 
 #include <lib/mathlib/math/filter/MedianFilter.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
 using namespace math;
 using matrix::Vector3f;
 
@@ -49,7 +54,28 @@ class MedianFilterTest : public ::testing::Test
 {
 public:
 
+	// median of the last WINDOW values (zero before the window is full) by sorting a copy
+	template<typename T, int WINDOW>
+	static T referenceMedian(const std::vector<T> &history)
+	{
+		std::vector<T> window(WINDOW, T{});
+		const int n = std::min<int>(WINDOW, history.size());
+		std::copy(history.end() - n, history.end(), window.end() - n);
+		std::nth_element(window.begin(), window.begin() + WINDOW / 2, window.end());
+		return window[WINDOW / 2];
+	}
+
+	template<typename T, int WINDOW>
+	static void compareWithReference(const std::vector<T> &samples)
+	{
+		MedianFilter<T, WINDOW> median_filter;
+		std::vector<T> history;
 
+		for (const T &sample : samples) {
+			history.push_back(sample);
+			ASSERT_EQ(median_filter.apply(sample), (referenceMedian<T, WINDOW>(history))) << "sample " << history.size();
+		}
+	}
 };
 
 TEST_F(MedianFilterTest, test3f_simple)
@@ -91,3 +117,60 @@ TEST_F(MedianFilterTest, test5i_100)
 		EXPECT_EQ(median_filter5.apply(i), max(0, i - 2));
 	}
 }
+
+TEST_F(MedianFilterTest, testRandomAgainstSort)
+{
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> uniform(-100.f, 100.f);
+	std::vector<float> samples(2000);
+
+	for (float &sample : samples) {
+		sample = uniform(generator);
+	}
+
+	// sorting network and sorted window
+	compareWithReference<float, 3>(samples);
+	compareWithReference<float, 5>(samples);
+	compareWithReference<float, 7>(samples);
+	compareWithReference<float, 9>(samples);
+	compareWithReference<float, 11>(samples);
+	compareWithReference<float, 31>(samples);
+	compareWithReference<float, 101>(samples);
+}
+
+TEST_F(MedianFilterTest, testDuplicates)
+{
+	std::mt19937 generator(7);
+	std::uniform_int_distribution<int> uniform(0, 4);
+	std::vector<uint16_t> samples(1000);
+
+	for (uint16_t &sample : samples) {
+		sample = uniform(generator);
+	}
+
+	compareWithReference<uint16_t, 5>(samples);
+	compareWithReference<uint16_t, 31>(samples);
+}
+
+TEST_F(MedianFilterTest, testNanLeavesWindow)
+{
+	std::mt19937 generator(3);
+	std::uniform_real_distribution<float> uniform(-100.f, 100.f);
+	std::uniform_int_distribution<int> position(0, 199);
+
+	for (int trial = 0; trial < 50; trial++) {
+		MedianFilter<float, 31> median_filter31;
+		std::vector<float> history;
+		const int nan_index = position(generator);
+
+		for (int n = 0; n < 400; n++) {
+			history.push_back(n == nan_index ? NAN : uniform(generator));
+			const float median = median_filter31.apply(history.back());
+
+			// once the NaN is out of the window the median is exact again
+			if (n >= nan_index + 31) {
+				ASSERT_EQ(median, (referenceMedian<float, 31>(history))) << "trial " << trial << " sample " << n;
+			}
+		}
+	}
+}
@@ -0,0 +1,468 @@
+/*
+* trajectory_index.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Nearest neighbour and interpolation queries over stored flight conditions
+
+#ifndef TRAJECTORY_INDEX_H
+#define TRAJECTORY_INDEX_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+
+#include "trajectory_library.h"
+
+namespace fpgm_collocation
+{
+    /** @brief Regular grid over D keys, multilinear interpolation
+     * interpolate() returns the 2^D corners around the query with their weights,
+     * corner indices are row-major like the trajectory_library entries
+    **/
+    template <int D>
+    class grid_index
+    {
+        public:
+            static const int corners = 1 << D;
+
+            grid_index() {}
+
+            grid_index(const double *min, const double *max, const int *count)
+            {
+                for (int a = 0; a < D; a++)
+                {
+                    axis_min[a] = min[a];
+                    axis_count[a] = std::max(count[a], 1);
+                    axis_scale[a] = axis_count[a] > 1 && max[a] != min[a] ?
+                        (axis_count[a] - 1) / (max[a] - min[a]) : 0.0;
+                }
+            }
+
+            /** @brief the grid stored in a trajectory_library header **/
+            static grid_index<D> from_library(const trajectory_library &library)
+            {
+                static_assert(D == (int)library_format::axis_count, "dimension of the library grid");
+                double min[D], max[D];
+                int count[D];
+                for (int a = 0; a < D; a++)
+                {
+                    trajectory_library::axis ax = library.get_axis(a);
+                    min[a] = ax.min;
+                    max[a] = ax.max;
+                    count[a] = ax.count;
+                }
+                return grid_index<D>(min, max, count);
+            }
+
+            /** @brief corners and multilinear weights, queries outside the grid are clamped **/
+            void interpolate(const double *key, size_t *index, double *weight) const
+            {
+                int base[D];
+                double fraction[D];
+                for (int a = 0; a < D; a++)
+                {
+                    double s = (key[a] - axis_min[a]) * axis_scale[a];
+                    s = std::max(0.0, std::min((double)(axis_count[a] - 1), s));
+                    base[a] = std::min((int)s, std::max(axis_count[a] - 2, 0));
+                    fraction[a] = axis_count[a] > 1 ? s - base[a] : 0.0;
+                }
+
+                for (int c = 0; c < corners; c++)
+                {
+                    size_t i = 0;
+                    double w = 1.0;
+                    for (int a = 0; a < D; a++)
+                    {
+                        int upper = (c >> (D - 1 - a)) & 1;
+                        int g = std::min(base[a] + upper, axis_count[a] - 1);
+                        i = i * axis_count[a] + g;
+                        w *= upper ? fraction[a] : 1.0 - fraction[a];
+                    }
+                    index[c] = i;
+                    weight[c] = w;
+                }
+            }
+
+        private:
+            double axis_min[D] = {};
+            double axis_scale[D] = {};
+            int axis_count[D] = {};
+    };
+
+    /** @brief Static k-d tree over scattered D dimensional keys
+     * - built once, nodes and the permuted keys are flat arrays so that the tree
+     * can be written next to the data with save() and mapped back with load()
+     * - every axis is scaled (e.g. by 1/span) so that m/s, deg and m are comparable
+     * - leaves hold up to leaf_size keys, knn() keeps a sorted list of at most max_k
+    **/
+    template <int D>
+    class kd_tree
+    {
+        public:
+            static const int leaf_size = 8;
+            static const int max_k = 16;
+
+            struct node
+            {
+                int32_t dimension; // -1 for a leaf
+                int32_t begin, end; // range in the permuted keys
+                int32_t left, right;
+                int32_t reserved;
+                double split;
+            };
+
+            kd_tree() {}
+
+            /** @brief build from count keys stored row by row
+             * @param scale per axis weight of the distance, nullptr for 1
+             * **/
+            void build(const double *keys, int count, const double *scale = nullptr)
+            {
+                nodes.clear();
+                points.assign(keys, keys + (size_t)count * D);
+                order.resize(count);
+                for (int i = 0; i < count; i++)
+                    order[i] = i;
+                for (int a = 0; a < D; a++)
+                    axis_scale[a] = scale ? scale[a] : 1.0;
+                for (int i = 0; i < count; i++)
+                    for (int a = 0; a < D; a++)
+                        points[(size_t)i * D + a] *= axis_scale[a];
+
+                if (count > 0)
+                    build_node(0, count);
+
+                // keys in leaf order so that a leaf scan is contiguous
+                std::vector<double> sorted((size_t)count * D);
+                for (int i = 0; i < count; i++)
+                    std::copy(points.begin() + (size_t)order[i] * D,
+                        points.begin() + (size_t)order[i] * D + D, sorted.begin() + (size_t)i * D);
+                points.swap(sorted);
+            }
+
+            int size() const { return (int)order.size(); }
+
+            /** @brief k nearest keys, sorted by distance
+             * @return number of neighbours found (<= k)
+             * **/
+            int knn(const double *key, int k, int *index, double *distance_squared) const
+            {
+                k = std::min(std::min(k, max_k), size());
+                if (k <= 0)
+                    return 0;
+
+                double query[D];
+                for (int a = 0; a < D; a++)
+                    query[a] = key[a] * axis_scale[a];
+
+                int found = 0;
+                int best_index[max_k];
+                double best_distance[max_k];
+                search(0, query, k, found, best_index, best_distance);
+
+                for (int i = 0; i < found; i++)
+                {
+                    index[i] = order[best_index[i]];
+                    distance_squared[i] = best_distance[i];
+                }
+                return found;
+            }
+
+            /** @brief inverse distance weights of the knn result, an exact match takes all the weight **/
+            static void inverse_distance_weights(const double *distance_squared, int found, double *weight)
+            {
+                double total = 0.0;
+                for (int i = 0; i < found; i++)
+                {
+                    if (distance_squared[i] <= 1E-24)
+                    {
+                        for (int j = 0; j < found; j++)
+                            weight[j] = j == i ? 1.0 : 0.0;
+                        return;
+                    }
+                    weight[i] = 1.0 / sqrt(distance_squared[i]);
+                    total += weight[i];
+                }
+                for (int i = 0; i < found; i++)
+                    weight[i] /= total;
+            }
+
+            /** @brief header (char[4] "KDTR", uint32 dimension, uint32 node count, uint32 key count),
+             * scale[D], nodes, permuted keys, order
+             * **/
+            bool save(const std::string &path) const
+            {
+                FILE *file = fopen(path.c_str(), "wb");
+                if (!file)
+                    return false;
+                uint32_t header[3] = {(uint32_t)D, (uint32_t)nodes.size(), (uint32_t)order.size()};
+                bool ok = fwrite("KDTR", 1, 4, file) == 4 &&
+                    fwrite(header, sizeof(uint32_t), 3, file) == 3 &&
+                    fwrite(axis_scale, sizeof(double), D, file) == (size_t)D &&
+                    fwrite(nodes.data(), sizeof(node), nodes.size(), file) == nodes.size() &&
+                    fwrite(points.data(), sizeof(double), points.size(), file) == points.size() &&
+                    fwrite(order.data(), sizeof(int32_t), order.size(), file) == order.size();
+                fclose(file);
+                return ok;
+            }
+
+            bool load(const std::string &path)
+            {
+                FILE *file = fopen(path.c_str(), "rb");
+                if (!file)
+                    return false;
+                // the counts are checked against the bytes left before anything is allocated
+                long file_size = -1;
+                if (fseek(file, 0, SEEK_END) == 0)
+                    file_size = ftell(file);
+                rewind(file);
+
+                char magic[4];
+                uint32_t header[3];
+                bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "KDTR", 4) == 0 &&
+                    fread(header, sizeof(uint32_t), 3, file) == 3 && header[0] == (uint32_t)D &&
+                    fread(axis_scale, sizeof(double), D, file) == (size_t)D;
+                if (ok)
+                {
+                    long position = ftell(file);
+                    uint64_t remaining = position >= 0 && file_size > position ? file_size - position : 0;
+                    uint64_t required = (uint64_t)header[1] * sizeof(node) +
+                        (uint64_t)header[2] * (D * sizeof(double) + sizeof(int32_t));
+                    ok = header[2] <= (uint32_t)std::numeric_limits<int32_t>::max() && required <= remaining &&
+                        (header[1] > 0) == (header[2] > 0);
+                }
+                if (ok)
+                {
+                    nodes.resize(header[1]);
+                    points.resize((size_t)header[2] * D);
+                    order.resize(header[2]);
+                    ok = fread(nodes.data(), sizeof(node), nodes.size(), file) == nodes.size() &&
+                        fread(points.data(), sizeof(double), points.size(), file) == points.size() &&
+                        fread(order.data(), sizeof(int32_t), order.size(), file) == order.size() &&
+                        valid();
+                }
+                fclose(file);
+                if (!ok)
+                {
+                    nodes.clear();
+                    points.clear();
+                    order.clear();
+                }
+                return ok;
+            }
+
+        private:
+
+            std::vector<node> nodes;
+            std::vector<double> points;
+            std::vector<int32_t> order;
+            double axis_scale[D] = {};
+
+            /** @brief the invariants of build() that search() relies on, children are stored after
+             * their parent (so the recursion ends) and split the range of the parent in two
+             * **/
+            bool valid() const
+            {
+                const int count = size();
+                if (count > 0 && (nodes[0].begin != 0 || nodes[0].end != count))
+                    return false;
+                for (int32_t i : order)
+                    if (i < 0 || i >= count)
+                        return false;
+
+                const int node_count = (int)nodes.size();
+                for (int id = 0; id < node_count; id++)
+                {
+                    const node &n = nodes[id];
+                    if (n.begin < 0 || n.begin > n.end || n.end > count)
+                        return false;
+                    if (n.dimension < 0)
+                        continue;
+                    if (n.dimension >= D || n.left <= id || n.right <= id ||
+                        n.left >= node_count || n.right >= node_count)
+                        return false;
+                    const node &left = nodes[n.left];
+                    const node &right = nodes[n.right];
+                    if (left.begin != n.begin || left.end != right.begin || right.end != n.end)
+                        return false;
+                }
+                return true;
+            }
+
+            int build_node(int begin, int end)
+            {
+                int id = (int)nodes.size();
+                nodes.push_back(node());
+                nodes[id].begin = begin;
+                nodes[id].end = end;
+                nodes[id].left = nodes[id].right = -1;
+                nodes[id].reserved = 0;
+                nodes[id].split = 0.0;
+
+                if (end - begin <= leaf_size)
+                {
+                    nodes[id].dimension = -1;
+                    return id;
+                }
+
+                // split the widest axis at the median
+                int dimension = 0;
+                double widest = -1.0;
+                for (int a = 0; a < D; a++)
+                {
+                    double low = std::numeric_limits<double>::infinity(), high = -low;
+                    for (int i = begin; i < end; i++)
+                    {
+                        double v = points[(size_t)order[i] * D + a];
+                        low = std::min(low, v);
+                        high = std::max(high, v);
+                    }
+                    if (high - low > widest)
+                    {
+                        widest = high - low;
+                        dimension = a;
+                    }
+                }
+
+                int middle = (begin + end) / 2;
+                const std::vector<double> &p = points;
+                std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                    [&p, dimension](int32_t a, int32_t b)
+                    { return p[(size_t)a * D + dimension] < p[(size_t)b * D + dimension]; });
+
+                nodes[id].dimension = dimension;
+                nodes[id].split = points[(size_t)order[middle] * D + dimension];
+                int left = build_node(begin, middle);
+                int right = build_node(middle, end);
+                nodes[id].left = left;
+                nodes[id].right = right;
+                return id;
+            }
+
+            void search(
+                int id, const double *query, int k, int &found,
+                int *best_index, double *best_distance) const
+            {
+                const node &n = nodes[id];
+                if (n.dimension < 0)
+                {
+                    for (int i = n.begin; i < n.end; i++)
+                    {
+                        const double *p = points.data() + (size_t)i * D;
+                        double d = 0.0;
+                        for (int a = 0; a < D; a++)
+                            d += (p[a] - query[a]) * (p[a] - query[a]);
+                        if (found == k && d >= best_distance[k - 1])
+                            continue;
+
+                        // insertion into the sorted list
+                        int j = found < k ? found++ : k - 1;
+                        while (j > 0 && best_distance[j - 1] > d)
+                        {
+                            best_distance[j] = best_distance[j - 1];
+                            best_index[j] = best_index[j - 1];
+                            j--;
+                        }
+                        best_distance[j] = d;
+                        best_index[j] = i;
+                    }
+                    return;
+                }
+
+                double difference = query[n.dimension] - n.split;
+                int near_child = difference < 0 ? n.left : n.right;
+                int far_child = difference < 0 ? n.right : n.left;
+                search(near_child, query, k, found, best_index, best_distance);
+                if (found < k || difference * difference < best_distance[k - 1])
+                    search(far_child, query, k, found, best_index, best_distance);
+            }
+    };
+
+    /** @brief Warm start for load_initial_guess blended from stored trajectories
+     * Every valid trajectory is resampled to the same number of knots over normalized time
+     * and summed with its weight, h is blended the same way
+     * Entries that failed to solve are dropped and the remaining weights renormalized
+    **/
+    struct warm_start
+    {
+        std::vector<double> guess; // [x, z, theta, phi, xdot, zdot, thetadot, phidot] per knot
+        std::vector<double> x, z; // positions for load_parameters (ix, iz)
+        int knots = 0;
+        double h = 0.0;
+
+        double total_time() const { return h * knots; }
+
+        static bool blend(
+            const trajectory_library &library, const size_t *index, const double *weight,
+            int count, warm_start &out, int knots = 0)
+        {
+            double total = 0.0;
+            double weighted_knots = 0.0;
+            for (int i = 0; i < count; i++)
+            {
+                trajectory_view v = library.get(index[i]);
+                if (v.valid() && weight[i] > 0)
+                {
+                    total += weight[i];
+                    weighted_knots += weight[i] * v.knots;
+                }
+            }
+            if (total <= 0)
+                return false;
+
+            out.knots = knots > 1 ? knots : std::max(2, (int)lround(weighted_knots / total));
+            out.h = 0.0;
+            out.guess.assign(8 * out.knots, 0.0);
+
+            for (int i = 0; i < count; i++)
+            {
+                trajectory_view v = library.get(index[i]);
+                if (!v.valid() || weight[i] <= 0)
+                    continue;
+                double w = weight[i] / total;
+                out.h += w * v.h * v.knots / out.knots;
+
+                for (int k = 0; k < out.knots; k++)
+                {
+                    double s = (double)k / (out.knots - 1) * (v.knots - 1);
+                    int lower = std::min((int)s, std::max(v.knots - 2, 0));
+                    int upper = std::min(lower + 1, v.knots - 1);
+                    double f = s - lower;
+                    for (int j = 0; j < 8; j++)
+                        out.guess[j+8*k] += w * ((1 - f) * v.channel[j][lower] + f * v.channel[j][upper]);
+                }
+            }
+
+            out.x.resize(out.knots);
+            out.z.resize(out.knots);
+            for (int k = 0; k < out.knots; k++)
+            {
+                out.x[k] = out.guess[0+8*k];
+                out.z[k] = out.guess[1+8*k];
+            }
+            return true;
+        }
+    };
+}
+
+#endif
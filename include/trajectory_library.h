@@ -0,0 +1,393 @@
+/*
+* trajectory_library.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Precomputed fpgm_collocation solutions over a grid of flight conditions
+
+#ifndef TRAJECTORY_LIBRARY_H
+#define TRAJECTORY_LIBRARY_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fpgm_collocation.h"
+
+namespace fpgm_collocation
+{
+    /** @brief File layout of the trajectory library, little endian, every block 64 byte aligned
+     * [library_header][library_axis * axis_count][library_entry * entry_count][trajectory data]
+     * - entries are row-major over the axes, the last axis changes fastest
+     * - the data of one entry is 8 arrays (x, z, theta, phi, vx, vz, thetadot, phidot),
+     * each of knots doubles, padded to channel_stride(knots) bytes
+     * - an entry with 0 knots is a grid point that failed to solve
+    **/
+    namespace library_format
+    {
+        const char magic[4] = {'F', 'P', 'T', 'L'};
+        const uint32_t version = 1;
+        const uint32_t alignment = 64;
+        // airspeed, descend_pitch_deg, height_of_descend, height_of_land
+        const uint32_t axis_count = 4;
+
+        struct library_header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t axis_count;
+            uint32_t entry_count;
+            uint64_t axis_offset;
+            uint64_t entry_offset;
+            uint64_t data_offset;
+            uint64_t file_size;
+            uint8_t reserved[16];
+        };
+
+        struct library_axis
+        {
+            double min;
+            double max;
+            uint32_t count;
+            uint32_t reserved;
+            uint8_t padding[8];
+        };
+
+        struct library_entry
+        {
+            uint64_t offset; // from the start of the file
+            uint32_t knots;
+            uint32_t converged;
+            double cost;
+            double h;
+            double key[axis_count];
+        };
+
+        static_assert(sizeof(library_header) == 64, "library_header must be 64 bytes");
+        static_assert(sizeof(library_axis) == 32, "library_axis must be 32 bytes");
+        static_assert(sizeof(library_entry) == 64, "library_entry must be 64 bytes");
+
+        inline uint64_t align(uint64_t size) { return (size + alignment - 1) / alignment * alignment; }
+
+        inline uint64_t channel_stride(uint32_t knots) { return align((uint64_t)knots * sizeof(double)); }
+
+        inline bool little_endian()
+        {
+            const uint16_t probe = 1;
+            return *(const uint8_t*)&probe == 1;
+        }
+    }
+
+    /** @brief Zero-copy view of one stored control_state, valid while the library is open **/
+    struct trajectory_view
+    {
+        int knots = 0;
+        bool converged = false;
+        double cost = 0.0;
+        double h = 0.0;
+        const double *key = nullptr;
+        // x, z, theta, phi, vx, vz, thetadot, phidot
+        const double *channel[8] = {};
+
+        bool valid() const { return knots > 0; }
+        const double *x() const { return channel[0]; }
+        const double *z() const { return channel[1]; }
+        const double *theta() const { return channel[2]; }
+        const double *phi() const { return channel[3]; }
+        const double *vx() const { return channel[4]; }
+        const double *vz() const { return channel[5]; }
+        const double *thetadot() const { return channel[6]; }
+        const double *phidot() const { return channel[7]; }
+
+        /** @brief copy into the decision vector layout of load_initial_guess **/
+        std::vector<double> to_guess() const
+        {
+            std::vector<double> guess(8 * knots);
+            for (int i = 0; i < knots; i++)
+                for (int j = 0; j < 8; j++)
+                    guess[j+8*i] = channel[j][i];
+            return guess;
+        }
+    };
+
+    class trajectory_library
+    {
+        public:
+
+            struct axis
+            {
+                double min;
+                double max;
+                int count;
+
+                double value(int i) const
+                {
+                    return count > 1 ? min + (max - min) * i / (count - 1) : min;
+                }
+            };
+
+            struct solution
+            {
+                fpgm_collocation::control_state state;
+                bool converged;
+                double cost;
+                double h;
+            };
+
+            trajectory_library() {}
+            ~trajectory_library() { close(); }
+            trajectory_library(const trajectory_library &) = delete;
+            trajectory_library &operator=(const trajectory_library &) = delete;
+
+            /** @brief write a library, solutions are row-major over the axes **/
+            static bool write(
+                const std::string &path, const std::vector<axis> &axes,
+                const std::vector<solution> &solutions)
+            {
+                using namespace library_format;
+                if (!little_endian() || axes.size() != axis_count)
+                    return false;
+
+                size_t entry_count = 1;
+                for (const axis &a : axes)
+                    entry_count *= (size_t)std::max(a.count, 1);
+                if (solutions.size() != entry_count)
+                    return false;
+
+                library_header header = {};
+                memcpy(header.magic, magic, 4);
+                header.version = version;
+                header.axis_count = axis_count;
+                header.entry_count = (uint32_t)entry_count;
+                header.axis_offset = align(sizeof(library_header));
+                header.entry_offset = align(header.axis_offset + axis_count * sizeof(library_axis));
+                header.data_offset = align(header.entry_offset + entry_count * sizeof(library_entry));
+
+                std::vector<library_axis> axis_block(axis_count);
+                for (uint32_t a = 0; a < axis_count; a++)
+                {
+                    axis_block[a] = {};
+                    axis_block[a].min = axes[a].min;
+                    axis_block[a].max = axes[a].max;
+                    axis_block[a].count = (uint32_t)std::max(axes[a].count, 1);
+                }
+
+                std::vector<library_entry> entries(entry_count);
+                uint64_t offset = header.data_offset;
+                for (size_t i = 0; i < entry_count; i++)
+                {
+                    const solution &s = solutions[i];
+                    library_entry &e = entries[i];
+                    e = {};
+                    e.knots = (uint32_t)s.state.x.size();
+                    e.converged = s.converged;
+                    e.cost = s.cost;
+                    e.h = s.h;
+                    e.offset = offset;
+                    // key from the row-major index
+                    size_t remainder = i;
+                    for (int a = (int)axis_count - 1; a >= 0; a--)
+                    {
+                        int count = (int)axis_block[a].count;
+                        e.key[a] = axes[a].value((int)(remainder % count));
+                        remainder /= count;
+                    }
+                    offset += 8 * channel_stride(e.knots);
+                }
+                header.file_size = offset;
+
+                FILE *file = fopen(path.c_str(), "wb");
+                if (!file)
+                    return false;
+
+                bool ok = true;
+                ok &= write_at(file, 0, &header, sizeof(header));
+                ok &= write_at(file, header.axis_offset, axis_block.data(), axis_count * sizeof(library_axis));
+                ok &= write_at(file, header.entry_offset, entries.data(), entry_count * sizeof(library_entry));
+
+                std::vector<double> padded;
+                for (size_t i = 0; i < entry_count && ok; i++)
+                {
+                    const fpgm_collocation::control_state &st = solutions[i].state;
+                    const std::vector<double> *channels[8] = {
+                        &st.x, &st.z, &st.theta, &st.phi, &st.vx, &st.vz, &st.thetadot, &st.phidot};
+                    uint64_t stride = channel_stride(entries[i].knots);
+                    padded.assign(stride / sizeof(double), 0.0);
+                    for (int j = 0; j < 8 && ok; j++)
+                    {
+                        if (channels[j]->size() != entries[i].knots)
+                            ok = false;
+                        else
+                        {
+                            std::copy(channels[j]->begin(), channels[j]->end(), padded.begin());
+                            ok &= write_at(file, entries[i].offset + j * stride, padded.data(), stride);
+                        }
+                    }
+                }
+                // alignment padding up to file_size when the last entries are empty
+                const uint8_t zero = 0;
+                if (ok && header.file_size > 0)
+                    ok &= write_at(file, header.file_size - 1, &zero, 1);
+                fclose(file);
+                return ok;
+            }
+
+            /** @brief mmap the library read-only and validate the header **/
+            bool open(const std::string &path)
+            {
+                using namespace library_format;
+                close();
+                if (!little_endian())
+                    return false;
+
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    return false;
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(library_header))
+                {
+                    ::close(fd);
+                    return false;
+                }
+
+                void *map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (map == MAP_FAILED)
+                    return false;
+
+                base = (const uint8_t*)map;
+                mapped_size = (size_t)st.st_size;
+
+                header = (const library_header*)base;
+                if (memcmp(header->magic, magic, 4) != 0 || header->version != version ||
+                    header->axis_count != axis_count || header->file_size != mapped_size ||
+                    header->axis_offset + axis_count * sizeof(library_axis) > mapped_size ||
+                    header->entry_offset + header->entry_count * sizeof(library_entry) > mapped_size)
+                {
+                    close();
+                    return false;
+                }
+
+                axes = (const library_axis*)(base + header->axis_offset);
+                entries = (const library_entry*)(base + header->entry_offset);
+
+                size_t expected = 1;
+                for (uint32_t a = 0; a < axis_count; a++)
+                    expected *= axes[a].count;
+                bool ok = expected == header->entry_count;
+                for (uint32_t i = 0; i < header->entry_count && ok; i++)
+                    ok = entries[i].offset % alignment == 0 &&
+                        entries[i].offset + 8 * channel_stride(entries[i].knots) <= mapped_size;
+                if (!ok)
+                    close();
+                return ok;
+            }
+
+            void close()
+            {
+                if (base)
+                    munmap((void*)base, mapped_size);
+                base = nullptr;
+                mapped_size = 0;
+                header = nullptr;
+                axes = nullptr;
+                entries = nullptr;
+            }
+
+            bool is_open() const { return base != nullptr; }
+
+            size_t size() const { return header ? header->entry_count : 0; }
+
+            axis get_axis(int a) const
+            {
+                axis out = {0.0, 0.0, 0};
+                if (axes && a >= 0 && a < (int)library_format::axis_count)
+                {
+                    out.min = axes[a].min;
+                    out.max = axes[a].max;
+                    out.count = (int)axes[a].count;
+                }
+                return out;
+            }
+
+            /** @brief row-major index of a grid point **/
+            size_t index(const int *grid) const
+            {
+                size_t i = 0;
+                for (uint32_t a = 0; a < library_format::axis_count; a++)
+                    i = i * axes[a].count + (size_t)grid[a];
+                return i;
+            }
+
+            /** @brief index of the closest grid point to [airspeed, pitch, height_of_descend, height_of_land] **/
+            size_t nearest(const double *key) const
+            {
+                int grid[library_format::axis_count];
+                for (uint32_t a = 0; a < library_format::axis_count; a++)
+                {
+                    int count = (int)axes[a].count;
+                    double span = axes[a].max - axes[a].min;
+                    double s = count > 1 && span != 0 ? (key[a] - axes[a].min) / span * (count - 1) : 0.0;
+                    grid[a] = std::max(0, std::min(count - 1, (int)lround(s)));
+                }
+                return index(grid);
+            }
+
+            trajectory_view get(size_t i) const
+            {
+                trajectory_view view;
+                if (!base || i >= size())
+                    return view;
+
+                const library_format::library_entry &e = entries[i];
+                view.knots = (int)e.knots;
+                view.converged = e.converged != 0;
+                view.cost = e.cost;
+                view.h = e.h;
+                view.key = e.key;
+                uint64_t stride = library_format::channel_stride(e.knots);
+                for (int j = 0; j < 8; j++)
+                    view.channel[j] = (const double*)(base + e.offset + j * stride);
+                return view;
+            }
+
+        private:
+
+            const uint8_t *base = nullptr;
+            size_t mapped_size = 0;
+            const library_format::library_header *header = nullptr;
+            const library_format::library_axis *axes = nullptr;
+            const library_format::library_entry *entries = nullptr;
+
+            static bool write_at(FILE *file, uint64_t offset, const void *data, size_t size)
+            {
+                return fseek(file, (long)offset, SEEK_SET) == 0 &&
+                    fwrite(data, 1, size, file) == size;
+            }
+    };
+}
+
+#endif
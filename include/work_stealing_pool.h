@@ -0,0 +1,104 @@
+/*
+* work_stealing_pool.h
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+
+// Thread pool for batches of independent solves with uneven run times
+
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+
+namespace fpgm_collocation
+{
+    /** @brief Fixed batch of jobs spread over per-thread deques
+     * - jobs are dealt round robin, a worker pops from the back of its own deque
+     * - an idle worker steals from the front of the other deques, so one slow
+     * solve does not hold back the jobs queued behind it
+     * - a job is an index, run() returns once every job has finished
+    **/
+    class work_stealing_pool
+    {
+        public:
+
+            explicit work_stealing_pool(int threads) :
+                queues(std::max(1, threads)) {}
+
+            int size() const { return (int)queues.size(); }
+
+            /** @brief run job(index, worker) for every index in jobs **/
+            void run(const std::vector<size_t> &jobs, std::function<void(size_t, int)> job)
+            {
+                for (size_t i = 0; i < jobs.size(); i++)
+                    queues[i % queues.size()].jobs.push_back(jobs[i]);
+
+                std::vector<std::thread> workers;
+                for (int w = 0; w < size(); w++)
+                    workers.push_back(std::thread([this, w, &job]()
+                    {
+                        size_t index;
+                        while (pop(w, index) || steal(w, index))
+                            job(index, w);
+                    }));
+                for (auto &t : workers)
+                    t.join();
+            }
+
+        private:
+
+            struct queue
+            {
+                std::mutex mutex;
+                std::deque<size_t> jobs;
+            };
+
+            std::vector<queue> queues;
+
+            bool pop(int w, size_t &index)
+            {
+                std::lock_guard<std::mutex> lock(queues[w].mutex);
+                if (queues[w].jobs.empty())
+                    return false;
+                index = queues[w].jobs.back();
+                queues[w].jobs.pop_back();
+                return true;
+            }
+
+            bool steal(int w, size_t &index)
+            {
+                for (int i = 1; i < size(); i++)
+                {
+                    queue &victim = queues[(w + i) % size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (victim.jobs.empty())
+                        continue;
+                    index = victim.jobs.front();
+                    victim.jobs.pop_front();
+                    return true;
+                }
+                return false;
+            }
+    };
+}
+
+#endif
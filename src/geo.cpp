@@ -43,6 +43,8 @@
  */
 
 #include "geo.h"
+#include "geo_trig.h"
+#include "geo_geodesic.h"
 
 #include <float.h>
 
@@ -58,17 +60,155 @@ using matrix::wrap_2pi;
  * formulas according to: http://mathworld.wolfram.com/AzimuthalEquidistantProjection.html
  */
 
+/**
+ * WGS84 with its series coefficients, evaluated on first use
+ */
+static const geo_geodesic::geodesic &wgs84()
+{
+	static const geo_geodesic::geodesic geodesic(CONSTANTS_WGS84_A, CONSTANTS_WGS84_F);
+	return geodesic;
+}
+
+/**
+ * lon_b - lon_a in degrees within [-180, 180]
+ */
+static double longitude_difference(double lon_a, double lon_b)
+{
+	return remainder(lon_b - lon_a, 360.0);
+}
+
 void MapProjection::initReference(double lat_0, double lon_0)
+{
+	initReference(lat_0, lon_0, Mode::AzimuthalEquidistant, 0.0);
+}
+
+void MapProjection::initReference(double lat_0, double lon_0, Mode mode, double radius)
 {
 	_ref_lat = math::radians(lat_0);
 	_ref_lon = math::radians(lon_0);
 	_ref_sin_lat = sin(_ref_lat);
 	_ref_cos_lat = cos(_ref_lat);
 	_ref_init_done = true;
+
+	_mode = mode;
+	_radius = radius;
+	_lt_lon2 = 0.5 * _ref_sin_lat * _ref_cos_lat;
+	_error_bound = 0.0;
+
+	// the series coefficients of wgs84() are only built for the ellipsoidal mode
+	if (_mode == Mode::Ellipsoidal) {
+		const geo_geodesic::point reference = wgs84().reduce(lat_0);
+		_ref_sin_beta = reference.sbet;
+		_ref_cos_beta = reference.cbet;
+		_ref_dn = reference.dn;
+		return;
+	}
+
+	if (_mode != Mode::LocalTangentPlane) {
+		return;
+	}
+
+	// the error of the series is of third order in the distance, largest on the circle of the radius.
+	// The azimuthal equidistant projection keeps range and bearing, a point at (radius, bearing)
+	// projects exactly to (radius cos(bearing), radius sin(bearing))
+	double error = 0.0;
+
+	for (int i = 0; i < 360; i++) {
+		const double bearing = math::radians((double)i);
+		const double x_exact = radius * cos(bearing);
+		const double y_exact = radius * sin(bearing);
+
+		double lat, lon;
+		waypoint_from_heading_and_distance_double(lat_0, lon_0, bearing, radius, &lat, &lon);
+
+		double x, y;
+		project_local_tangent(lat, lon, x, y);
+		error = math::max(error, sqrt((x - x_exact) * (x - x_exact) + (y - y_exact) * (y - y_exact)));
+
+		double lat_lt, lon_lt;
+		reproject_local_tangent(x_exact, y_exact, lat_lt, lon_lt);
+		const double d_n = math::radians(lat_lt - lat) * CONSTANTS_RADIUS_OF_EARTH;
+		const double d_e = math::radians(lon_lt - lon) * CONSTANTS_RADIUS_OF_EARTH * cos(math::radians(lat));
+		error = math::max(error, sqrt(d_n * d_n + d_e * d_e));
+	}
+
+	// margin for the bearings in between the samples
+	_error_bound = 1.1 * error;
+}
+
+void MapProjection::project_local_tangent(double lat, double lon, double &x, double &y) const
+{
+	const double d_lat = math::radians(lat) - _ref_lat;
+	const double d_lon = math::radians(lon) - _ref_lon;
+
+	x = (d_lat + _lt_lon2 * d_lon * d_lon) * CONSTANTS_RADIUS_OF_EARTH;
+	y = d_lon * (_ref_cos_lat - _ref_sin_lat * d_lat) * CONSTANTS_RADIUS_OF_EARTH;
+}
+
+void MapProjection::reproject_local_tangent(double x, double y, double &lat, double &lon) const
+{
+	const double x_rad = x / CONSTANTS_RADIUS_OF_EARTH;
+	const double y_rad = y / CONSTANTS_RADIUS_OF_EARTH;
+
+	// first order d_lon is enough for the second order term of d_lat
+	const double d_lon_0 = y_rad / _ref_cos_lat;
+	const double d_lat = x_rad - _lt_lon2 * d_lon_0 * d_lon_0;
+	const double d_lon = y_rad / (_ref_cos_lat - _ref_sin_lat * d_lat);
+
+	lat = math::degrees(_ref_lat + d_lat);
+	lon = math::degrees(_ref_lon + d_lon);
+}
+
+void MapProjection::project_ellipsoidal(double lat, double lon, double &x, double &y) const
+{
+	const geo_geodesic::point reference = {_ref_sin_beta, _ref_cos_beta, _ref_dn};
+
+	double s12, salp1, calp1, salp2, calp2;
+	wgs84().inverse(reference, wgs84().reduce(lat), longitude_difference(math::degrees(_ref_lon), lon),
+			s12, salp1, calp1, salp2, calp2);
+
+	x = s12 * calp1;
+	y = s12 * salp1;
+}
+
+void MapProjection::reproject_ellipsoidal(double x, double y, double &lat, double &lon) const
+{
+	const double s12 = sqrt(x * x + y * y);
+
+	if (!(s12 > 0)) {
+		lat = math::degrees(_ref_lat);
+		lon = math::degrees(_ref_lon);
+		return;
+	}
+
+	const geo_geodesic::point reference = {_ref_sin_beta, _ref_cos_beta, _ref_dn};
+
+	double lon12;
+	wgs84().direct(reference, y / s12, x / s12, s12, lat, lon12);
+	lon = math::degrees(_ref_lon) + lon12;
 }
 
 void MapProjection::project(double lat, double lon, float &x, float &y) const
 {
+	double x_d, y_d;
+	project_double(lat, lon, x_d, y_d);
+
+	x = static_cast<float>(x_d);
+	y = static_cast<float>(y_d);
+}
+
+void MapProjection::project_double(double lat, double lon, double &x, double &y) const
+{
+	if (_mode == Mode::LocalTangentPlane) {
+		project_local_tangent(lat, lon, x, y);
+		return;
+	}
+
+	if (_mode == Mode::Ellipsoidal) {
+		project_ellipsoidal(lat, lon, x, y);
+		return;
+	}
+
 	const double lat_rad = math::radians(lat);
 	const double lon_rad = math::radians(lon);
 
@@ -86,14 +226,29 @@ void MapProjection::project(double lat, double lon, float &x, float &y) const
 		k = (c / sin(c));
 	}
 
-	x = static_cast<float>(k * (_ref_cos_lat * sin_lat - _ref_sin_lat * cos_lat * cos_d_lon) * CONSTANTS_RADIUS_OF_EARTH);
-	y = static_cast<float>(k * cos_lat * sin(lon_rad - _ref_lon) * CONSTANTS_RADIUS_OF_EARTH);
+	x = k * (_ref_cos_lat * sin_lat - _ref_sin_lat * cos_lat * cos_d_lon) * CONSTANTS_RADIUS_OF_EARTH;
+	y = k * cos_lat * sin(lon_rad - _ref_lon) * CONSTANTS_RADIUS_OF_EARTH;
 }
 
 void MapProjection::reproject(float x, float y, double &lat, double &lon) const
 {
-	const double x_rad = (double)x / CONSTANTS_RADIUS_OF_EARTH;
-	const double y_rad = (double)y / CONSTANTS_RADIUS_OF_EARTH;
+	reproject_double(x, y, lat, lon);
+}
+
+void MapProjection::reproject_double(double x, double y, double &lat, double &lon) const
+{
+	if (_mode == Mode::LocalTangentPlane) {
+		reproject_local_tangent(x, y, lat, lon);
+		return;
+	}
+
+	if (_mode == Mode::Ellipsoidal) {
+		reproject_ellipsoidal(x, y, lat, lon);
+		return;
+	}
+
+	const double x_rad = x / CONSTANTS_RADIUS_OF_EARTH;
+	const double y_rad = y / CONSTANTS_RADIUS_OF_EARTH;
 	const double c = sqrt(x_rad * x_rad + y_rad * y_rad);
 
 	if (fabs(c) > 0) {
@@ -112,6 +267,112 @@ void MapProjection::reproject(float x, float y, double &lat, double &lon) const
 	}
 }
 
+void MapProjection::project_batch(const double *lat, const double *lon, float *x, float *y, size_t n) const
+{
+	// the inverse problem iterates, nothing to vectorize there
+	if (_mode != Mode::AzimuthalEquidistant) {
+		for (size_t i = 0; i < n; i++) {
+			project(lat[i], lon[i], x[i], y[i]);
+		}
+
+		return;
+	}
+
+	// sin(c) is the length of the (north, east) component, c = atan2(sin(c), cos(c))
+	// stays accurate close to the reference where acos(cos(c)) does not
+	for (size_t i = 0; i < n; i++) {
+		double sin_lat, cos_lat, sin_d_lon, cos_d_lon;
+		geo_trig::sincos(math::radians(lat[i]), sin_lat, cos_lat);
+		geo_trig::sincos(math::radians(lon[i]) - _ref_lon, sin_d_lon, cos_d_lon);
+
+		const double north = _ref_cos_lat * sin_lat - _ref_sin_lat * cos_lat * cos_d_lon;
+		const double east = cos_lat * sin_d_lon;
+		const double arg = _ref_sin_lat * sin_lat + _ref_cos_lat * cos_lat * cos_d_lon;
+
+		const double sin_c = sqrt(north * north + east * east);
+		const double c = geo_trig::atan2(sin_c, arg);
+		const double k = c / (sin_c > 0.0 ? sin_c : 1.0);
+
+		x[i] = static_cast<float>(k * north * CONSTANTS_RADIUS_OF_EARTH);
+		y[i] = static_cast<float>(k * east * CONSTANTS_RADIUS_OF_EARTH);
+	}
+}
+
+void MapProjection::reproject_batch(const float *x, const float *y, double *lat, double *lon, size_t n) const
+{
+	if (_mode != Mode::AzimuthalEquidistant) {
+		for (size_t i = 0; i < n; i++) {
+			reproject(x[i], y[i], lat[i], lon[i]);
+		}
+
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const double x_rad = (double)x[i] / CONSTANTS_RADIUS_OF_EARTH;
+		const double y_rad = (double)y[i] / CONSTANTS_RADIUS_OF_EARTH;
+		const double c = sqrt(x_rad * x_rad + y_rad * y_rad);
+
+		double sin_c, cos_c;
+		geo_trig::sincos(c, sin_c, cos_c);
+
+		// sin(c) / c, the reference itself falls out without a branch (x_rad = y_rad = 0)
+		const double sinc = sin_c / (c > 0.0 ? c : 1.0);
+
+		const double sin_lat = math::constrain(cos_c * _ref_sin_lat + x_rad * sinc * _ref_cos_lat, -1.0, 1.0);
+		const double cos_lat = sqrt((1.0 - sin_lat) * (1.0 + sin_lat));
+
+		lat[i] = math::degrees(geo_trig::atan2(sin_lat, cos_lat));
+		lon[i] = math::degrees(_ref_lon + geo_trig::atan2(y_rad * sinc,
+				       _ref_cos_lat * cos_c - x_rad * _ref_sin_lat * sinc));
+	}
+}
+
+/*
+ * Great circle from a start position and bearing, in the frame rotated by the start longitude
+ * the point at angle d along it is cos(d) start + sin(d) tangent,
+ * start = (cos(lat), 0, sin(lat)), tangent = (-cos(bearing) sin(lat), sin(bearing), cos(bearing) cos(lat))
+ */
+
+void GeodesicRay::init(double lat_start, double lon_start, double bearing)
+{
+	_lat_start = math::radians(lat_start);
+	_lon_start = math::radians(lon_start);
+	_sin_lat = sin(_lat_start);
+	_cos_lat = cos(_lat_start);
+	_sin_bearing = sin(bearing);
+	_cos_bearing = cos(bearing);
+}
+
+void GeodesicRay::waypoint(double dist, double &lat, double &lon) const
+{
+	const double radius_ratio = dist / CONSTANTS_RADIUS_OF_EARTH;
+	const double sin_d = sin(radius_ratio);
+	const double cos_d = cos(radius_ratio);
+
+	const double x = cos_d * _cos_lat - sin_d * _cos_bearing * _sin_lat;
+	const double y = sin_d * _sin_bearing;
+	const double z = cos_d * _sin_lat + sin_d * _cos_bearing * _cos_lat;
+
+	lat = math::degrees(atan2(z, sqrt(x * x + y * y)));
+	lon = math::degrees(_lon_start + atan2(y, x));
+}
+
+void GeodesicRay::waypoint_batch(const double *dist, double *lat, double *lon, size_t n) const
+{
+	for (size_t i = 0; i < n; i++) {
+		double sin_d, cos_d;
+		geo_trig::sincos(dist[i] / CONSTANTS_RADIUS_OF_EARTH, sin_d, cos_d);
+
+		const double x = cos_d * _cos_lat - sin_d * _cos_bearing * _sin_lat;
+		const double y = sin_d * _sin_bearing;
+		const double z = cos_d * _sin_lat + sin_d * _cos_bearing * _cos_lat;
+
+		lat[i] = math::degrees(geo_trig::atan2(z, sqrt(x * x + y * y)));
+		lon[i] = math::degrees(_lon_start + geo_trig::atan2(y, x));
+	}
+}
+
 float get_distance_to_next_waypoint(double lat_now, double lon_now, double lat_next, double lon_next)
 {
 	const double lat_now_rad = math::radians(lat_now);
@@ -128,6 +389,22 @@ float get_distance_to_next_waypoint(double lat_now, double lon_now, double lat_n
 	return static_cast<float>(CONSTANTS_RADIUS_OF_EARTH * 2.0 * c);
 }
 
+double get_distance_to_next_waypoint_ellipsoid(double lat_now, double lon_now, double lat_next, double lon_next)
+{
+	double s12, salp1, calp1, salp2, calp2;
+	wgs84().inverse(wgs84().reduce(lat_now), wgs84().reduce(lat_next), longitude_difference(lon_now, lon_next),
+			s12, salp1, calp1, salp2, calp2);
+	return s12;
+}
+
+double get_bearing_to_next_waypoint_ellipsoid(double lat_now, double lon_now, double lat_next, double lon_next)
+{
+	double s12, salp1, calp1, salp2, calp2;
+	wgs84().inverse(wgs84().reduce(lat_now), wgs84().reduce(lat_next), longitude_difference(lon_now, lon_next),
+			s12, salp1, calp1, salp2, calp2);
+	return atan2(salp1, calp1);
+}
+
 void create_waypoint_from_line_and_dist(double lat_A, double lon_A, double lat_B, double lon_B, float dist,
 					double *lat_target, double *lon_target)
 {
@@ -143,16 +420,22 @@ void create_waypoint_from_line_and_dist(double lat_A, double lon_A, double lat_B
 
 void waypoint_from_heading_and_distance(double lat_start, double lon_start, float bearing, float dist,
 					double *lat_target, double *lon_target)
+{
+	waypoint_from_heading_and_distance_double(lat_start, lon_start, (double)wrap_2pi(bearing), (double)dist,
+			lat_target, lon_target);
+}
+
+void waypoint_from_heading_and_distance_double(double lat_start, double lon_start, double bearing, double dist,
+					double *lat_target, double *lon_target)
 {
 	bearing = wrap_2pi(bearing);
-	double radius_ratio = static_cast<double>(dist) / CONSTANTS_RADIUS_OF_EARTH;
+	double radius_ratio = dist / CONSTANTS_RADIUS_OF_EARTH;
 
 	double lat_start_rad = math::radians(lat_start);
 	double lon_start_rad = math::radians(lon_start);
 
-	*lat_target = asin(sin(lat_start_rad) * cos(radius_ratio) + cos(lat_start_rad) * sin(radius_ratio) * cos((
-				   double)bearing));
-	*lon_target = lon_start_rad + atan2(sin((double)bearing) * sin(radius_ratio) * cos(lat_start_rad),
+	*lat_target = asin(sin(lat_start_rad) * cos(radius_ratio) + cos(lat_start_rad) * sin(radius_ratio) * cos(bearing));
+	*lon_target = lon_start_rad + atan2(sin(bearing) * sin(radius_ratio) * cos(lat_start_rad),
 					    cos(radius_ratio) - sin(lat_start_rad) * sin(*lat_target));
 
 	*lat_target = math::degrees(*lat_target);
@@ -207,12 +490,18 @@ get_vector_to_next_waypoint_fast(double lat_now, double lon_now, double lat_next
 
 void add_vector_to_global_position(double lat_now, double lon_now, float v_n, float v_e, double *lat_res,
 				   double *lon_res)
+{
+	add_vector_to_global_position_double(lat_now, lon_now, (double)v_n, (double)v_e, lat_res, lon_res);
+}
+
+void add_vector_to_global_position_double(double lat_now, double lon_now, double v_n, double v_e, double *lat_res,
+				   double *lon_res)
 {
 	double lat_now_rad = math::radians(lat_now);
 	double lon_now_rad = math::radians(lon_now);
 
-	*lat_res = math::degrees(lat_now_rad + (double)v_n / CONSTANTS_RADIUS_OF_EARTH);
-	*lon_res = math::degrees(lon_now_rad + (double)v_e / (CONSTANTS_RADIUS_OF_EARTH * cos(lat_now_rad)));
+	*lat_res = math::degrees(lat_now_rad + v_n / CONSTANTS_RADIUS_OF_EARTH);
+	*lon_res = math::degrees(lon_now_rad + v_e / (CONSTANTS_RADIUS_OF_EARTH * cos(lat_now_rad)));
 }
 
 // Additional functions - @author Doug Weibel <douglas.weibel@colorado.edu>
@@ -365,6 +654,188 @@ int get_distance_to_arc(struct crosstrack_error_s *crosstrack_error, double lat_
 	return return_value;
 }
 
+void init_crosstrack_line(struct crosstrack_line_s *line, double lat_start, double lon_start, double lat_end,
+			  double lon_end)
+{
+	const float bearing_track = get_bearing_to_next_waypoint(lat_start, lon_start, lat_end, lon_end);
+
+	line->lat_end = math::radians(lat_end);
+	line->lon_end = math::radians(lon_end);
+	line->sin_lat_end = sin(line->lat_end);
+	line->cos_lat_end = cos(line->lat_end);
+	line->sin_bearing_track = sin((double)bearing_track);
+	line->cos_bearing_track = cos((double)bearing_track);
+	line->bearing_right = wrap_pi(bearing_track - M_PI_2_F);
+	line->bearing_left = wrap_pi(bearing_track + M_PI_2_F);
+}
+
+void init_crosstrack_arc(struct crosstrack_arc_s *arc, double lat_center, double lon_center, float radius,
+			 float arc_start_bearing, float arc_sweep)
+{
+	arc->lat_center = math::radians(lat_center);
+	arc->lon_center = math::radians(lon_center);
+	arc->sin_lat_center = sin(arc->lat_center);
+	arc->cos_lat_center = cos(arc->lat_center);
+	arc->radius = radius;
+
+	// same sector as get_distance_to_arc
+	if (arc_sweep >= 0.0f) {
+		arc->bearing_sector_start = arc_start_bearing;
+		arc->bearing_sector_end = arc_start_bearing + arc_sweep;
+
+		if (arc->bearing_sector_end > 2.0f * M_PI_F) { arc->bearing_sector_end -= (2 * M_PI_F); }
+
+	} else {
+		arc->bearing_sector_end = arc_start_bearing;
+		arc->bearing_sector_start = arc_start_bearing - arc_sweep;
+
+		if (arc->bearing_sector_start < 0.0f) { arc->bearing_sector_start += (2 * M_PI_F); }
+	}
+
+	// same start and end points as get_distance_to_arc out of the sector
+	arc->start_lon_offset = (double)radius * sin((double)arc_start_bearing) / 111111.0;
+	arc->start_lat_offset = (double)radius * cos((double)arc_start_bearing) / 111111.0;
+	arc->end_lon_offset = (double)radius * sin((double)wrap_pi(arc_start_bearing + arc_sweep)) / 111111.0;
+	arc->end_lat_offset = (double)radius * cos((double)wrap_pi(arc_start_bearing + arc_sweep)) / 111111.0;
+}
+
+/**
+ * Haversine distance and the unnormalized (north, east) direction to the next point,
+ * shared by the batch functions through geo_trig.h
+ */
+static inline void distance_and_direction(double lat_now_rad, double sin_lat_now, double cos_lat_now,
+					  double lat_next_rad, double sin_lat_next, double cos_lat_next, double d_lon,
+					  float &distance, double &north, double &east)
+{
+	// half angles keep the haversine accurate for short distances, sin / cos of the
+	// full d_lon for the direction follow from them
+	double sin_half_d_lat, cos_half_d_lat, sin_half_d_lon, cos_half_d_lon;
+	geo_trig::sincos(0.5 * (lat_next_rad - lat_now_rad), sin_half_d_lat, cos_half_d_lat);
+	geo_trig::sincos(0.5 * d_lon, sin_half_d_lon, cos_half_d_lon);
+
+	const double a = math::constrain(sin_half_d_lat * sin_half_d_lat
+					 + sin_half_d_lon * sin_half_d_lon * cos_lat_now * cos_lat_next, 0.0, 1.0);
+	distance = static_cast<float>(CONSTANTS_RADIUS_OF_EARTH * 2.0 * geo_trig::atan2(sqrt(a), sqrt(1.0 - a)));
+
+	const double sin_d_lon = 2.0 * sin_half_d_lon * cos_half_d_lon;
+	const double cos_d_lon = 1.0 - 2.0 * sin_half_d_lon * sin_half_d_lon;
+	east = sin_d_lon * cos_lat_next;
+	north = cos_lat_now * sin_lat_next - sin_lat_now * cos_lat_next * cos_d_lon;
+}
+
+/**
+ * get_distance_to_next_waypoint and get_bearing_to_next_waypoint in one, see distance_and_direction
+ */
+static inline void distance_and_bearing(double lat_now_rad, double sin_lat_now, double cos_lat_now,
+					double lat_next_rad, double d_lon, float &distance, float &bearing)
+{
+	double sin_lat_next, cos_lat_next, north, east;
+	geo_trig::sincos(lat_next_rad, sin_lat_next, cos_lat_next);
+	distance_and_direction(lat_now_rad, sin_lat_now, cos_lat_now, lat_next_rad, sin_lat_next, cos_lat_next, d_lon,
+			       distance, north, east);
+	bearing = static_cast<float>(geo_trig::atan2(east, north));
+}
+
+int get_distance_to_line_batch(const struct crosstrack_line_s *line, const double *lat_now, const double *lon_now,
+			       float *distance, uint8_t *past_end, float *bearing, size_t n)
+{
+	int errors = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		const double lat_rad = math::radians(lat_now[i]);
+
+		double sin_lat, cos_lat;
+		geo_trig::sincos(lat_rad, sin_lat, cos_lat);
+
+		// bearing to the end point as an unnormalized (north, east) vector
+		float dist_to_end;
+		double north, east;
+		distance_and_direction(lat_rad, sin_lat, cos_lat, line->lat_end, line->sin_lat_end, line->cos_lat_end,
+				       line->lon_end - math::radians(lon_now[i]), dist_to_end, north, east);
+
+		const double norm = sqrt(north * north + east * east);
+		const double inv_norm = 1.0 / (norm > 0.0 ? norm : 1.0);
+
+		// sin / cos of bearing_track - bearing_end
+		const double sin_diff = (line->sin_bearing_track * north - line->cos_bearing_track * east) * inv_norm;
+		const double cos_diff = (line->cos_bearing_track * north + line->sin_bearing_track * east) * inv_norm;
+
+		const bool invalid = dist_to_end < 0.1f;
+		const bool past = !invalid && cos_diff < 0.0;
+		const bool on_line = !invalid && !past;
+
+		distance[i] = on_line ? dist_to_end * static_cast<float>(sin_diff) : 0.0f;
+		bearing[i] = on_line ? (sin_diff >= 0.0 ? line->bearing_right : line->bearing_left) : 0.0f;
+		past_end[i] = past ? 1 : 0;
+		errors += invalid ? 1 : 0;
+	}
+
+	return errors;
+}
+
+int get_distance_to_arc_batch(const struct crosstrack_arc_s *arc, const double *lat_now, const double *lon_now,
+			      float *distance, uint8_t *past_end, float *bearing, size_t n)
+{
+	if (arc->radius < 0.1f) {
+		for (size_t i = 0; i < n; i++) {
+			distance[i] = 0.0f;
+			past_end[i] = 0;
+			bearing[i] = 0.0f;
+		}
+
+		return static_cast<int>(n);
+	}
+
+	// copies, the outputs could alias *arc as far as the compiler knows
+	const crosstrack_arc_s c = *arc;
+	const bool sector_spans_zero = c.bearing_sector_end < c.bearing_sector_start;
+
+	for (size_t i = 0; i < n; i++) {
+		const double lat_rad = math::radians(lat_now[i]);
+		const double lon_rad = math::radians(lon_now[i]);
+
+		double sin_lat, cos_lat;
+		geo_trig::sincos(lat_rad, sin_lat, cos_lat);
+
+		float dist_to_center, bearing_now;
+		distance_and_bearing(lat_rad, sin_lat, cos_lat, c.lat_center, c.lon_center - lon_rad,
+				     dist_to_center, bearing_now);
+
+		// same sector test as get_distance_to_arc, bitwise so that there is no branch
+		const bool in_sector = sector_spans_zero ?
+				       ((bearing_now > c.bearing_sector_start) | (bearing_now < c.bearing_sector_end)) :
+				       ((bearing_now >= c.bearing_sector_start) & (bearing_now <= c.bearing_sector_end));
+
+		// in the sector, inside the circle the closest point is away from the center, wrap_pi(bearing_now + pi)
+		const bool inside = dist_to_center <= c.radius;
+		const float bearing_away = bearing_now >= 0.0f ? bearing_now - M_PI_F : bearing_now + M_PI_F;
+		const float distance_arc = inside ? c.radius - dist_to_center : dist_to_center - c.radius;
+		const float bearing_arc = inside ? bearing_away : bearing_now;
+
+		// out of the sector, the closer of the start and end points (cos of the latitude in degrees as
+		// get_distance_to_arc does)
+		double sin_lat_deg, cos_lat_deg;
+		geo_trig::sincos(lat_now[i], sin_lat_deg, cos_lat_deg);
+
+		float dist_to_start, bearing_start, dist_to_end, bearing_end;
+		distance_and_bearing(lat_rad, sin_lat, cos_lat, math::radians(lat_now[i] + c.start_lat_offset * cos_lat_deg),
+				     math::radians(c.start_lon_offset), dist_to_start, bearing_start);
+		distance_and_bearing(lat_rad, sin_lat, cos_lat, math::radians(lat_now[i] + c.end_lat_offset * cos_lat_deg),
+				     math::radians(c.end_lon_offset), dist_to_end, bearing_end);
+
+		const bool to_start = dist_to_start < dist_to_end;
+		const float distance_out = to_start ? dist_to_start : dist_to_end;
+		const float bearing_out = to_start ? bearing_start : bearing_end;
+
+		distance[i] = in_sector ? distance_arc : distance_out;
+		bearing[i] = in_sector ? bearing_arc : bearing_out;
+		// int arithmetic for the byte store, gcc does not vectorize a store of a bool expression here
+		past_end[i] = static_cast<uint8_t>((1 - static_cast<int>(in_sector)) * (1 - static_cast<int>(to_start)));
+	}
+
+	return 0;
+}
+
 float get_distance_to_point_global_wgs84(double lat_now, double lon_now, float alt_now,
 		double lat_next, double lon_next, float alt_next,
 		float *dist_xy, float *dist_z)
@@ -0,0 +1,267 @@
+/*
+* geo_benchmark.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+#include "geo.h"
+
+/**
+ * @brief Throughput and accuracy of the batched geo functions against the scalar ones
+ * Points are drawn uniformly in a disc of <radius> meters around the reference,
+ * "line" / "arc" evaluate 1000 of the points against 100 legs (the cross track batch functions),
+ * "project" / "distance" time the WGS84 (Mode::Ellipsoidal, _ellipsoid) functions against the spherical ones,
+ * "ray" compares GeodesicRay::waypoint_batch against waypoint_from_heading_and_distance,
+ * "tangent" compares the local tangent plane mode (as batch) against the full projection,
+ * every timing is the median of <repetitions> passes over all the points
+ * usage : ./obvp_geo_benchmark <points> <repetitions> <radius>
+ */
+
+static const double reference_lat = 47.397742;
+static const double reference_lon = 8.545594;
+
+static double median_time(int repetitions, std::function<void()> pass)
+{
+    std::vector<double> times;
+    for (int r = 0; r < repetitions; r++)
+    {
+        std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+        pass();
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+static void print_timing(const char *name, double scalar, double batch, size_t n, double error, const char *unit)
+{
+    printf("%-10s scalar %8.2lf ns/pt batch %8.2lf ns/pt speedup %5.2lfx max difference %.3e %s\n",
+        name, scalar / n * 1E9, batch / n * 1E9, scalar / batch, error, unit);
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? (size_t)std::max(1, atoi(argv[1])) : 100000;
+    int repetitions = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+    double radius = argc > 3 ? atof(argv[3]) : 10000.0;
+
+    MapProjection projection(reference_lat, reference_lon);
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<double> lat(n), lon(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        double range = radius * sqrt(unit(generator));
+        double bearing = 2.0 * M_PI * unit(generator);
+        waypoint_from_heading_and_distance(reference_lat, reference_lon,
+            (float)bearing, (float)range, &lat[i], &lon[i]);
+    }
+    printf("%zu points within %.0lfm, median of %d passes\n", n, radius, repetitions);
+
+    // project
+    std::vector<float> x_scalar(n), y_scalar(n), x_batch(n), y_batch(n);
+    double scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            projection.project(lat[i], lon[i], x_scalar[i], y_scalar[i]);
+    });
+    double batch = median_time(repetitions, [&]()
+    {
+        projection.project_batch(lat.data(), lon.data(), x_batch.data(), y_batch.data(), n);
+    });
+    double error = 0.0;
+    for (size_t i = 0; i < n; i++)
+        error = std::max(error, (double)std::max(
+            fabsf(x_scalar[i] - x_batch[i]), fabsf(y_scalar[i] - y_batch[i])));
+    print_timing("project", scalar, batch, n, error, "m");
+
+    // reproject
+    std::vector<double> lat_scalar(n), lon_scalar(n), lat_batch(n), lon_batch(n);
+    scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            projection.reproject(x_scalar[i], y_scalar[i], lat_scalar[i], lon_scalar[i]);
+    });
+    batch = median_time(repetitions, [&]()
+    {
+        projection.reproject_batch(x_scalar.data(), y_scalar.data(), lat_batch.data(), lon_batch.data(), n);
+    });
+    error = 0.0;
+    for (size_t i = 0; i < n; i++)
+        error = std::max(error, std::max(
+            fabs(lat_scalar[i] - lat_batch[i]), fabs(lon_scalar[i] - lon_batch[i])));
+    print_timing("reproject", scalar, batch, n, error, "deg");
+
+    // local tangent plane series against the full projection, both scalar
+    MapProjection local(reference_lat, reference_lon, MapProjection::Mode::LocalTangentPlane, radius);
+    std::vector<double> x_exact(n), y_exact(n), x_local(n), y_local(n);
+    scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            projection.project_double(lat[i], lon[i], x_exact[i], y_exact[i]);
+    });
+    batch = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            local.project_double(lat[i], lon[i], x_local[i], y_local[i]);
+    });
+    error = 0.0;
+    for (size_t i = 0; i < n; i++)
+        error = std::max(error, std::max(fabs(x_exact[i] - x_local[i]), fabs(y_exact[i] - y_local[i])));
+    print_timing("tangent", scalar, batch, n, error, "m");
+    printf("tangent plane error bound %.3e m\n", local.getErrorBound());
+
+    // WGS84 against the sphere, the difference is the error of the spherical functions
+    MapProjection ellipsoidal(reference_lat, reference_lon, MapProjection::Mode::Ellipsoidal, radius);
+    scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            projection.project_double(lat[i], lon[i], x_exact[i], y_exact[i]);
+    });
+    double ellipsoid = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            ellipsoidal.project_double(lat[i], lon[i], x_local[i], y_local[i]);
+    });
+    error = 0.0;
+    for (size_t i = 0; i < n; i++)
+        error = std::max(error, sqrt((x_exact[i] - x_local[i]) * (x_exact[i] - x_local[i])
+            + (y_exact[i] - y_local[i]) * (y_exact[i] - y_local[i])));
+    printf("%-10s sphere %8.2lf ns/pt wgs84 %8.2lf ns/pt ratio %5.2lfx max difference %.3e m\n",
+        "project", scalar / n * 1E9, ellipsoid / n * 1E9, ellipsoid / scalar, error);
+
+    std::vector<double> distance_sphere(n), distance_ellipsoid(n);
+    scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i + 1 < n; i++)
+            distance_sphere[i] = get_distance_to_next_waypoint(lat[i], lon[i], lat[i + 1], lon[i + 1]);
+    });
+    ellipsoid = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i + 1 < n; i++)
+            distance_ellipsoid[i] = get_distance_to_next_waypoint_ellipsoid(lat[i], lon[i], lat[i + 1], lon[i + 1]);
+    });
+    error = 0.0;
+    for (size_t i = 0; i + 1 < n; i++)
+        error = std::max(error, fabs(distance_sphere[i] - distance_ellipsoid[i]));
+    printf("%-10s sphere %8.2lf ns/pt wgs84 %8.2lf ns/pt ratio %5.2lfx max difference %.3e m\n",
+        "distance", scalar / n * 1E9, ellipsoid / n * 1E9, ellipsoid / scalar, error);
+
+    // points along one bearing, the distance only changes
+    std::vector<double> dist(n);
+    for (size_t i = 0; i < n; i++)
+        dist[i] = radius * unit(generator);
+    GeodesicRay ray(reference_lat, reference_lon, 1.0);
+    scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            waypoint_from_heading_and_distance_double(reference_lat, reference_lon, 1.0, dist[i],
+                &lat_scalar[i], &lon_scalar[i]);
+    });
+    batch = median_time(repetitions, [&]()
+    {
+        ray.waypoint_batch(dist.data(), lat_batch.data(), lon_batch.data(), n);
+    });
+    error = 0.0;
+    for (size_t i = 0; i < n; i++)
+        error = std::max(error, std::max(
+            fabs(lat_scalar[i] - lat_batch[i]), fabs(lon_scalar[i] - lon_batch[i])));
+    print_timing("ray", scalar, batch, n, error, "deg");
+    double ray_scalar = median_time(repetitions, [&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            ray.waypoint(dist[i], lat_batch[i], lon_batch[i]);
+    });
+    printf("%-10s GeodesicRay::waypoint %8.2lf ns/pt\n", "ray", ray_scalar / n * 1E9);
+
+    // cross track, every aircraft against every leg
+    const size_t aircraft = 1000, legs = 100;
+    std::vector<double> leg_lat(2 * legs), leg_lon(2 * legs);
+    std::vector<float> leg_radius(legs), leg_start(legs), leg_sweep(legs);
+    for (size_t j = 0; j < 2 * legs; j++)
+    {
+        double range = radius * sqrt(unit(generator));
+        double bearing = 2.0 * M_PI * unit(generator);
+        waypoint_from_heading_and_distance_double(reference_lat, reference_lon,
+            bearing, range, &leg_lat[j], &leg_lon[j]);
+    }
+    for (size_t j = 0; j < legs; j++)
+    {
+        leg_radius[j] = (float)(0.05 * radius + 0.1 * radius * unit(generator));
+        leg_start[j] = (float)(2.0 * M_PI * unit(generator));
+        leg_sweep[j] = (float)(M_PI * (2.0 * unit(generator) - 1.0));
+    }
+    std::vector<crosstrack_line_s> lines(legs);
+    std::vector<crosstrack_arc_s> arcs(legs);
+    for (size_t j = 0; j < legs; j++)
+    {
+        init_crosstrack_line(&lines[j], leg_lat[2 * j], leg_lon[2 * j], leg_lat[2 * j + 1], leg_lon[2 * j + 1]);
+        init_crosstrack_arc(&arcs[j], leg_lat[2 * j], leg_lon[2 * j], leg_radius[j], leg_start[j], leg_sweep[j]);
+    }
+    printf("cross track, %zu aircraft x %zu legs\n", aircraft, legs);
+
+    std::vector<crosstrack_error_s> crosstrack_scalar(aircraft * legs);
+    std::vector<float> distance_batch(aircraft * legs), bearing_batch(aircraft * legs);
+    std::vector<uint8_t> past_end_batch(aircraft * legs);
+    for (int arc = 0; arc < 2; arc++)
+    {
+        scalar = median_time(repetitions, [&]()
+        {
+            for (size_t j = 0; j < legs; j++)
+                for (size_t i = 0; i < aircraft; i++)
+                {
+                    if (arc)
+                        get_distance_to_arc(&crosstrack_scalar[j * aircraft + i], lat[i], lon[i],
+                            leg_lat[2 * j], leg_lon[2 * j], leg_radius[j], leg_start[j], leg_sweep[j]);
+                    else
+                        get_distance_to_line(&crosstrack_scalar[j * aircraft + i], lat[i], lon[i],
+                            leg_lat[2 * j], leg_lon[2 * j], leg_lat[2 * j + 1], leg_lon[2 * j + 1]);
+                }
+        });
+        batch = median_time(repetitions, [&]()
+        {
+            for (size_t j = 0; j < legs; j++)
+            {
+                size_t k = j * aircraft;
+                if (arc)
+                    get_distance_to_arc_batch(&arcs[j], lat.data(), lon.data(),
+                        &distance_batch[k], &past_end_batch[k], &bearing_batch[k], aircraft);
+                else
+                    get_distance_to_line_batch(&lines[j], lat.data(), lon.data(),
+                        &distance_batch[k], &past_end_batch[k], &bearing_batch[k], aircraft);
+            }
+        });
+        error = 0.0;
+        size_t past_end_mismatch = 0;
+        for (size_t k = 0; k < aircraft * legs; k++)
+        {
+            error = std::max(error, (double)fabsf(crosstrack_scalar[k].distance - distance_batch[k]));
+            past_end_mismatch += crosstrack_scalar[k].past_end != (past_end_batch[k] != 0) ? 1 : 0;
+        }
+        print_timing(arc ? "arc" : "line", scalar, batch, aircraft * legs, error, "m");
+        printf("%-10s past_end mismatches %zu\n", "", past_end_mismatch);
+    }
+
+    return 0;
+}
@@ -0,0 +1,368 @@
+/*
+* geo_test.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "geo.h"
+#include "geo_trig.h"
+
+/**
+ * @brief Precision checks of the geo functions, returns non zero if one fails
+ * usage : ./obvp_geo_test
+ */
+
+static const double reference_lat = 47.397742;
+static const double reference_lon = 8.545594;
+
+static int failures = 0;
+
+static void check(const char *name, double range, double error, double tolerance)
+{
+    bool pass = error <= tolerance;
+    printf("%-28s %6.0lfkm error %.3e m (tolerance %.1e m) %s\n",
+        name, range / 1000.0, error, tolerance, pass ? "ok" : "FAILED");
+    if (!pass)
+        failures++;
+}
+
+/** @brief distance in meters between two close positions, in double unlike get_distance_to_next_waypoint **/
+static double distance(double lat_a, double lon_a, double lat_b, double lon_b)
+{
+    double d_lat = math::radians(lat_b - lat_a);
+    double d_lon = math::radians(lon_b - lon_a) * cos(math::radians(lat_a));
+    return CONSTANTS_RADIUS_OF_EARTH * sqrt(d_lat * d_lat + d_lon * d_lon);
+}
+
+/**
+ * @brief the azimuthal equidistant plane keeps range and bearing from the reference,
+ * a point placed at (range, bearing) has to project to (range cos(bearing), range sin(bearing))
+ */
+static void double_precision(const MapProjection &projection, double range)
+{
+    double project_error = 0.0, round_trip_error = 0.0, vector_error = 0.0;
+    double float_error = 0.0;
+    for (int i = 0; i < 36; i++)
+    {
+        double bearing = math::radians(10.0 * i + 3.0);
+        double lat, lon;
+        waypoint_from_heading_and_distance_double(reference_lat, reference_lon, bearing, range, &lat, &lon);
+
+        double x, y;
+        projection.project_double(lat, lon, x, y);
+        project_error = std::max(project_error,
+            std::max(fabs(x - range * cos(bearing)), fabs(y - range * sin(bearing))));
+
+        float x_f, y_f;
+        projection.project(lat, lon, x_f, y_f);
+        float_error = std::max(float_error,
+            std::max(fabs((double)x_f - range * cos(bearing)), fabs((double)y_f - range * sin(bearing))));
+
+        double lat_back, lon_back;
+        projection.reproject_double(x, y, lat_back, lon_back);
+        round_trip_error = std::max(round_trip_error, distance(lat, lon, lat_back, lon_back));
+
+        // the offset is applied on the local tangent, check it back against the same scale
+        double v_n = 0.001 * range * cos(bearing), v_e = 0.001 * range * sin(bearing);
+        double lat_res, lon_res;
+        add_vector_to_global_position_double(lat, lon, v_n, v_e, &lat_res, &lon_res);
+        double n = math::radians(lat_res - lat) * CONSTANTS_RADIUS_OF_EARTH;
+        double e = math::radians(lon_res - lon) * CONSTANTS_RADIUS_OF_EARTH * cos(math::radians(lat));
+        vector_error = std::max(vector_error, std::max(fabs(n - v_n), fabs(e - v_e)));
+    }
+
+    check("project (double)", range, project_error, 1e-6);
+    check("project -> reproject", range, round_trip_error, 1e-6);
+    check("add_vector_to_global_position", range, vector_error, 1e-6);
+    // the float overload is only as good as a float at that range
+    check("project (float)", range, float_error, range * FLT_EPSILON);
+}
+
+/**
+ * @brief the local tangent plane series has to stay within the bound it reports, against
+ * the full projection at points inside the configured radius
+ */
+static void local_tangent_plane(double radius)
+{
+    MapProjection exact(reference_lat, reference_lon);
+    MapProjection local(reference_lat, reference_lon, MapProjection::Mode::LocalTangentPlane, radius);
+
+    double error = 0.0;
+    for (int i = 0; i < 20; i++)
+    {
+        for (int j = 0; j < 97; j++)
+        {
+            double range = radius * (i + 1) / 20.0;
+            double bearing = math::radians(3.7 * j);
+            double lat, lon;
+            waypoint_from_heading_and_distance_double(reference_lat, reference_lon, bearing, range, &lat, &lon);
+
+            double x, y, x_local, y_local;
+            exact.project_double(lat, lon, x, y);
+            local.project_double(lat, lon, x_local, y_local);
+            error = std::max(error, sqrt((x - x_local) * (x - x_local) + (y - y_local) * (y - y_local)));
+
+            double lat_local, lon_local;
+            local.reproject_double(x, y, lat_local, lon_local);
+            error = std::max(error, distance(lat, lon, lat_local, lon_local));
+        }
+    }
+
+    check("local tangent plane", radius, error, local.getErrorBound());
+}
+
+/**
+ * @brief the batch cross track functions against the scalar ones, the scalar bearings go through
+ * atan2f / sinf (a few float ulp of pi) so the distances are compared at 10 float ulp of the range
+ */
+static void crosstrack_batch(double radius)
+{
+    const size_t n = 512;
+    std::vector<double> lat(n), lon(n);
+    for (size_t i = 0; i < n; i++)
+        waypoint_from_heading_and_distance_double(reference_lat, reference_lon,
+            math::radians(7.3 * i), radius * (i % 64 + 1) / 64.0, &lat[i], &lon[i]);
+
+    double lat_end, lon_end;
+    waypoint_from_heading_and_distance_double(reference_lat, reference_lon, 0.3, 0.5 * radius, &lat_end, &lon_end);
+
+    crosstrack_line_s line;
+    crosstrack_arc_s arc;
+    init_crosstrack_line(&line, reference_lat, reference_lon, lat_end, lon_end);
+    init_crosstrack_arc(&arc, lat_end, lon_end, (float)(0.2 * radius), 0.5f, 2.0f);
+
+    std::vector<float> distance(n), bearing(n);
+    std::vector<uint8_t> past_end(n);
+    for (int is_arc = 0; is_arc < 2; is_arc++)
+    {
+        if (is_arc)
+            get_distance_to_arc_batch(&arc, lat.data(), lon.data(), distance.data(), past_end.data(), bearing.data(), n);
+        else
+            get_distance_to_line_batch(&line, lat.data(), lon.data(), distance.data(), past_end.data(), bearing.data(), n);
+
+        double error = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            crosstrack_error_s crosstrack;
+            if (is_arc)
+                get_distance_to_arc(&crosstrack, lat[i], lon[i], lat_end, lon_end, (float)(0.2 * radius), 0.5f, 2.0f);
+            else
+                get_distance_to_line(&crosstrack, lat[i], lon[i], reference_lat, reference_lon, lat_end, lon_end);
+            error = std::max(error, (double)fabsf(crosstrack.distance - distance[i]));
+            // a flipped past_end counts as a failure
+            if (crosstrack.past_end != (past_end[i] != 0))
+                error = INFINITY;
+        }
+        check(is_arc ? "get_distance_to_arc_batch" : "get_distance_to_line_batch", radius, error, 10.0 * radius * FLT_EPSILON);
+    }
+}
+
+/**
+ * @brief project_batch / reproject_batch against the scalar float functions, the azimuthal
+ * equidistant path goes through geo_trig (a few double ulp, so at most one float ulp of the range
+ * after the cast), the local tangent plane path falls back to the scalar functions and is exact
+ */
+static void projection_batch(MapProjection::Mode mode, const char *name, double range)
+{
+    MapProjection projection(reference_lat, reference_lon, mode, range);
+
+    const size_t n = 256;
+    std::vector<double> lat(n), lon(n), lat_batch(n), lon_batch(n);
+    std::vector<float> x(n), y(n), x_batch(n), y_batch(n);
+    for (size_t i = 0; i < n; i++)
+        waypoint_from_heading_and_distance_double(reference_lat, reference_lon,
+            math::radians(7.3 * i), range * (i % 32) / 31.0, &lat[i], &lon[i]);
+
+    projection.project_batch(lat.data(), lon.data(), x_batch.data(), y_batch.data(), n);
+    projection.reproject_batch(x_batch.data(), y_batch.data(), lat_batch.data(), lon_batch.data(), n);
+
+    double project_error = 0.0, reproject_error = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        projection.project(lat[i], lon[i], x[i], y[i]);
+        project_error = std::max(project_error,
+            std::max(fabs((double)x[i] - x_batch[i]), fabs((double)y[i] - y_batch[i])));
+
+        // both from the same float input
+        double lat_scalar, lon_scalar;
+        projection.reproject(x_batch[i], y_batch[i], lat_scalar, lon_scalar);
+        reproject_error = std::max(reproject_error, distance(lat_scalar, lon_scalar, lat_batch[i], lon_batch[i]));
+    }
+
+    bool exact = mode != MapProjection::Mode::AzimuthalEquidistant;
+    std::string project_name = std::string(name) + " project_batch";
+    std::string reproject_name = std::string(name) + " reproject_batch";
+    check(project_name.c_str(), range, project_error, exact ? 0.0 : range * FLT_EPSILON);
+    check(reproject_name.c_str(), range, reproject_error, exact ? 0.0 : 1e-6);
+}
+
+/**
+ * @brief geo_trig::atan2 against libm on the axes, where only the signs of the zeros decide
+ */
+static void atan2_signed_zero()
+{
+    const double values[4] = {0.0, -0.0, 1.0, -1.0};
+    double error = 0.0;
+    for (double y : values)
+    {
+        for (double x : values)
+        {
+            double expected = atan2(y, x), result = geo_trig::atan2(y, x);
+            error = std::max(error, fabs(expected - result));
+            // -0.0 against 0.0
+            if (signbit(expected) != signbit(result))
+                error = INFINITY;
+        }
+    }
+    check("geo_trig::atan2 signed zero", 0.0, error, 1e-15);
+}
+
+/**
+ * @brief points along a GeodesicRay against waypoint_from_heading_and_distance
+ */
+static void geodesic_ray(double range)
+{
+    double error = 0.0, batch_error = 0.0;
+    for (int i = 0; i < 36; i++)
+    {
+        double bearing = math::radians(10.0 * i + 3.0);
+        GeodesicRay ray(reference_lat, reference_lon, bearing);
+
+        double dist[8], lat_batch[8], lon_batch[8];
+        for (int j = 0; j < 8; j++)
+            dist[j] = range * (j - 2) / 5.0;
+        ray.waypoint_batch(dist, lat_batch, lon_batch, 8);
+
+        for (int j = 0; j < 8; j++)
+        {
+            double lat, lon, lat_ray, lon_ray;
+            waypoint_from_heading_and_distance_double(reference_lat, reference_lon, bearing, dist[j], &lat, &lon);
+            ray.waypoint(dist[j], lat_ray, lon_ray);
+            error = std::max(error, distance(lat, lon, lat_ray, lon_ray));
+            batch_error = std::max(batch_error, distance(lat, lon, lat_batch[j], lon_batch[j]));
+        }
+    }
+
+    check("GeodesicRay::waypoint", range, error, 1e-6);
+    check("GeodesicRay::waypoint_batch", range, batch_error, 1e-6);
+}
+
+/**
+ * @brief Vincenty's inverse formula on WGS84 (accurate to 0.1 mm away from antipodal points),
+ * an independent reference for the series of geo_geodesic.h
+ */
+static double vincenty_distance(double lat_1, double lon_1, double lat_2, double lon_2)
+{
+    const double a = CONSTANTS_WGS84_A, f = CONSTANTS_WGS84_F, b = a * (1 - f);
+    const double L = math::radians(lon_2 - lon_1);
+    const double U1 = atan((1 - f) * tan(math::radians(lat_1)));
+    const double U2 = atan((1 - f) * tan(math::radians(lat_2)));
+    const double sin_U1 = sin(U1), cos_U1 = cos(U1), sin_U2 = sin(U2), cos_U2 = cos(U2);
+
+    double lambda = L, lambda_previous, sin_sigma, cos_sigma, sigma, cos2_alpha, cos_2sigma_m;
+    int iterations = 0;
+    do
+    {
+        const double sin_lambda = sin(lambda), cos_lambda = cos(lambda);
+        const double t = cos_U1 * sin_U2 - sin_U1 * cos_U2 * cos_lambda;
+        sin_sigma = sqrt(cos_U2 * sin_lambda * cos_U2 * sin_lambda + t * t);
+        if (sin_sigma == 0)
+            return 0;
+        cos_sigma = sin_U1 * sin_U2 + cos_U1 * cos_U2 * cos_lambda;
+        sigma = atan2(sin_sigma, cos_sigma);
+        const double sin_alpha = cos_U1 * cos_U2 * sin_lambda / sin_sigma;
+        cos2_alpha = 1 - sin_alpha * sin_alpha;
+        cos_2sigma_m = cos2_alpha != 0 ? cos_sigma - 2 * sin_U1 * sin_U2 / cos2_alpha : 0;
+        const double C = f / 16 * cos2_alpha * (4 + f * (4 - 3 * cos2_alpha));
+        lambda_previous = lambda;
+        lambda = L + (1 - C) * f * sin_alpha *
+            (sigma + C * sin_sigma * (cos_2sigma_m + C * cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)));
+    } while (fabs(lambda - lambda_previous) > 1e-14 && ++iterations < 200);
+
+    const double u2 = cos2_alpha * (a * a - b * b) / (b * b);
+    const double A = 1 + u2 / 16384 * (4096 + u2 * (-768 + u2 * (320 - 175 * u2)));
+    const double B = u2 / 1024 * (256 + u2 * (-128 + u2 * (74 - 47 * u2)));
+    const double delta_sigma = B * sin_sigma * (cos_2sigma_m + B / 4 * (cos_sigma * (-1 + 2 * cos_2sigma_m * cos_2sigma_m)
+        - B / 6 * cos_2sigma_m * (-3 + 4 * sin_sigma * sin_sigma) * (-3 + 4 * cos_2sigma_m * cos_2sigma_m)));
+    return b * A * (sigma - delta_sigma);
+}
+
+/**
+ * @brief the WGS84 functions against Vincenty, and the ellipsoidal projection back and forth
+ */
+static void ellipsoid(double range)
+{
+    MapProjection projection(reference_lat, reference_lon, MapProjection::Mode::Ellipsoidal, range);
+
+    double distance_error = 0.0, projection_error = 0.0, round_trip_error = 0.0;
+    for (int i = 0; i < 36; i++)
+    {
+        double bearing = math::radians(10.0 * i + 3.0);
+        double x = range * cos(bearing), y = range * sin(bearing);
+
+        // the projection keeps the geodesic distance from the reference
+        double lat, lon;
+        projection.reproject_double(x, y, lat, lon);
+        projection_error = std::max(projection_error, fabs(vincenty_distance(reference_lat, reference_lon, lat, lon) - range));
+
+        double x_back, y_back;
+        projection.project_double(lat, lon, x_back, y_back);
+        round_trip_error = std::max(round_trip_error, sqrt((x - x_back) * (x - x_back) + (y - y_back) * (y - y_back)));
+
+        // a pair of points that does not contain the reference
+        double lat_b, lon_b;
+        projection.reproject_double(-0.3 * y, 0.5 * x, lat_b, lon_b);
+        distance_error = std::max(distance_error, fabs(get_distance_to_next_waypoint_ellipsoid(lat, lon, lat_b, lon_b)
+            - vincenty_distance(lat, lon, lat_b, lon_b)));
+    }
+
+    check("ellipsoid distance", range, distance_error, 1e-4);
+    check("ellipsoid projection", range, projection_error, 1e-4);
+    check("ellipsoid round trip", range, round_trip_error, 1e-6);
+}
+
+int main(int argc, char **argv)
+{
+    MapProjection projection(reference_lat, reference_lon);
+
+    double ranges[3] = {1000.0, 10000.0, 100000.0};
+    for (double range : ranges)
+    {
+        double_precision(projection, range);
+        projection_batch(MapProjection::Mode::AzimuthalEquidistant, "AE", range);
+        projection_batch(MapProjection::Mode::LocalTangentPlane, "LTP", range);
+        geodesic_ray(range);
+        ellipsoid(range);
+    }
+
+    // quarter meridian and one degree of the equator of WGS84
+    check("ellipsoid meridian", 10001965.729, fabs(get_distance_to_next_waypoint_ellipsoid(0, 0, 90, 0) - 10001965.729313), 1e-6);
+    check("ellipsoid equator", 111319.491, fabs(get_distance_to_next_waypoint_ellipsoid(0, 0, 0, 1)
+        - CONSTANTS_WGS84_A * M_PI / 180.0), 1e-6);
+
+    local_tangent_plane(2000.0);
+    local_tangent_plane(10000.0);
+
+    crosstrack_batch(2000.0);
+    atan2_signed_zero();
+
+    printf("%d failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -91,9 +91,9 @@ int main(int argc, char **argv)
     dive_position(2) = height_of_descend;
 
     double descend_bearing_backwards = wrap_pi(descend_bearing_rad-3.14);
-    waypoint_from_heading_and_distance(
+    waypoint_from_heading_and_distance_double(
         WS_LAT_P_LAND, WS_LONG_P_LAND, descend_bearing_backwards, 
-        (float)distance_to_land_from_dive, &dive_position(0), &dive_position(1));
+        distance_to_land_from_dive, &dive_position(0), &dive_position(1));
 
     matrix::Vector3d velocity_global = 
         velocity_in_global_frame(0.0, descend_pitch_rad, descend_bearing_rad, airspeed);
@@ -103,9 +103,8 @@ int main(int argc, char **argv)
         matrix::Vector3d(0, 0, landing_position(2));
     if (_global_local_proj_ref.isInitialized()) 
     {
-        matrix::Vector2f pos_local = _global_local_proj_ref.project(dive_position(0), dive_position(1));
-        dive_position_local(0) = (double)pos_local(0);
-        dive_position_local(1) = (double)pos_local(1);
+        _global_local_proj_ref.project_double(dive_position(0), dive_position(1),
+            dive_position_local(0), dive_position_local(1));
         dive_position_local(2) = dive_position(2);
     }
 
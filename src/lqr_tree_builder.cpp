@@ -0,0 +1,139 @@
+/*
+* lqr_tree_builder.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "fpgm_collocation.h"
+#include "fpgm_sqp.h"
+#include "fpgm_tvlqr.h"
+#include "landing_problem.h"
+#include "lqr_tree.h"
+
+/**
+ * @brief Offline LQR-tree builder
+ * Initial conditions are sampled around parameters.yaml (airspeed, descend pitch and
+ * height of descend), each one is solved with the native sqp, stabilized with TVLQR
+ * and given a funnel estimated by closed loop simulation
+ * Samples are independent, they are handed out to one worker per core
+ * usage : ./obvp_lqr_tree_builder <trajectories> <output file> <threads>
+ */
+
+struct sampling_range
+{
+    double airspeed = 3.0; // +- m/s
+    double descend_pitch_deg = 10.0; // +- deg
+    double height_of_descend = 3.0; // +- m
+};
+
+int main(int argc, char **argv)
+{
+    int trajectories = argc > 1 ? std::max(1, atoi(argv[1])) : 32;
+    std::string output = argc > 2 ? std::string(argv[2]) : "lqr_tree.bin";
+    int threads = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    threads = std::max(1, threads);
+
+    std::string params_directory = "parameters.yaml";
+    fpgm_collocation::landing_problem::landing_settings nominal;
+    if (!fpgm_collocation::landing_problem::load_settings(params_directory, nominal))
+        return -1;
+
+    sampling_range range;
+    fpgm_collocation::funnel_options funnel;
+
+    std::vector<fpgm_collocation::gain_schedule> schedules(trajectories);
+    std::vector<double> rho(trajectories, 0.0);
+    std::vector<char> solved(trajectories, 0);
+
+    std::atomic<int> next(0);
+    std::mutex print_mutex;
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+    auto worker = [&]()
+    {
+        for (int i = next++; i < trajectories; i = next++)
+        {
+            // seeded by the sample index so the tree does not depend on the thread count
+            std::mt19937 generator(i);
+            std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+            fpgm_collocation::landing_problem::landing_settings settings = nominal;
+            settings.airspeed += range.airspeed * uniform(generator);
+            settings.descend_pitch_deg += range.descend_pitch_deg * uniform(generator);
+            settings.height_of_descend += range.height_of_descend * uniform(generator);
+
+            fpgm_collocation::fpgm_collocation fpgm;
+            fpgm_collocation::fpgm_collocation::control_state control_guess;
+            fpgm_collocation::landing_problem problem;
+            problem.verbose = false;
+            if (!problem.setup(settings, params_directory, fpgm, control_guess))
+                continue;
+
+            fpgm_collocation::fpgm_sqp sqp(fpgm.get_parameters(), fpgm.get_boundary());
+            fpgm_collocation::fpgm_collocation::control_state control_opt =
+                sqp.solve(fpgm.get_initial_guess());
+            if (!sqp.get_report().converged)
+                continue;
+
+            if (!fpgm_collocation::fpgm_tvlqr::compute(control_opt, fpgm.get_parameters(), schedules[i]))
+                continue;
+
+            fpgm_collocation::funnel_options options = funnel;
+            options.seed = (unsigned int)i;
+            rho[i] = fpgm_collocation::lqr_tree::estimate_funnel(
+                schedules[i], fpgm.get_parameters(), fpgm.get_boundary(), options);
+            solved[i] = rho[i] > 0;
+
+            std::lock_guard<std::mutex> lock(print_mutex);
+            printf("[%d] airspeed %lf pitch %lf height %lf cost %lf rho %lf\n", i,
+                settings.airspeed, settings.descend_pitch_deg, settings.height_of_descend,
+                sqp.get_report().cost, rho[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++)
+        pool.push_back(std::thread(worker));
+    for (auto &t : pool)
+        t.join();
+
+    fpgm_collocation::lqr_tree tree;
+    for (int i = 0; i < trajectories; i++)
+        if (solved[i])
+            tree.add(schedules[i], rho[i]);
+
+    double build_time = std::chrono::duration<double>(
+        std::chrono::system_clock::now() - start).count();
+    printf("%d / %d trajectories in the tree, %d threads, %lfs\n",
+        (int)tree.size(), trajectories, threads, build_time);
+
+    if (!tree.save(output))
+    {
+        printf("failed to write %s\n", output.c_str());
+        return -1;
+    }
+    printf("saved %s\n", output.c_str());
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+* monte_carlo.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "fpgm_collocation.h"
+#include "fpgm_simulator.h"
+#include "fpgm_tvlqr.h"
+#include "landing_problem.h"
+
+/**
+ * @brief Flies the optimized control_state through the continuous model
+ * - the nominal is integrated with rk45 and compared with the planned knots
+ * - Monte Carlo rollouts with perturbed mass, inertia, surface areas and initial state
+ * report the touchdown dispersion, open loop and with TVLQR tracking
+ * usage : ./obvp_monte_carlo <samples> <threads>
+ */
+
+static void print_statistics(const char *name, const fpgm_collocation::dispersion_report::statistics &s)
+{
+    printf("%-8s mean %10.4lf sigma %10.4lf min %10.4lf max %10.4lf p05 %10.4lf p95 %10.4lf\n",
+        name, s.mean, s.sigma, s.min, s.max, s.p05, s.p95);
+}
+
+static void print_report(const char *title, const fpgm_collocation::dispersion_report &report)
+{
+    printf("\n%s : %d samples, %d touchdowns, %d diverged, %lfs\n",
+        title, report.samples, report.touchdowns, report.diverged, report.solve_time);
+    print_statistics("x", report.x);
+    print_statistics("z", report.z);
+    print_statistics("vx", report.vx);
+    print_statistics("vz", report.vz);
+    print_statistics("speed", report.speed);
+}
+
+int main(int argc, char **argv)
+{
+    fpgm_collocation::dispersion_options options;
+    options.samples = argc > 1 ? std::max(1, atoi(argv[1])) : 1000;
+    options.threads = argc > 2 ? std::max(1, atoi(argv[2])) :
+        std::max(1, (int)std::thread::hardware_concurrency());
+
+    std::string params_directory = "parameters.yaml";
+    fpgm_collocation::landing_problem::landing_settings settings;
+    if (!fpgm_collocation::landing_problem::load_settings(params_directory, settings))
+        return -1;
+
+    fpgm_collocation::fpgm_collocation fpgm;
+    fpgm_collocation::fpgm_collocation::control_state control_guess;
+    fpgm_collocation::landing_problem problem;
+    problem.verbose = false;
+    if (!problem.setup(settings, params_directory, fpgm, control_guess))
+        return -1;
+    fpgm.set_verbose(false);
+
+    fpgm_collocation::fpgm_collocation::solve_report report;
+    fpgm_collocation::fpgm_collocation::control_state plan =
+        fpgm_collocation::landing_problem::solve(fpgm, settings.solver, settings.mesh, report);
+    if (plan.x.empty())
+        return -1;
+
+    const fpgm_collocation::equations_and_helper::fpgm_param &parameter = fpgm.get_parameters();
+    double ground_height = settings.height_of_land;
+
+    // nominal under the continuous model
+    fpgm_collocation::fpgm_simulator::trajectory nominal =
+        fpgm_collocation::fpgm_simulator::simulate_rk45(
+        parameter, plan, fpgm_collocation::fpgm_simulator::initial_state(plan), 1E-8, -1E9);
+    fpgm_collocation::fpgm_simulator::state_vector end = nominal.state.back();
+    printf("plan end [x %lf z %lf vx %lf vz %lf] simulated end [x %lf z %lf vx %lf vz %lf] (%zu rk45 steps)\n",
+        plan.x.back(), plan.z.back(), plan.vx.back(), plan.vz.back(),
+        end[0], end[1], end[4], end[5], nominal.t.size());
+
+    print_report("open loop", fpgm_collocation::fpgm_simulator::monte_carlo(
+        parameter, fpgm.get_boundary(), plan, ground_height, options));
+
+    fpgm_collocation::gain_schedule schedule;
+    if (fpgm_collocation::fpgm_tvlqr::compute(plan, parameter, schedule))
+    {
+        options.feedback = &schedule;
+        print_report("tvlqr", fpgm_collocation::fpgm_simulator::monte_carlo(
+            parameter, fpgm.get_boundary(), plan, ground_height, options));
+    }
+
+    return 0;
+}
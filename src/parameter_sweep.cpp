@@ -0,0 +1,270 @@
+/*
+* parameter_sweep.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include "fpgm_collocation.h"
+#include "landing_problem.h"
+#include "work_stealing_pool.h"
+
+// https://stackoverflow.com/questions/5693686/how-to-use-yaml-cpp-in-a-c-program-on-linux
+#include "yaml-cpp/yaml.h"
+
+/**
+ * @brief Sweep over parameters.yaml keys
+ * Every argument after the output file is one axis of the job grid
+ * - key=min:max:count for an evenly spaced range
+ * - key=a,b,c for a list (any value parameters.yaml accepts, e.g. solver=sqp,cobyla)
+ * Each job runs OBVP + collocation with the modified parameters, the result row is
+ * appended to the csv as soon as the job finishes
+ * Rerunning with the same output file and axes skips the jobs already in the file
+ * usage : ./obvp_parameter_sweep <output.csv> [--threads n] key=... key=...
+ */
+
+struct sweep_axis
+{
+    std::string key;
+    std::vector<std::string> values;
+};
+
+static bool parse_axis(const std::string &argument, sweep_axis &axis)
+{
+    size_t equal = argument.find('=');
+    if (equal == std::string::npos || equal == 0)
+        return false;
+    axis.key = argument.substr(0, equal);
+    std::string spec = argument.substr(equal + 1);
+    axis.values.clear();
+
+    if (std::count(spec.begin(), spec.end(), ':') == 2)
+    {
+        double min, max;
+        int count;
+        char c1, c2;
+        std::istringstream ss(spec);
+        if (!(ss >> min >> c1 >> max >> c2 >> count) || count < 1)
+            return false;
+        for (int i = 0; i < count; i++)
+        {
+            std::ostringstream value;
+            value.precision(12);
+            value << (count > 1 ? min + (max - min) * i / (count - 1) : min);
+            axis.values.push_back(value.str());
+        }
+        return true;
+    }
+
+    std::istringstream ss(spec);
+    std::string value;
+    while (std::getline(ss, value, ','))
+        if (!value.empty())
+            axis.values.push_back(value);
+    return !axis.values.empty();
+}
+
+/** @brief keep the complete rows of an interrupted run, a garbled row is dropped and its job runs again
+ * @return false if the file exists with a different header
+ * **/
+static bool resume(const std::string &output, const std::string &header, std::set<size_t> &done)
+{
+    std::ifstream in(output.c_str());
+    if (!in.good())
+        return true;
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    in.close();
+    std::string content = buffer.str();
+    if (content.empty())
+        return true;
+
+    // drop a row cut short by the interruption
+    size_t last = content.rfind('\n');
+    content = last == std::string::npos ? std::string() : content.substr(0, last + 1);
+
+    std::istringstream lines(content);
+    std::string line;
+    if (!std::getline(lines, line) || line != header)
+        return false;
+
+    // a row is the job index (at most 19 digits, it always fits) and one value per column
+    const long columns = std::count(header.begin(), header.end(), ',');
+    std::string kept = header + "\n";
+    while (std::getline(lines, line))
+    {
+        size_t comma = line.find(',');
+        if (comma == 0 || comma == std::string::npos || comma > 19 ||
+            line.find_first_not_of("0123456789") != comma ||
+            std::count(line.begin(), line.end(), ',') != columns)
+            continue;
+        size_t job = (size_t)strtoull(line.c_str(), nullptr, 10);
+        if (done.insert(job).second)
+            kept += line + "\n";
+    }
+
+    std::ofstream out(output.c_str(), std::ios::trunc);
+    out << kept;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("usage : %s <output.csv> [--threads n] key=min:max:count key=a,b,c ...\n", argv[0]);
+        return -1;
+    }
+
+    std::string output = argv[1];
+    int threads = (int)std::thread::hardware_concurrency();
+    std::vector<sweep_axis> axes;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--threads" && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+            continue;
+        }
+        sweep_axis axis;
+        if (!parse_axis(argument, axis))
+        {
+            printf("cannot parse %s\n", argument.c_str());
+            return -1;
+        }
+        axes.push_back(axis);
+    }
+
+    std::string params_directory = "parameters.yaml";
+    std::ifstream f(params_directory.c_str());
+    if (!f.good())
+        return -1;
+    YAML::Node base = YAML::LoadFile(params_directory);
+
+    size_t total = 1;
+    std::string header = "job";
+    for (const sweep_axis &axis : axes)
+    {
+        if (!base[axis.key])
+        {
+            printf("%s is not a parameters.yaml key\n", axis.key.c_str());
+            return -1;
+        }
+        total *= axis.values.size();
+        header += "," + axis.key;
+    }
+    header += ",converged,iterations,cost,max_defect,solve_time,final_position_error,final_speed";
+
+    std::set<size_t> done;
+    if (!resume(output, header, done))
+    {
+        printf("%s was written by a different sweep\n", output.c_str());
+        return -1;
+    }
+
+    FILE *file = fopen(output.c_str(), "a");
+    if (!file)
+        return -1;
+    if (done.empty() && ftell(file) == 0)
+        fprintf(file, "%s\n", header.c_str());
+    fflush(file);
+
+    std::vector<size_t> jobs;
+    for (size_t i = 0; i < total; i++)
+        if (done.count(i) == 0)
+            jobs.push_back(i);
+    printf("%zu jobs, %zu already done, %d threads\n", total, done.size(), threads);
+
+    std::mutex yaml_mutex, file_mutex;
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+    fpgm_collocation::work_stealing_pool pool(threads);
+    pool.run(jobs, [&](size_t job, int worker)
+    {
+        // row-major, the last axis changes fastest
+        std::vector<std::string> values(axes.size());
+        size_t remainder = job;
+        for (int a = (int)axes.size() - 1; a >= 0; a--)
+        {
+            values[a] = axes[a].values[remainder % axes[a].values.size()];
+            remainder /= axes[a].values.size();
+        }
+
+        YAML::Node node;
+        fpgm_collocation::landing_problem::landing_settings settings;
+        {
+            std::lock_guard<std::mutex> lock(yaml_mutex);
+            node = YAML::Clone(base);
+            for (size_t a = 0; a < axes.size(); a++)
+                node[axes[a].key] = values[a];
+            fpgm_collocation::landing_problem::load_settings(node, settings);
+        }
+
+        fpgm_collocation::fpgm_collocation fpgm;
+        fpgm_collocation::fpgm_collocation::control_state control_guess, control_opt;
+        fpgm_collocation::fpgm_collocation::solve_report report = {};
+        fpgm_collocation::landing_problem problem;
+        problem.verbose = false;
+        double position_error = std::numeric_limits<double>::quiet_NaN();
+        double speed = std::numeric_limits<double>::quiet_NaN();
+
+        if (problem.setup(settings, node, fpgm, control_guess))
+        {
+            fpgm.set_verbose(false);
+            control_opt = fpgm_collocation::landing_problem::solve(fpgm, settings.solver, settings.mesh, report);
+            if (!control_opt.x.empty())
+            {
+                // final state against the end of the OBVP (the landing point)
+                const fpgm_collocation::equations_and_helper::optimization_constrain &boundary = fpgm.get_boundary();
+                position_error = sqrt(
+                    pow(control_opt.x.back() - boundary.ix.back(), 2) +
+                    pow(control_opt.z.back() - boundary.iz.back(), 2));
+                speed = sqrt(pow(control_opt.vx.back(), 2) + pow(control_opt.vz.back(), 2));
+            }
+        }
+
+        std::ostringstream row;
+        row.precision(10);
+        row << job;
+        for (const std::string &value : values)
+            row << "," << value;
+        row << "," << report.converged << "," << report.iterations << "," << report.cost <<
+            "," << report.constraint_violation << "," << report.solve_time <<
+            "," << position_error << "," << speed << "\n";
+
+        std::lock_guard<std::mutex> lock(file_mutex);
+        fputs(row.str().c_str(), file);
+        fflush(file);
+    });
+
+    fclose(file);
+    printf("sweep completed in %lfs, results in %s\n",
+        std::chrono::duration<double>(std::chrono::system_clock::now() - start).count(),
+        output.c_str());
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+* solver_benchmark.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "fpgm_collocation.h"
+#include "fpgm_sqp.h"
+#include "fpgm_ilqr.h"
+#include "landing_problem.h"
+
+/**
+ * @brief Solver backends on the same landing problem
+ * Every backend starts from the same OBVP guess, cost and defect are measured with
+ * the same functions (control effort without the start penalty, max trapezoidal defect)
+ * - COBYLA and SLSQP only hold the defects within the +-0.01 band of collocation_eq_constraints
+ * - the native sqp holds them as equality constrains
+ * - ilqr rolls out rk4 from the first knot, its trapezoidal defect is the rk4/trapezoid mismatch
+ * usage : ./obvp_solver_benchmark <repetitions> <command_time>
+ * a smaller command_time gives more knots (N = total_time / command_time)
+ */
+
+struct benchmark_entry
+{
+    std::string name;
+    fpgm_collocation::fpgm_collocation::solve_report report;
+    std::vector<double> times;
+};
+
+int main(int argc, char **argv)
+{
+    int repetitions = argc > 1 ? std::max(1, atoi(argv[1])) : 5;
+
+    std::string params_directory = "parameters.yaml";
+    fpgm_collocation::landing_problem::landing_settings settings;
+    if (!fpgm_collocation::landing_problem::load_settings(params_directory, settings))
+        return -1;
+    if (argc > 2)
+        settings.command_time = atof(argv[2]);
+
+    fpgm_collocation::fpgm_collocation fpgm;
+    fpgm_collocation::fpgm_collocation::control_state control_guess;
+    fpgm_collocation::landing_problem problem;
+    problem.verbose = false;
+    if (!problem.setup(settings, params_directory, fpgm, control_guess))
+        return -1;
+    fpgm.set_verbose(false);
+
+    const std::vector<double> &guess = fpgm.get_initial_guess();
+    int N = (int)guess.size() / 8;
+
+    std::vector<benchmark_entry> entries(6);
+    entries[0].name = "nlopt_cobyla";
+    entries[1].name = "nlopt_slsqp";
+    entries[2].name = "sqp_riccati";
+    entries[3].name = "sqp_sparse_lu";
+    entries[4].name = "sqp_dense_lu";
+    entries[5].name = "ilqr";
+
+    for (int r = 0; r < repetitions; r++)
+    {
+        fpgm.nlopt_optimization(NLOPT_LN_COBYLA);
+        entries[0].report = fpgm.get_last_report();
+
+        fpgm.nlopt_optimization(NLOPT_LD_SLSQP);
+        entries[1].report = fpgm.get_last_report();
+
+        fpgm_collocation::sqp_options options;
+        const fpgm_collocation::kkt_backend backends[3] = {
+            fpgm_collocation::RICCATI, fpgm_collocation::SPARSE_LU, fpgm_collocation::DENSE_LU};
+        for (int b = 0; b < 3; b++)
+        {
+            options.backend = backends[b];
+            fpgm_collocation::fpgm_sqp sqp(fpgm.get_parameters(), fpgm.get_boundary(), options);
+            sqp.solve(guess);
+            entries[2 + b].report = sqp.get_report();
+        }
+
+        fpgm_collocation::fpgm_ilqr ilqr(fpgm.get_parameters(), fpgm.get_boundary());
+        ilqr.solve(guess);
+        entries[5].report = ilqr.get_report();
+
+        for (auto &entry : entries)
+            entry.times.push_back(entry.report.solve_time);
+    }
+
+    printf("\nN = %d, guess cost %lf, guess defect %lf, %d repetitions\n", N,
+        fpgm_collocation::fpgm_collocation::trajectory_cost(guess.data(), N, fpgm.get_parameters()),
+        fpgm_collocation::fpgm_collocation::max_defect(guess.data(), N, fpgm.get_parameters()),
+        repetitions);
+    printf("%-16s %-10s %-10s %-14s %-12s %-12s\n",
+        "solver", "converged", "iter/eval", "cost", "max_defect", "median_time");
+    for (auto &entry : entries)
+    {
+        std::sort(entry.times.begin(), entry.times.end());
+        printf("%-16s %-10d %-10d %-14lf %-12.3e %-12.6lf\n",
+            entry.name.c_str(), entry.report.converged, entry.report.iterations,
+            entry.report.cost, entry.report.constraint_violation,
+            entry.times[entry.times.size() / 2]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*
+* trajectory_index_test.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <random>
+
+#include "trajectory_index.h"
+
+/**
+ * @brief Checks of the k-d tree file and the warm start blend, returns non zero if one fails
+ * usage : ./obvp_trajectory_index_test
+ */
+
+using fpgm_collocation::kd_tree;
+using fpgm_collocation::trajectory_library;
+using fpgm_collocation::warm_start;
+
+static const int D = 4;
+static const char *index_path = "trajectory_index_test.kdtr";
+static const char *library_path = "trajectory_index_test.fptl";
+
+static int failures = 0;
+
+static void check(const char *name, bool pass)
+{
+    printf("%-40s %s\n", name, pass ? "ok" : "FAILED");
+    if (!pass)
+        failures++;
+}
+
+static std::vector<char> read_file(const char *path)
+{
+    std::vector<char> content;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return content;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        content.insert(content.end(), buffer, buffer + n);
+    fclose(file);
+    return content;
+}
+
+static void write_file(const char *path, const std::vector<char> &content)
+{
+    FILE *file = fopen(path, "wb");
+    fwrite(content.data(), 1, content.size(), file);
+    fclose(file);
+}
+
+/** @brief load a modified copy of a saved tree, a bad file has to fail and leave the tree empty **/
+static void check_rejected(const char *name, const std::vector<char> &content)
+{
+    write_file(index_path, content);
+    kd_tree<D> tree;
+    bool loaded = tree.load(index_path);
+    check(name, !loaded && tree.size() == 0);
+}
+
+static void kd_tree_file()
+{
+    std::mt19937 generator(5);
+    std::uniform_real_distribution<double> uniform(-10.0, 10.0);
+    const int count = 500;
+    std::vector<double> keys(count * D);
+    for (double &k : keys)
+        k = uniform(generator);
+    const double scale[D] = {1.0, 0.5, 2.0, 0.1};
+
+    kd_tree<D> tree;
+    tree.build(keys.data(), count, scale);
+    check("kd_tree save", tree.save(index_path));
+
+    kd_tree<D> loaded;
+    check("kd_tree load", loaded.load(index_path) && loaded.size() == count);
+
+    // the loaded tree answers like a brute force search
+    bool same = true;
+    for (int q = 0; q < 50; q++)
+    {
+        double query[D];
+        for (int a = 0; a < D; a++)
+            query[a] = uniform(generator);
+
+        std::vector<std::pair<double, int>> brute(count);
+        for (int i = 0; i < count; i++)
+        {
+            double d = 0.0;
+            for (int a = 0; a < D; a++)
+                d += pow((keys[i * D + a] - query[a]) * scale[a], 2);
+            brute[i] = std::make_pair(d, i);
+        }
+        std::sort(brute.begin(), brute.end());
+
+        int index[4];
+        double distance_squared[4];
+        int found = loaded.knn(query, 4, index, distance_squared);
+        same &= found == 4;
+        for (int i = 0; i < found; i++)
+            same &= index[i] == brute[i].second && fabs(distance_squared[i] - brute[i].first) < 1E-9;
+    }
+    check("kd_tree knn after load", same);
+
+    const std::vector<char> good = read_file(index_path);
+    const size_t header_size = 4 + 3 * sizeof(uint32_t) + D * sizeof(double);
+    uint32_t node_count;
+    memcpy(&node_count, good.data() + 8, sizeof(uint32_t));
+
+    check_rejected("kd_tree truncated", std::vector<char>(good.begin(), good.end() - 1));
+    check_rejected("kd_tree truncated in the nodes", std::vector<char>(good.begin(), good.begin() + header_size + 10));
+
+    std::vector<char> bad = good;
+    uint32_t huge = 0x7fffffff;
+    memcpy(bad.data() + 8, &huge, sizeof(uint32_t));
+    check_rejected("kd_tree node count past the file", bad);
+
+    bad = good;
+    memcpy(bad.data() + 12, &huge, sizeof(uint32_t));
+    check_rejected("kd_tree key count past the file", bad);
+
+    // no nodes for the keys, the file size still adds up
+    bad.assign(good.begin(), good.begin() + header_size);
+    bad.insert(bad.end(), good.begin() + header_size + node_count * sizeof(kd_tree<D>::node), good.end());
+    uint32_t zero = 0;
+    memcpy(bad.data() + 8, &zero, sizeof(uint32_t));
+    check_rejected("kd_tree keys without nodes", bad);
+
+    // child of the root out of range, then pointing back at the root
+    kd_tree<D>::node root;
+    memcpy(&root, good.data() + header_size, sizeof(root));
+    bad = good;
+    root.left = (int32_t)node_count;
+    memcpy(bad.data() + header_size, &root, sizeof(root));
+    check_rejected("kd_tree child out of range", bad);
+
+    memcpy(&root, good.data() + header_size, sizeof(root));
+    root.right = 0;
+    memcpy(bad.data() + header_size, &root, sizeof(root));
+    check_rejected("kd_tree child before its parent", bad);
+
+    memcpy(&root, good.data() + header_size, sizeof(root));
+    root.dimension = D;
+    memcpy(bad.data() + header_size, &root, sizeof(root));
+    check_rejected("kd_tree split dimension", bad);
+
+    memcpy(&root, good.data() + header_size, sizeof(root));
+    root.end = count + 1;
+    memcpy(bad.data() + header_size, &root, sizeof(root));
+    check_rejected("kd_tree key range", bad);
+
+    bad = good;
+    int32_t outside = count;
+    memcpy(bad.data() + good.size() - sizeof(int32_t), &outside, sizeof(int32_t));
+    check_rejected("kd_tree order out of range", bad);
+
+    remove(index_path);
+}
+
+/** @brief every channel of the stored trajectory is constant at value **/
+static trajectory_library::solution constant_solution(int knots, double value, double h)
+{
+    trajectory_library::solution s;
+    std::vector<double> channel(knots, value);
+    s.state.x = s.state.z = s.state.theta = s.state.phi = channel;
+    s.state.vx = s.state.vz = s.state.thetadot = s.state.phidot = channel;
+    s.converged = knots > 0;
+    s.cost = 0.0;
+    s.h = h;
+    return s;
+}
+
+static void warm_start_blend()
+{
+    // three grid points on the first axis, the middle one failed to solve
+    std::vector<trajectory_library::axis> axes = {{10.0, 20.0, 3}, {30.0, 30.0, 1}, {5.0, 5.0, 1}, {0.5, 0.5, 1}};
+    std::vector<trajectory_library::solution> solutions = {
+        constant_solution(10, 1.0, 0.1), constant_solution(0, 0.0, 0.0), constant_solution(30, 3.0, 0.05)};
+    check("warm_start write library", trajectory_library::write(library_path, axes, solutions));
+
+    trajectory_library library;
+    check("warm_start open library", library.open(library_path));
+
+    const size_t index[3] = {0, 1, 2};
+    const double weight[3] = {0.25, 0.5, 0.75};
+    warm_start start;
+    bool ok = warm_start::blend(library, index, weight, 3, start);
+    check("warm_start blend", ok);
+
+    // the failed entry is dropped, 0.25 / 0.75 are already normalized
+    bool blended = ok && start.knots == 25 && (int)start.guess.size() == 8 * start.knots &&
+        (int)start.x.size() == start.knots && (int)start.z.size() == start.knots;
+    for (size_t i = 0; blended && i < start.guess.size(); i++)
+        blended = fabs(start.guess[i] - 2.5) < 1E-12;
+    check("warm_start knots and values", blended);
+    check("warm_start total time", ok && fabs(start.total_time() - (0.25 * 1.0 + 0.75 * 1.5)) < 1E-12);
+
+    warm_start fixed;
+    check("warm_start fixed knot count", warm_start::blend(library, index, weight, 3, fixed, 7) &&
+        fixed.knots == 7 && fabs(fixed.guess[8 * 6] - 2.5) < 1E-12);
+
+    const size_t failed[1] = {1};
+    const double one[1] = {1.0};
+    warm_start none;
+    check("warm_start no valid entry", !warm_start::blend(library, failed, one, 1, none));
+
+    library.close();
+    remove(library_path);
+}
+
+int main(int argc, char **argv)
+{
+    kd_tree_file();
+    warm_start_blend();
+
+    printf("%d failure(s)\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/*
+* trajectory_library_builder.cpp
+*
+* ---------------------------------------------------------------------
+* Copyright (C) 2022 Matthew (matthewoots at gmail.com)
+*
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+* ---------------------------------------------------------------------
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "fpgm_collocation.h"
+#include "landing_problem.h"
+#include "trajectory_library.h"
+
+// https://stackoverflow.com/questions/5693686/how-to-use-yaml-cpp-in-a-c-program-on-linux
+#include "yaml-cpp/yaml.h"
+
+/**
+ * @brief Trajectory library builder
+ * Sweeps the library_* ranges of parameters.yaml ([min, max, count] for airspeed,
+ * descend_pitch_deg, height_of_descend and height_of_land), solves every grid point
+ * with the solver in parameters.yaml and writes the control_state arrays
+ * to a trajectory_library file
+ * usage : ./obvp_trajectory_library <output file> <threads>
+ */
+
+int main(int argc, char **argv)
+{
+    std::string output = argc > 1 ? std::string(argv[1]) : "trajectory_library.bin";
+    int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    threads = std::max(1, threads);
+
+    std::string params_directory = "parameters.yaml";
+    fpgm_collocation::landing_problem::landing_settings nominal;
+    if (!fpgm_collocation::landing_problem::load_settings(params_directory, nominal))
+        return -1;
+    // entries are stored with a single time step
+    nominal.touchdown_refine_time = 0.0;
+
+    YAML::Node node = YAML::LoadFile(params_directory);
+    const char *keys[4] = {
+        "library_airspeed", "library_descend_pitch_deg",
+        "library_height_of_descend", "library_height_of_land"};
+    const double defaults[4] = {
+        nominal.airspeed, nominal.descend_pitch_deg,
+        nominal.height_of_descend, nominal.height_of_land};
+
+    // a missing range keeps the single value of parameters.yaml
+    std::vector<fpgm_collocation::trajectory_library::axis> axes(4);
+    size_t total = 1;
+    for (int a = 0; a < 4; a++)
+    {
+        axes[a] = {defaults[a], defaults[a], 1};
+        if (node[keys[a]] && node[keys[a]].size() == 3)
+        {
+            axes[a].min = node[keys[a]][0].as<double>();
+            axes[a].max = node[keys[a]][1].as<double>();
+            axes[a].count = std::max(1, node[keys[a]][2].as<int>());
+        }
+        total *= axes[a].count;
+        printf("%s [%lf %lf] x %d\n", keys[a], axes[a].min, axes[a].max, axes[a].count);
+    }
+
+    std::vector<fpgm_collocation::trajectory_library::solution> solutions(total);
+    std::atomic<size_t> next(0);
+    std::atomic<int> converged(0);
+    std::mutex print_mutex;
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < total; i = next++)
+        {
+            fpgm_collocation::trajectory_library::solution &s = solutions[i];
+            s.converged = false;
+            s.cost = 0.0;
+            s.h = 0.0;
+
+            // row-major, the last axis changes fastest
+            double key[4];
+            size_t remainder = i;
+            for (int a = 3; a >= 0; a--)
+            {
+                key[a] = axes[a].value((int)(remainder % axes[a].count));
+                remainder /= axes[a].count;
+            }
+
+            fpgm_collocation::landing_problem::landing_settings settings = nominal;
+            settings.airspeed = key[0];
+            settings.descend_pitch_deg = key[1];
+            settings.height_of_descend = key[2];
+            settings.height_of_land = key[3];
+
+            fpgm_collocation::fpgm_collocation fpgm;
+            fpgm_collocation::fpgm_collocation::control_state control_guess;
+            fpgm_collocation::landing_problem problem;
+            problem.verbose = false;
+            if (!problem.setup(settings, params_directory, fpgm, control_guess))
+                continue;
+            fpgm.set_verbose(false);
+
+            fpgm_collocation::fpgm_collocation::solve_report report;
+            s.state = fpgm_collocation::landing_problem::solve(fpgm, settings.solver, report);
+            s.converged = report.converged;
+            s.cost = report.cost;
+            s.h = fpgm.get_parameters().h;
+            if (s.converged)
+                converged++;
+
+            std::lock_guard<std::mutex> lock(print_mutex);
+            printf("[%zu/%zu] airspeed %lf pitch %lf descend %lf land %lf cost %lf converged %d\n",
+                i + 1, total, key[0], key[1], key[2], key[3], s.cost, s.converged);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++)
+        pool.push_back(std::thread(worker));
+    for (auto &t : pool)
+        t.join();
+
+    double build_time = std::chrono::duration<double>(
+        std::chrono::system_clock::now() - start).count();
+    printf("%d / %zu grid points converged, %d threads, %lfs\n",
+        converged.load(), total, threads, build_time);
+
+    if (!fpgm_collocation::trajectory_library::write(output, axes, solutions))
+    {
+        printf("failed to write %s\n", output.c_str());
+        return -1;
+    }
+    printf("saved %s\n", output.c_str());
+
+    return 0;
+}